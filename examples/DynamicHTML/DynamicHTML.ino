@@ -51,37 +51,96 @@ byte mac[] = {0x00, 0xAA, 0xBB, 0xCC, 0xDE, 0x02};
 // and you must provide a callback with the following two methods.  'IsMutable' is called
 // to determine which files you want to change, and 'FileAction' is called to do the
 // actual work.
+
+//  If you process over multiple calls, you need somewhere to keep your state between
+//  them.  Two browsers loading the page at once each need their own, so define
+//  YAAWS_CONTEXT_SIZE (in YAAWS.h) and it is kept in the request's context.  Without it,
+//  the only place for it is the handler, shared by every request, and only one client
+//  can be loading the page at a time.
+struct AnalogPage
+{
+	YaawsResumePoint resume;   //  Where 'FileAction' carries on from.
+	int pin;                   //  Next analog pin to report.
+};
+
+#ifdef YAAWS_CONTEXT_SIZE
+static_assert(sizeof(AnalogPage) <= YAAWS_CONTEXT_SIZE,
+	"YAAWS_CONTEXT_SIZE is too small for the page state");
+#endif
+
 class DynamicHTMLHandler : public YaawsCallback
 {
 public:
-	DynamicHTMLHandler();
+	//  We override only some of each set of overloads, keep the rest in view.
+	using YaawsCallback::IsMutable;
+	using YaawsCallback::FileAction;
 
+#ifdef YAAWS_CONTEXT_SIZE
+	bool IsMutable(const char *path, void *context);
+	bool FileAction(EthernetClient &, WebFileType &, void *context);
+#else
 	bool IsMutable(const char *path);
 	bool FileAction(EthernetClient &, WebFileType &);
+#endif
 
 private:
-	//  If you process over multiple calls, you'll need to keep your state in the handler.
-	int _stepNumber;  //  What 'step' of processing we are on.
-};
+	bool IsAnalogPage(const char *path);
+	bool SendPage(EthernetClient &, WebFileType &, AnalogPage &page);
 
-DynamicHTMLHandler::DynamicHTMLHandler()
-	: _stepNumber(0)
-{}
+#ifndef YAAWS_CONTEXT_SIZE
+	AnalogPage _page;
+#endif
+};
 
 
-bool DynamicHTMLHandler::IsMutable(
+bool DynamicHTMLHandler::IsAnalogPage(
 	const char *path)
 {
 	Serial.print(F("IsMutable() called for: "));
 	Serial.println(path);
 
-	auto val = strcasecmp_P(path, PSTR("/analog.html"));
+	return (strcasecmp_P(path, PSTR("/analog.html")) == 0);
+}
+
+
+#ifdef YAAWS_CONTEXT_SIZE
+//  The context is zeroed for each new request, so the page starts from the top.
+bool DynamicHTMLHandler::IsMutable(
+	const char *path,
+	void *)
+{
+	return IsAnalogPage(path);
+}
+
+
+bool DynamicHTMLHandler::FileAction(
+	EthernetClient &client,
+	WebFileType &file,
+	void *context)
+{
+	return SendPage(client, file, *static_cast<AnalogPage *>(context));
+}
+#else
+bool DynamicHTMLHandler::IsMutable(
+	const char *path)
+{
+	if (!IsAnalogPage(path))
+	{
+		return false;
+	}
+
+	_page.resume = 0;
+	return true;
+}
 
-	if (val == 0)
-		_stepNumber = 0;
 
-	return (val == 0);
+bool DynamicHTMLHandler::FileAction(
+	EthernetClient &client,
+	WebFileType &file)
+{
+	return SendPage(client, file, _page);
 }
+#endif
 
 
 //  The HTML we will emit once the 'special' file is requested.
@@ -119,9 +178,10 @@ typedef const __FlashStringHelper *fsh;
 //  client, and the file is positioned at the beginning, with nothing sent.  Once you
 //  return 'false', the server will take care of sending the rest of the file and closing
 //  the connection, and you will not be called any more for this request.
-bool DynamicHTMLHandler::FileAction(
+bool DynamicHTMLHandler::SendPage(
 	EthernetClient &client,
-	WebFileType &file)
+	WebFileType &file,
+	AnalogPage &page)
 {
 
 	//  If you have multiple files you want to change in different ways, you can check the
@@ -133,44 +193,34 @@ bool DynamicHTMLHandler::FileAction(
 	//  You can do as much or as little work as you like each time you are called, keeping
 	//  in mind that long operations will block the rest of your sketch.
 	//
-	//  For demonstration purposes, we split the processing here into 3 phases.
-	if (_stepNumber == 0)
-	{
-		client.print((fsh)Html1);
-		_stepNumber++;
+	//  For demonstration purposes, we give up the processor after the page heading and
+	//  after each pin.  'YAAWS_YIELD' returns 'true', and the next call carries on from
+	//  just after it.  Local variables are lost across a yield, so the loop counter is
+	//  kept with the rest of the page's state.
+	YAAWS_BEGIN(page.resume);
 
-		return true;
-	}
+	client.print((fsh)Html1);
+	YAAWS_YIELD(page.resume);
+
+	client.print((fsh)Html2);
 
-	if (_stepNumber == 1)
+	for (page.pin = A0; page.pin < A5; page.pin++)
 	{
-		client.print((fsh)Html2);
-
-		for (auto i = A0; i < A5; i++)
-		{
-			auto val = analogRead(i);
-
-			client.print(F("<span style=\"float:left\">"));
-			client.print(i);
-			client.print(F("</span><span style=\"float:right\">"));
-			client.print(val);
-			client.print(F("</span><br>"));
-		}
-		_stepNumber++;
-		return true;
+		client.print(F("<span style=\"float:left\">"));
+		client.print(page.pin);
+		client.print(F("</span><span style=\"float:right\">"));
+		client.print(analogRead(page.pin));
+		client.print(F("</span><br>"));
+		YAAWS_YIELD(page.resume);
 	}
 
-	if (_stepNumber == 2)
-	{
-		client.print((fsh)Html3);
-		_stepNumber++;
+	client.print((fsh)Html3);
 
-		//  Just skip over the file entirely!
-		file.seekEnd();
-	}
+	//  Just skip over the file entirely!
+	file.seekEnd();
 
 	//  Now let the server do the rest.
-	return false;
+	YAAWS_END(page.resume);
 }
 
 DynamicHTMLHandler handler;
@@ -50,6 +50,9 @@ byte mac[] = {0x00, 0xAA, 0xBB, 0xCC, 0xDE, 0x02};
 
 class FormHandler : public YaawsCallback
 {
+	//  We override only one of the 'ProcessFormData' overloads, keep the rest in view.
+	using YaawsCallback::ProcessFormData;
+
 	bool ProcessFormData(const char *path, char *FormData);
 };
 
@@ -50,8 +50,21 @@ byte mac[] = {0x00, 0xAA, 0xBB, 0xCC, 0xDE, 0x02};
 
 class PostHandler : public YaawsCallback
 {
+	//  We override only some of the 'ProcessPostData' overloads, keep the rest in view.
+	using YaawsCallback::ProcessPostData;
+
 	bool ProcessPostData(const char *path, EthernetClient &,
 						 unsigned long contentLength);
+
+#ifdef YAAWS_CONTEXT_SIZE
+	//  With request contexts the server calls this one, and this example has no use for
+	//  the context.
+	bool ProcessPostData(const char *path, EthernetClient &client,
+						 unsigned long contentLength, void *)
+	{
+		return ProcessPostData(path, client, contentLength);
+	}
+#endif
 };
 
 
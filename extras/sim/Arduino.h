@@ -0,0 +1,223 @@
+//  MIT License
+//
+//  Copyright(c) 2019 M Hotchin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this
+//  software and associated documentation files(the "Software"), to deal in the Software
+//  without restriction, including without limitation the rights to use, copy, modify,
+//  merge, publish, distribute, sublicense, and/or sell copies of the Software, andto
+//  permit persons to whom the Software is furnished to do so, subject to the following
+//  conditions :
+//
+//  The above copyright notice andthis permission notice shall be included in all copies
+//  or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+//  CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+//  OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//  Just enough of the Arduino core to build YAAWS on a PC, for the simulation.  Flash
+//  is ordinary memory, and the clock is the simulation's virtual clock (see YaawsSim.h).
+
+#ifndef YAAWS_SIM_ARDUINO_H
+#define YAAWS_SIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+//  The C++ library, ahead of the 'min' and 'max' macros below, which would break it.
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define ARDUINO 10800
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(PSTR(s)))
+
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define pgm_read_ptr(p) (*(void *const *)(p))
+
+#define memcpy_P memcpy
+#define memcmp_P memcmp
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strcat_P strcat
+inline char *strncat_P(char *dst, const void *src, size_t size)
+{
+	return strncat(dst, (const char *)src, size);
+}
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcasecmp_P strcasecmp
+#define strncasecmp_P strncasecmp
+#define strstr_P strstr
+#define strlen_P strlen
+
+char *ultoa(unsigned long value, char *buffer, int radix);
+char *ltoa(long value, char *buffer, int radix);
+
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#define constrain(amt, low, high) \
+	((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define LED_BUILTIN 13
+
+#define DEC 10
+#define HEX 16
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+
+class Print
+{
+public:
+	virtual ~Print() {}
+
+	virtual size_t write(uint8_t) = 0;
+	virtual size_t write(const uint8_t *buffer, size_t size);
+	size_t write(const char *str)
+	{
+		return (str == nullptr) ? 0 : write((const uint8_t *)str, strlen(str));
+	}
+	size_t write(const char *buffer, size_t size)
+	{
+		return write((const uint8_t *)buffer, size);
+	}
+
+	virtual int availableForWrite() { return 0; }
+	virtual void flush() {}
+
+	size_t print(const __FlashStringHelper *);
+	size_t print(const char *);
+	size_t print(char);
+	size_t print(unsigned char, int = DEC);
+	size_t print(int, int = DEC);
+	size_t print(unsigned int, int = DEC);
+	size_t print(long, int = DEC);
+	size_t print(unsigned long, int = DEC);
+	size_t print(double, int = 2);
+
+	size_t println();
+	template <class T> size_t println(T value)
+	{
+		size_t n = print(value);
+		return n + println();
+	}
+	template <class T> size_t println(T value, int format)
+	{
+		size_t n = print(value, format);
+		return n + println();
+	}
+};
+
+
+class Stream : public Print
+{
+public:
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+
+	//  Waits up to the timeout (virtual time) for 'length' bytes.
+	size_t readBytes(char *buffer, size_t length);
+	size_t readBytes(uint8_t *buffer, size_t length)
+	{
+		return readBytes((char *)buffer, length);
+	}
+	void setTimeout(unsigned long timeout) { _timeout = timeout; }
+
+protected:
+	unsigned long _timeout = 1000;
+};
+
+
+//  Trace output goes nowhere unless YaawsSim::Verbose(true).
+class HardwareSerial : public Stream
+{
+public:
+	void begin(unsigned long) {}
+	operator bool() { return true; }
+
+	size_t write(uint8_t c) override;
+	using Print::write;
+	int available() override { return 0; }
+	int read() override { return -1; }
+	int peek() override { return -1; }
+};
+
+extern HardwareSerial Serial;
+
+
+class IPAddress
+{
+public:
+	IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0)
+		: _address{a, b, c, d}
+	{}
+
+	uint8_t operator[](int index) const { return _address[index]; }
+	uint8_t &operator[](int index) { return _address[index]; }
+
+private:
+	uint8_t _address[4];
+};
+
+
+class Client : public Stream
+{
+public:
+	virtual int connect(IPAddress ip, uint16_t port) = 0;
+	virtual size_t write(uint8_t) = 0;
+	virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+	virtual int read(uint8_t *buffer, size_t size) = 0;
+	virtual void stop() = 0;
+	virtual uint8_t connected() = 0;
+	virtual operator bool() = 0;
+
+	using Stream::read;
+	using Print::write;
+};
+
+
+class Server : public Print
+{
+public:
+	virtual void begin() = 0;
+};
+
+#endif
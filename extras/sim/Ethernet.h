@@ -0,0 +1,108 @@
+//  MIT License
+//
+//  Copyright(c) 2019 M Hotchin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this
+//  software and associated documentation files(the "Software"), to deal in the Software
+//  without restriction, including without limitation the rights to use, copy, modify,
+//  merge, publish, distribute, sublicense, and/or sell copies of the Software, andto
+//  permit persons to whom the Software is furnished to do so, subject to the following
+//  conditions :
+//
+//  The above copyright notice andthis permission notice shall be included in all copies
+//  or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+//  CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+//  OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//  The Ethernet library (2.x) for the simulation, over a model of a W5x00 chip: a fixed
+//  number of sockets, each with its own send and receive buffer.  What the server
+//  writes waits in the send buffer until the simulated wire carries it to the peer, so
+//  'availableForWrite' behaves as it does on the chip.  Peers are driven from YaawsSim.h.
+
+#ifndef ethernet_h_
+#define ethernet_h_
+
+#include "Arduino.h"
+
+#ifndef MAX_SOCK_NUM
+#define MAX_SOCK_NUM 8
+#endif
+
+enum EthernetHardwareStatus
+{
+	EthernetNoHardware,
+	EthernetW5100,
+	EthernetW5200,
+	EthernetW5500
+};
+
+
+class EthernetClient : public Client
+{
+public:
+	EthernetClient() : _socket(MAX_SOCK_NUM) {}
+	EthernetClient(uint8_t socket) : _socket(socket) {}
+
+	uint8_t status();
+	int connect(IPAddress, uint16_t) override { return 0; }
+	size_t write(uint8_t c) override { return write(&c, 1); }
+	size_t write(const uint8_t *buffer, size_t size) override;
+	int availableForWrite() override;
+	int available() override;
+	int read() override;
+	int read(uint8_t *buffer, size_t size) override;
+	int peek() override;
+	void flush() override;
+	void stop() override;
+	uint8_t connected() override;
+	operator bool() override { return _socket < MAX_SOCK_NUM; }
+	uint8_t getSocketNumber() const { return _socket; }
+	IPAddress remoteIP();
+
+	using Print::write;
+
+private:
+	uint8_t _socket;
+};
+
+
+class EthernetServer : public Server
+{
+public:
+	EthernetServer(uint16_t port) : _port(port) {}
+
+	EthernetClient available();
+	EthernetClient accept();
+	void begin() override;
+	size_t write(uint8_t) override { return 0; }
+	size_t write(const uint8_t *, size_t) override { return 0; }
+	operator bool();
+
+	using Print::write;
+
+private:
+	uint16_t _port;
+};
+
+
+class EthernetClass
+{
+public:
+	static EthernetHardwareStatus hardwareStatus();
+
+	friend class EthernetClient;
+	friend class EthernetServer;
+
+private:
+	static uint8_t socketStatus(uint8_t socket);
+};
+
+extern EthernetClass Ethernet;
+
+#endif
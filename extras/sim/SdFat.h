@@ -0,0 +1,155 @@
+//  MIT License
+//
+//  Copyright(c) 2019 M Hotchin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this
+//  software and associated documentation files(the "Software"), to deal in the Software
+//  without restriction, including without limitation the rights to use, copy, modify,
+//  merge, publish, distribute, sublicense, and/or sell copies of the Software, andto
+//  permit persons to whom the Software is furnished to do so, subject to the following
+//  conditions :
+//
+//  The above copyright notice andthis permission notice shall be included in all copies
+//  or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+//  CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+//  OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//  SdFat (1.x) for the simulation, over an in-memory card.  Directories keep their
+//  entries in slots like a FAT directory - a removed entry leaves a hole that the next
+//  new file fills - and every sector read or written costs virtual time.  The card is
+//  filled and examined from YaawsSim.h.
+
+#ifndef SdFat_h
+#define SdFat_h
+
+#include "Arduino.h"
+
+#include <memory>
+
+typedef int oflag_t;
+
+#define O_RDONLY 0x00
+#define O_WRONLY 0x01
+#define O_RDWR   0x02
+#define O_ACCMODE 0x03
+#define O_APPEND 0x08
+#define O_CREAT  0x0200
+#define O_TRUNC  0x0400
+#define O_EXCL   0x0800
+#define O_AT_END 0x4000
+#define O_READ   O_RDONLY
+#define O_WRITE  O_WRONLY
+
+struct dir_t
+{
+	uint8_t name[11];
+	uint8_t attributes;
+	uint16_t lastWriteTime;
+	uint16_t lastWriteDate;
+	uint32_t fileSize;
+};
+
+#define FAT_YEAR(d) (1980 + ((d) >> 9))
+#define FAT_MONTH(d) (((d) >> 5) & 0XF)
+#define FAT_DAY(d) ((d) & 0X1F)
+#define FAT_HOUR(t) ((t) >> 11)
+#define FAT_MINUTE(t) (((t) >> 5) & 0X3F)
+#define FAT_SECOND(t) (2 * ((t) & 0X1F))
+
+namespace YaawsSim
+{
+	struct Node;
+
+	uint32_t CardBlocks();
+	bool CardExists(const char *path);
+	bool CardMkdir(const char *path);
+	bool CardRemove(const char *path);
+	bool CardRename(const char *oldPath, const char *newPath);
+}
+
+
+class FatFile
+{
+public:
+	bool open(const char *path, oflag_t flags = O_RDONLY);
+	bool open(FatFile *dir, uint16_t index, oflag_t flags);
+	bool openNext(FatFile *dir, oflag_t flags = O_RDONLY);
+	bool close();
+
+	bool isOpen() const { return (bool)_node; }
+	bool isDir() const;
+	bool isFile() const { return isOpen() && !isDir(); }
+	bool isHidden() const;
+	bool isReadOnly() const;
+
+	uint32_t fileSize() const;
+	uint32_t curPosition() const { return _position; }
+	bool seekSet(uint32_t position);
+	bool seekCur(int32_t offset) { return seekSet(_position + offset); }
+	bool seekEnd(int32_t offset = 0) { return seekSet(fileSize() + offset); }
+
+	int read();
+	int read(void *buffer, size_t size);
+	int write(const void *buffer, size_t size);
+	bool sync();
+	bool truncate(uint32_t length);
+
+	uint32_t firstCluster() const;
+	uint16_t dirIndex() const { return _dirIndex; }
+	bool dirEntry(dir_t *entry);
+	bool getName(char *name, size_t size);
+
+private:
+	bool OpenNode(std::shared_ptr<YaawsSim::Node> node, uint16_t index, oflag_t flags);
+
+	std::shared_ptr<YaawsSim::Node> _node;
+	uint32_t _position = 0;
+	oflag_t _flags = 0;
+	uint16_t _dirIndex = 0;
+};
+
+
+class SdFile : public FatFile, public Print
+{
+public:
+	size_t write(uint8_t c) override { return FatFile::write(&c, 1); }
+	int write(const void *buffer, size_t size) { return FatFile::write(buffer, size); }
+	size_t write(const uint8_t *buffer, size_t size) override
+	{
+		return FatFile::write(buffer, size);
+	}
+};
+
+
+class SdSpiCard
+{
+};
+
+
+template <class Card> class SdFileSystem
+{
+public:
+	uint32_t volumeBlockCount() { return YaawsSim::CardBlocks(); }
+	bool exists(const char *path) { return YaawsSim::CardExists(path); }
+	bool mkdir(const char *path, bool = true) { return YaawsSim::CardMkdir(path); }
+	bool remove(const char *path) { return YaawsSim::CardRemove(path); }
+	bool rename(const char *oldPath, const char *newPath)
+	{
+		return YaawsSim::CardRename(oldPath, newPath);
+	}
+};
+
+
+class SdFat : public SdFileSystem<SdSpiCard>
+{
+public:
+	bool begin(uint8_t = 0) { return volumeBlockCount() > 0; }
+};
+
+#endif
@@ -0,0 +1,1408 @@
+//  MIT License
+//
+//  Copyright(c) 2019 M Hotchin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this
+//  software and associated documentation files(the "Software"), to deal in the Software
+//  without restriction, including without limitation the rights to use, copy, modify,
+//  merge, publish, distribute, sublicense, and/or sell copies of the Software, andto
+//  permit persons to whom the Software is furnished to do so, subject to the following
+//  conditions :
+//
+//  The above copyright notice andthis permission notice shall be included in all copies
+//  or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+//  CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+//  OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "YaawsSim.h"
+
+#include <deque>
+#include <set>
+
+namespace YaawsSim
+{
+	//  A file or directory on the card.
+	struct Node
+	{
+		std::string name;
+		bool isDir = false;
+		bool readOnly = false;
+		std::vector<uint8_t> data;
+		std::vector<std::shared_ptr<Node>> entries;  //  Directory slots, empty if null
+		uint32_t cluster = 0;                        //  0 until it has data
+	};
+
+	bool CardCached(uint32_t cluster, uint32_t sector);
+
+	namespace
+	{
+		SimConfig config;
+		bool verbose = false;
+		uint64_t now = 0;
+		bool realTime = false;
+		uint32_t longestCall = 0;
+
+		//  The card.  Every file was last written at noon on 1 June 2019.
+		constexpr uint16_t fileDate = ((2019 - 1980) << 9) | (6 << 5) | 1;
+		constexpr uint16_t fileTime = (12 << 11);
+
+		std::shared_ptr<Node> root;
+		uint32_t nextCluster = 2;
+		std::set<uint32_t> freeClusters;    //  Given out again, lowest first
+		uint32_t cachedCluster = 0;
+		uint32_t cachedSector = 0;
+
+		//  W5x00 socket status register values.
+		enum : uint8_t
+		{
+			snClosed = 0x00,
+			snListen = 0x14,
+			snEstablished = 0x17,
+			snCloseWait = 0x1C
+		};
+
+		struct Socket
+		{
+			uint8_t status = snClosed;
+			uint16_t serverPort = 0;    //  As the library keeps it, 0 once accepted
+			int peer = -1;
+			std::deque<uint8_t> rx;
+			std::deque<uint8_t> tx;
+		};
+
+		Socket sockets[MAX_SOCK_NUM];
+
+		struct Peer
+		{
+			uint8_t socket = MAX_SOCK_NUM;
+			std::string toSend;
+			std::string received;
+			uint32_t readBytesPerMilli = 0;
+			uint64_t credit = 0;        //  Thousandths of a byte it may still read
+			bool closed = false;        //  The server hung up
+			bool hungUp = false;        //  The peer hung up
+			uint64_t closedAt = 0;
+			uint32_t writes = 0;        //  Calls to 'write' on its socket
+		};
+
+		std::vector<Peer> peers;
+		uint64_t wireCredit = 0;
+
+		bool IsConnected(const Socket &socket)
+		{
+			return (socket.status == snEstablished) || (socket.status == snCloseWait);
+		}
+
+
+		//  Splits 'path' into its names.
+		std::vector<std::string> SplitPath(const char *path)
+		{
+			std::vector<std::string> names;
+			std::string name;
+
+			for (const char *p = path; ; p++)
+			{
+				if ((*p == '/') || (*p == '\0'))
+				{
+					if (!name.empty())
+					{
+						names.push_back(name);
+						name.clear();
+					}
+
+					if (*p == '\0')
+					{
+						break;
+					}
+				}
+				else
+				{
+					name += *p;
+				}
+			}
+
+			return names;
+		}
+
+
+		//  Slot of 'name' in 'dir', -1 if not there.  FAT names don't care about case.
+		int FindEntry(const Node &dir, const std::string &name)
+		{
+			for (size_t i = 0; i < dir.entries.size(); i++)
+			{
+				if (dir.entries[i] &&
+					(strcasecmp(dir.entries[i]->name.c_str(), name.c_str()) == 0))
+				{
+					return (int)i;
+				}
+			}
+
+			return -1;
+		}
+
+
+		//  Puts 'node' in the first free slot of 'dir', as FAT does.
+		uint16_t AddEntry(Node &dir, std::shared_ptr<Node> node)
+		{
+			for (size_t i = 0; i < dir.entries.size(); i++)
+			{
+				if (!dir.entries[i])
+				{
+					dir.entries[i] = node;
+					return (uint16_t)i;
+				}
+			}
+
+			dir.entries.push_back(node);
+			return (uint16_t)(dir.entries.size() - 1);
+		}
+
+
+		//  The directory holding the last name in 'names', making directories on the
+		//  way if 'make' is set.
+		std::shared_ptr<Node> FindParent(const std::vector<std::string> &names, bool make)
+		{
+			std::shared_ptr<Node> dir = root;
+
+			for (size_t i = 0; i + 1 < names.size(); i++)
+			{
+				int slot = FindEntry(*dir, names[i]);
+
+				if (slot < 0)
+				{
+					if (!make)
+					{
+						return nullptr;
+					}
+
+					auto child = std::make_shared<Node>();
+
+					child->name = names[i];
+					child->isDir = true;
+					slot = AddEntry(*dir, child);
+				}
+
+				dir = dir->entries[slot];
+
+				if (!dir->isDir)
+				{
+					return nullptr;
+				}
+			}
+
+			return dir;
+		}
+
+
+		//  The node at 'path', and its slot in its directory.
+		std::shared_ptr<Node> FindNode(const char *path, uint16_t *slot = nullptr)
+		{
+			std::vector<std::string> names = SplitPath(path);
+
+			if (slot != nullptr)
+			{
+				*slot = 0;
+			}
+
+			if (names.empty())
+			{
+				return root;
+			}
+
+			std::shared_ptr<Node> dir = FindParent(names, false);
+			int found = dir ? FindEntry(*dir, names.back()) : -1;
+
+			if (found < 0)
+			{
+				return nullptr;
+			}
+
+			if (slot != nullptr)
+			{
+				*slot = (uint16_t)found;
+			}
+
+			return dir->entries[found];
+		}
+
+
+		//  A cluster for a file's data.  Like FAT, freed clusters are used again, so a new
+		//  file can start where a deleted one did.
+		uint32_t NewCluster()
+		{
+			if (freeClusters.empty())
+			{
+				return nextCluster++;
+			}
+
+			uint32_t cluster = *freeClusters.begin();
+
+			freeClusters.erase(freeClusters.begin());
+			return cluster;
+		}
+
+
+		void FreeCluster(uint32_t cluster)
+		{
+			if (cluster != 0)
+			{
+				freeClusters.insert(cluster);
+			}
+		}
+
+
+		//  Everything waiting to go either way moves as far as the time allows.
+		void RunNetwork(uint32_t micros)
+		{
+			for (Peer &peer : peers)
+			{
+				if (peer.hungUp || peer.closed)
+				{
+					continue;
+				}
+
+				Socket &socket = sockets[peer.socket];
+				size_t room = config.bufferSize - socket.rx.size();
+				size_t amount = min(room, peer.toSend.size());
+
+				socket.rx.insert(socket.rx.end(), peer.toSend.begin(),
+								 peer.toSend.begin() + amount);
+				peer.toSend.erase(0, amount);
+			}
+
+			wireCredit += (uint64_t)config.wireBytesPerMilli * micros;
+
+			uint64_t budget = wireCredit / 1000;
+
+			wireCredit %= 1000;
+
+			for (Peer &peer : peers)
+			{
+				peer.credit += (uint64_t)peer.readBytesPerMilli * micros;
+			}
+
+			//  The wire is shared a piece at a time between the sockets with something to
+			//  send, in socket order.
+			bool moved = true;
+
+			while ((budget > 0) && moved)
+			{
+				moved = false;
+
+				for (Socket &socket : sockets)
+				{
+					if ((socket.peer < 0) || socket.tx.empty() || (budget == 0))
+					{
+						continue;
+					}
+
+					Peer &peer = peers[socket.peer];
+
+					if (peer.hungUp)
+					{
+						//  Nobody to take it.
+						socket.tx.clear();
+						continue;
+					}
+
+					size_t piece = (size_t)min(budget, (uint64_t)64);
+					size_t amount = min(socket.tx.size(), piece);
+
+					if (peer.readBytesPerMilli != 0)
+					{
+						amount = min(amount, (size_t)(peer.credit / 1000));
+						peer.credit -= amount * 1000;
+					}
+
+					if (amount == 0)
+					{
+						continue;
+					}
+
+					peer.received.append(socket.tx.begin(), socket.tx.begin() + amount);
+					socket.tx.erase(socket.tx.begin(), socket.tx.begin() + amount);
+					budget -= amount;
+					moved = true;
+				}
+			}
+
+			//  A reader that has caught up can't save up time to read faster later.
+			for (Peer &peer : peers)
+			{
+				if ((peer.socket >= MAX_SOCK_NUM) || sockets[peer.socket].tx.empty())
+				{
+					peer.credit %= 1000;
+				}
+			}
+		}
+
+
+		void CloseSocket(uint8_t index)
+		{
+			Socket &socket = sockets[index];
+
+			if (socket.peer >= 0)
+			{
+				Peer &peer = peers[socket.peer];
+
+				peer.closed = true;
+				peer.closedAt = now;
+				peer.socket = MAX_SOCK_NUM;
+			}
+
+			socket = Socket();
+		}
+	}
+
+
+	//  True if the sector was the last one the card read, otherwise makes it so.
+	bool CardCached(uint32_t cluster, uint32_t sector)
+	{
+		if ((cachedCluster == cluster) && (cachedSector == sector))
+		{
+			return true;
+		}
+
+		cachedCluster = cluster;
+		cachedSector = sector;
+		return false;
+	}
+
+
+	void Reset()
+	{
+		now = 0;
+		longestCall = 0;
+
+		root = std::make_shared<Node>();
+		root->isDir = true;
+		nextCluster = 2;
+		freeClusters.clear();
+		cachedCluster = cachedSector = 0;
+
+		for (Socket &socket : sockets)
+		{
+			socket = Socket();
+		}
+
+		peers.clear();
+		wireCredit = 0;
+	}
+
+
+	SimConfig &Config()
+	{
+		return config;
+	}
+
+
+	void Verbose(bool on)
+	{
+		verbose = on;
+	}
+
+
+	uint64_t Now()
+	{
+		return now;
+	}
+
+
+	void Advance(uint32_t micros)
+	{
+		now += micros;
+		RunNetwork(micros);
+	}
+
+
+	void RealTime(bool on)
+	{
+		realTime = on;
+	}
+
+
+	void AddFile(const char *path, const std::string &contents, bool readOnly)
+	{
+		std::vector<std::string> names = SplitPath(path);
+		std::shared_ptr<Node> dir = FindParent(names, true);
+
+		if (!dir || names.empty())
+		{
+			return;
+		}
+
+		int slot = FindEntry(*dir, names.back());
+		auto node = std::make_shared<Node>();
+
+		if (slot >= 0)
+		{
+			FreeCluster(dir->entries[slot]->cluster);
+		}
+
+		node->name = names.back();
+		node->readOnly = readOnly;
+		node->data.assign(contents.begin(), contents.end());
+		node->cluster = contents.empty() ? 0 : NewCluster();
+
+		if (slot >= 0)
+		{
+			dir->entries[slot] = node;
+		}
+		else
+		{
+			AddEntry(*dir, node);
+		}
+	}
+
+
+	void AddDir(const char *path)
+	{
+		std::string inside(path);
+
+		inside += "/.";
+		FindParent(SplitPath(inside.c_str()), true);
+	}
+
+
+	//  Read only or not, as a PC would.
+	void RemoveFile(const char *path)
+	{
+		std::shared_ptr<Node> node = FindNode(path);
+
+		if (node)
+		{
+			node->readOnly = false;
+			CardRemove(path);
+		}
+	}
+
+
+	bool FileExists(const char *path)
+	{
+		return (bool)FindNode(path);
+	}
+
+
+	std::string FileContents(const char *path)
+	{
+		std::shared_ptr<Node> node = FindNode(path);
+
+		return node ? std::string(node->data.begin(), node->data.end()) : std::string();
+	}
+
+
+	int Connect(uint16_t port, const std::string &request, uint32_t readBytesPerMilli)
+	{
+		for (uint8_t i = 0; i < MAX_SOCK_NUM; i++)
+		{
+			Socket &socket = sockets[i];
+
+			if ((socket.status == snListen) && (socket.serverPort == port))
+			{
+				Peer peer;
+
+				peer.socket = i;
+				peer.toSend = request;
+				peer.readBytesPerMilli = readBytesPerMilli;
+				peers.push_back(peer);
+
+				socket.status = snEstablished;
+				socket.peer = (int)peers.size() - 1;
+				return socket.peer;
+			}
+		}
+
+		return -1;
+	}
+
+
+	void Disconnect(int peer)
+	{
+		Peer &p = peers[peer];
+
+		p.hungUp = true;
+
+		if ((p.socket < MAX_SOCK_NUM) && (sockets[p.socket].status == snEstablished))
+		{
+			sockets[p.socket].status = snCloseWait;
+		}
+	}
+
+
+	const std::string &Received(int peer)
+	{
+		return peers[peer].received;
+	}
+
+
+	bool Closed(int peer)
+	{
+		return peers[peer].closed;
+	}
+
+
+	uint64_t ClosedAt(int peer)
+	{
+		return peers[peer].closedAt;
+	}
+
+
+	uint32_t Writes(int peer)
+	{
+		return peers[peer].writes;
+	}
+
+
+	std::string Body(const std::string &response)
+	{
+		size_t lf = response.find("\n\n");
+		size_t crlf = response.find("\r\n\r\n");
+
+		if ((crlf != std::string::npos) && ((lf == std::string::npos) || (crlf < lf)))
+		{
+			return response.substr(crlf + 4);
+		}
+
+		return (lf == std::string::npos) ? std::string() : response.substr(lf + 2);
+	}
+
+
+	std::string StatusLine(const std::string &response)
+	{
+		std::string line = response.substr(0, response.find('\n'));
+
+		if (!line.empty() && (line.back() == '\r'))
+		{
+			line.pop_back();
+		}
+
+		return line;
+	}
+
+
+	uint32_t Step(YAAWS &web)
+	{
+		uint64_t start = now;
+
+		web.ServiceWebServer();
+
+		uint32_t took = (uint32_t)(now - start);
+
+		longestCall = max(longestCall, took);
+		Advance(config.tickMicros);
+
+		return took;
+	}
+
+
+	bool RunUntilClosed(YAAWS &web, int peer, uint64_t limitMicros)
+	{
+		uint64_t end = now + limitMicros;
+
+		while (!peers[peer].closed && (now < end))
+		{
+			Step(web);
+		}
+
+		return peers[peer].closed;
+	}
+
+
+	uint32_t LongestCall()
+	{
+		return longestCall;
+	}
+
+
+	uint32_t CardBlocks()
+	{
+		return 1UL << 21;
+	}
+
+
+	bool CardExists(const char *path)
+	{
+		return FileExists(path);
+	}
+
+
+	bool CardMkdir(const char *path)
+	{
+		if (FindNode(path))
+		{
+			return false;
+		}
+
+		AddDir(path);
+		return true;
+	}
+
+
+	bool CardRemove(const char *path)
+	{
+		std::vector<std::string> names = SplitPath(path);
+		std::shared_ptr<Node> dir = names.empty() ? nullptr : FindParent(names, false);
+		int slot = dir ? FindEntry(*dir, names.back()) : -1;
+
+		if ((slot < 0) || dir->entries[slot]->isDir || dir->entries[slot]->readOnly)
+		{
+			return false;
+		}
+
+		//  The slot is left empty for the next new file.
+		FreeCluster(dir->entries[slot]->cluster);
+		dir->entries[slot] = nullptr;
+		return true;
+	}
+
+
+	bool CardRename(const char *oldPath, const char *newPath)
+	{
+		std::vector<std::string> oldNames = SplitPath(oldPath);
+		std::vector<std::string> newNames = SplitPath(newPath);
+		auto oldDir = oldNames.empty() ? nullptr : FindParent(oldNames, false);
+		auto newDir = newNames.empty() ? nullptr : FindParent(newNames, false);
+		int slot = oldDir ? FindEntry(*oldDir, oldNames.back()) : -1;
+
+		if ((slot < 0) || !newDir || (FindEntry(*newDir, newNames.back()) >= 0))
+		{
+			return false;
+		}
+
+		std::shared_ptr<Node> node = oldDir->entries[slot];
+
+		oldDir->entries[slot] = nullptr;
+		node->name = newNames.back();
+		AddEntry(*newDir, node);
+		return true;
+	}
+}
+
+
+using namespace YaawsSim;
+
+
+//  The Arduino core.
+
+HardwareSerial Serial;
+EthernetClass Ethernet;
+
+
+unsigned long millis()
+{
+	return micros() / 1000;
+}
+
+
+unsigned long micros()
+{
+	if (realTime)
+	{
+		auto time = std::chrono::steady_clock::now().time_since_epoch();
+
+		return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(time)
+			.count();
+	}
+
+	return (unsigned long)Now();
+}
+
+
+void delay(unsigned long ms)
+{
+	Advance(ms * 1000);
+}
+
+
+void yield()
+{
+}
+
+
+void pinMode(uint8_t, uint8_t)
+{
+}
+
+
+void digitalWrite(uint8_t, uint8_t)
+{
+}
+
+
+char *ultoa(unsigned long value, char *buffer, int radix)
+{
+	char digits[33];
+	int count = 0;
+
+	do
+	{
+		int digit = value % radix;
+
+		digits[count++] = (char)((digit < 10) ? '0' + digit : 'a' + digit - 10);
+		value /= radix;
+	} while (value != 0);
+
+	for (int i = 0; i < count; i++)
+	{
+		buffer[i] = digits[count - 1 - i];
+	}
+
+	buffer[count] = '\0';
+	return buffer;
+}
+
+
+char *ltoa(long value, char *buffer, int radix)
+{
+	if ((value < 0) && (radix == 10))
+	{
+		buffer[0] = '-';
+		ultoa(-(unsigned long)value, buffer + 1, radix);
+		return buffer;
+	}
+
+	return ultoa((unsigned long)value, buffer, radix);
+}
+
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+	size_t written = 0;
+
+	while ((written < size) && write(buffer[written]))
+	{
+		written++;
+	}
+
+	return written;
+}
+
+
+size_t Print::print(const __FlashStringHelper *str)
+{
+	return write(reinterpret_cast<const char *>(str));
+}
+
+
+size_t Print::print(const char *str)
+{
+	return write(str);
+}
+
+
+size_t Print::print(char c)
+{
+	return write((uint8_t)c);
+}
+
+
+size_t Print::print(unsigned char value, int base)
+{
+	return print((unsigned long)value, base);
+}
+
+
+size_t Print::print(int value, int base)
+{
+	return print((long)value, base);
+}
+
+
+size_t Print::print(unsigned int value, int base)
+{
+	return print((unsigned long)value, base);
+}
+
+
+size_t Print::print(long value, int base)
+{
+	char buffer[34];
+
+	return write(ltoa(value, buffer, base));
+}
+
+
+size_t Print::print(unsigned long value, int base)
+{
+	char buffer[34];
+
+	return write(ultoa(value, buffer, base));
+}
+
+
+size_t Print::print(double value, int digits)
+{
+	char buffer[48];
+
+	snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+	return write(buffer);
+}
+
+
+size_t Print::println()
+{
+	return write("\r\n");
+}
+
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+	size_t count = 0;
+	uint64_t start = Now();
+
+	while (count < length)
+	{
+		int c = read();
+
+		if (c >= 0)
+		{
+			buffer[count++] = (char)c;
+		}
+		else if ((Now() - start) >= _timeout * 1000ULL)
+		{
+			break;
+		}
+		else
+		{
+			Advance(Config().tickMicros);
+		}
+	}
+
+	return count;
+}
+
+
+size_t HardwareSerial::write(uint8_t c)
+{
+	if (verbose)
+	{
+		putchar(c);
+	}
+
+	return 1;
+}
+
+
+//  The W5x00, as the Ethernet library sees it.
+
+EthernetHardwareStatus EthernetClass::hardwareStatus()
+{
+	return EthernetW5500;
+}
+
+
+uint8_t EthernetClass::socketStatus(uint8_t socket)
+{
+	return (socket < MAX_SOCK_NUM) ? sockets[socket].status : (uint8_t)snClosed;
+}
+
+
+uint8_t EthernetClient::status()
+{
+	return Ethernet.socketStatus(_socket);
+}
+
+
+uint8_t EthernetClient::connected()
+{
+	uint8_t s = status();
+
+	return !((s == snListen) || (s == snClosed) || ((s == snCloseWait) && !available()));
+}
+
+
+int EthernetClient::available()
+{
+	return (_socket < MAX_SOCK_NUM) ? (int)sockets[_socket].rx.size() : 0;
+}
+
+
+int EthernetClient::read()
+{
+	if ((_socket >= MAX_SOCK_NUM) || sockets[_socket].rx.empty())
+	{
+		return -1;
+	}
+
+	uint8_t c = sockets[_socket].rx.front();
+
+	sockets[_socket].rx.pop_front();
+	return c;
+}
+
+
+int EthernetClient::read(uint8_t *buffer, size_t size)
+{
+	size_t count = 0;
+
+	while ((count < size) && available())
+	{
+		buffer[count++] = (uint8_t)read();
+	}
+
+	return (int)count;
+}
+
+
+int EthernetClient::peek()
+{
+	return available() ? sockets[_socket].rx.front() : -1;
+}
+
+
+int EthernetClient::availableForWrite()
+{
+	if ((_socket >= MAX_SOCK_NUM) || !IsConnected(sockets[_socket]))
+	{
+		return 0;
+	}
+
+	return config.bufferSize - (int)sockets[_socket].tx.size();
+}
+
+
+//  Like the library, waits (in virtual time) for room in the send buffer.
+size_t EthernetClient::write(const uint8_t *buffer, size_t size)
+{
+	size_t written = 0;
+
+	if ((size > 0) && (_socket < MAX_SOCK_NUM) && IsConnected(sockets[_socket]))
+	{
+		peers[sockets[_socket].peer].writes++;
+	}
+
+	while ((written < size) && (_socket < MAX_SOCK_NUM) && IsConnected(sockets[_socket]))
+	{
+		Socket &socket = sockets[_socket];
+		size_t room = config.bufferSize - socket.tx.size();
+
+		if (room == 0)
+		{
+			Advance(config.tickMicros);
+			continue;
+		}
+
+		size_t amount = min(room, size - written);
+
+		socket.tx.insert(socket.tx.end(), buffer + written, buffer + written + amount);
+		written += amount;
+	}
+
+	return written;
+}
+
+
+void EthernetClient::flush()
+{
+	while ((_socket < MAX_SOCK_NUM) && IsConnected(sockets[_socket]) &&
+		   !sockets[_socket].tx.empty())
+	{
+		Advance(config.tickMicros);
+	}
+}
+
+
+//  Sends what is left, then closes - giving up after a second, as the library does.
+void EthernetClient::stop()
+{
+	if (_socket >= MAX_SOCK_NUM)
+	{
+		return;
+	}
+
+	uint64_t giveUp = now + 1000000;
+
+	while (IsConnected(sockets[_socket]) && !sockets[_socket].tx.empty() &&
+		   (now < giveUp))
+	{
+		Advance(config.tickMicros);
+	}
+
+	CloseSocket(_socket);
+	_socket = MAX_SOCK_NUM;
+}
+
+
+IPAddress EthernetClient::remoteIP()
+{
+	int peer = (_socket < MAX_SOCK_NUM) ? sockets[_socket].peer : -1;
+
+	return (peer >= 0) ? IPAddress(10, 0, 0, (uint8_t)(peer + 1)) : IPAddress();
+}
+
+
+void EthernetServer::begin()
+{
+	for (Socket &socket : sockets)
+	{
+		if (socket.status == snClosed)
+		{
+			socket.status = snListen;
+			socket.serverPort = _port;
+			return;
+		}
+	}
+}
+
+
+//  As the library does, hands out each connection once, and starts listening again if
+//  nothing is.
+EthernetClient EthernetServer::accept()
+{
+	bool listening = false;
+	uint8_t found = MAX_SOCK_NUM;
+
+	for (uint8_t i = 0; i < MAX_SOCK_NUM; i++)
+	{
+		Socket &socket = sockets[i];
+
+		if (socket.serverPort != _port)
+		{
+			continue;
+		}
+
+		if ((found == MAX_SOCK_NUM) && IsConnected(socket))
+		{
+			found = i;
+			socket.serverPort = 0;
+		}
+		else if (socket.status == snListen)
+		{
+			listening = true;
+		}
+	}
+
+	if (!listening)
+	{
+		begin();
+	}
+
+	return EthernetClient(found);
+}
+
+
+EthernetClient EthernetServer::available()
+{
+	bool listening = false;
+	uint8_t found = MAX_SOCK_NUM;
+
+	for (uint8_t i = 0; i < MAX_SOCK_NUM; i++)
+	{
+		Socket &socket = sockets[i];
+
+		if (socket.serverPort != _port)
+		{
+			continue;
+		}
+
+		if ((found == MAX_SOCK_NUM) && IsConnected(socket) && !socket.rx.empty())
+		{
+			found = i;
+		}
+		else if (socket.status == snListen)
+		{
+			listening = true;
+		}
+	}
+
+	if (!listening)
+	{
+		begin();
+	}
+
+	return EthernetClient(found);
+}
+
+
+EthernetServer::operator bool()
+{
+	for (Socket &socket : sockets)
+	{
+		if ((socket.status == snListen) && (socket.serverPort == _port))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+//  The card, as SdFat sees it.
+
+bool FatFile::OpenNode(std::shared_ptr<Node> node, uint16_t index, oflag_t flags)
+{
+	bool writing = (flags & O_ACCMODE) != O_RDONLY;
+
+	if (isOpen() || !node || (writing && (node->isDir || node->readOnly)))
+	{
+		return false;
+	}
+
+	_node = node;
+	_flags = flags;
+	_dirIndex = index;
+	_position = 0;
+
+	if (writing && (flags & O_TRUNC))
+	{
+		truncate(0);
+	}
+
+	if (flags & O_AT_END)
+	{
+		_position = fileSize();
+	}
+
+	return true;
+}
+
+
+bool FatFile::open(const char *path, oflag_t flags)
+{
+	uint16_t slot;
+	std::shared_ptr<Node> node = FindNode(path, &slot);
+
+	if (node)
+	{
+		return !((flags & O_CREAT) && (flags & O_EXCL)) && OpenNode(node, slot, flags);
+	}
+
+	std::vector<std::string> names = SplitPath(path);
+	std::shared_ptr<Node> dir = names.empty() ? nullptr : FindParent(names, false);
+
+	if (!dir || !(flags & O_CREAT) || ((flags & O_ACCMODE) == O_RDONLY))
+	{
+		return false;
+	}
+
+	node = std::make_shared<Node>();
+	node->name = names.back();
+	slot = AddEntry(*dir, node);
+
+	return OpenNode(node, slot, flags);
+}
+
+
+bool FatFile::open(FatFile *dir, uint16_t index, oflag_t flags)
+{
+	if (!dir->isDir() || (index >= dir->_node->entries.size()))
+	{
+		return false;
+	}
+
+	return OpenNode(dir->_node->entries[index], index, flags);
+}
+
+
+bool FatFile::openNext(FatFile *dir, oflag_t flags)
+{
+	if (isOpen() || !dir->isDir())
+	{
+		return false;
+	}
+
+	const std::vector<std::shared_ptr<Node>> &entries = dir->_node->entries;
+
+	for (size_t i = dir->_position / 32; i < entries.size(); i++)
+	{
+		if (entries[i])
+		{
+			dir->_position = (uint32_t)(i + 1) * 32;
+			return OpenNode(entries[i], (uint16_t)i, flags);
+		}
+	}
+
+	dir->_position = (uint32_t)entries.size() * 32;
+	return false;
+}
+
+
+bool FatFile::close()
+{
+	_node.reset();
+	_position = 0;
+	_flags = 0;
+	return true;
+}
+
+
+bool FatFile::isDir() const
+{
+	return isOpen() && _node->isDir;
+}
+
+
+bool FatFile::isHidden() const
+{
+	return isOpen() && (_node->name[0] == '.');
+}
+
+
+bool FatFile::isReadOnly() const
+{
+	return isOpen() && _node->readOnly;
+}
+
+
+uint32_t FatFile::fileSize() const
+{
+	return isOpen() ? (uint32_t)_node->data.size() : 0;
+}
+
+
+bool FatFile::seekSet(uint32_t position)
+{
+	if (!isOpen() || (!isDir() && (position > fileSize())))
+	{
+		return false;
+	}
+
+	_position = position;
+	return true;
+}
+
+
+int FatFile::read()
+{
+	uint8_t c;
+
+	return (read(&c, 1) == 1) ? c : -1;
+}
+
+
+int FatFile::read(void *buffer, size_t size)
+{
+	if (!isOpen() || isDir() || ((_flags & O_ACCMODE) == O_WRONLY))
+	{
+		return -1;
+	}
+
+	size_t amount = min(size, (size_t)(fileSize() - _position));
+
+	for (uint32_t sector = _position / 512;
+		 (amount > 0) && (sector <= (_position + amount - 1) / 512); sector++)
+	{
+		if (!CardCached(_node->cluster, sector))
+		{
+			Advance(config.readMicros);
+		}
+	}
+
+	memcpy(buffer, _node->data.data() + _position, amount);
+	_position += amount;
+	return (int)amount;
+}
+
+
+int FatFile::write(const void *buffer, size_t size)
+{
+	if (!isOpen() || isDir() || ((_flags & O_ACCMODE) == O_RDONLY))
+	{
+		return -1;
+	}
+
+	if (_flags & O_APPEND)
+	{
+		_position = fileSize();
+	}
+
+	if (size == 0)
+	{
+		return 0;
+	}
+
+	if (_node->cluster == 0)
+	{
+		_node->cluster = NewCluster();
+	}
+
+	if (_position + size > _node->data.size())
+	{
+		_node->data.resize(_position + size);
+	}
+
+	memcpy(_node->data.data() + _position, buffer, size);
+
+	uint32_t lastSector = (_position + size - 1) / 512;
+
+	for (uint32_t sector = _position / 512; sector <= lastSector; sector++)
+	{
+		CardCached(_node->cluster, sector);
+		Advance(config.writeMicros);
+	}
+
+	_position += size;
+	return (int)size;
+}
+
+
+bool FatFile::sync()
+{
+	return isOpen();
+}
+
+
+bool FatFile::truncate(uint32_t length)
+{
+	if (!isOpen() || isDir() || ((_flags & O_ACCMODE) == O_RDONLY) ||
+		(length > fileSize()))
+	{
+		return false;
+	}
+
+	_node->data.resize(length);
+	_position = min(_position, length);
+
+	if (length == 0)
+	{
+		//  Its clusters are freed.
+		FreeCluster(_node->cluster);
+		_node->cluster = 0;
+	}
+
+	return true;
+}
+
+
+uint32_t FatFile::firstCluster() const
+{
+	return isOpen() ? _node->cluster : 0;
+}
+
+
+bool FatFile::dirEntry(dir_t *entry)
+{
+	if (!isOpen())
+	{
+		return false;
+	}
+
+	memset(entry, 0, sizeof(*entry));
+	memset(entry->name, ' ', sizeof(entry->name));
+	memcpy(entry->name, _node->name.c_str(),
+		   min(_node->name.size(), sizeof(entry->name)));
+	entry->attributes = (_node->isDir ? 0x10 : 0) | (_node->readOnly ? 0x01 : 0);
+	entry->lastWriteDate = fileDate;
+	entry->lastWriteTime = fileTime;
+	entry->fileSize = fileSize();
+	return true;
+}
+
+
+bool FatFile::getName(char *name, size_t size)
+{
+	if (!isOpen() || (_node->name.size() >= size))
+	{
+		return false;
+	}
+
+	strcpy(name, _node->name.c_str());
+	return true;
+}
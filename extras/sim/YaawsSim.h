@@ -0,0 +1,129 @@
+//  MIT License
+//
+//  Copyright(c) 2019 M Hotchin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this
+//  software and associated documentation files(the "Software"), to deal in the Software
+//  without restriction, including without limitation the rights to use, copy, modify,
+//  merge, publish, distribute, sublicense, and/or sell copies of the Software, andto
+//  permit persons to whom the Software is furnished to do so, subject to the following
+//  conditions :
+//
+//  The above copyright notice andthis permission notice shall be included in all copies
+//  or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+//  CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+//  OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//  A deterministic simulation of the hardware YAAWS runs on, so the real server code can
+//  be driven step by step on a PC.  There are three parts:
+//
+//  - A virtual clock.  'millis' and 'micros' read it, and it only moves when the
+//    simulation moves it - one tick after each call to the server, plus whatever the
+//    card and the network cost during the call.
+//  - A W5x00 chip (Ethernet.h).  Peers connect to a port, send a request and read the
+//    response at the rate you choose.  Each socket has a send and a receive buffer of
+//    'Config().bufferSize' bytes, and the wire empties the send buffers at
+//    'Config().wireBytesPerMilli'.
+//  - An SD card (SdFat.h) held in memory.  Each sector the server reads costs
+//    'Config().readMicros' of virtual time, unless it's the sector read last.
+//
+//  Nothing depends on the real time or on chance, so a scenario gives the same result
+//  on every run, which makes it usable as a regression test.  See 'tests.cpp'.
+
+#ifndef YAAWS_SIM_H
+#define YAAWS_SIM_H
+
+#include <Arduino.h>
+#include <Ethernet.h>
+#include <SdFat.h>
+#include <YAAWS.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace YaawsSim
+{
+	struct SimConfig
+	{
+		uint32_t tickMicros = 100;          //  Time between calls to the server
+		uint16_t bufferSize = 2048;         //  Each socket's send and receive buffers
+		uint32_t wireBytesPerMilli = 1000;  //  Shared by all sockets
+		uint32_t readMicros = 800;          //  To read a sector from the card
+		uint32_t writeMicros = 1500;        //  To write a sector
+	};
+
+	//  Empties the card, drops every connection, and puts the clock back to 0.  The
+	//  configuration is kept.
+	void Reset();
+
+	SimConfig &Config();
+
+	//  Trace output from the server goes to stdout.
+	void Verbose(bool on);
+
+	//  The virtual clock, in microseconds.
+	uint64_t Now();
+
+	//  Moves the clock on, carrying data over the network as it goes.
+	void Advance(uint32_t micros);
+
+	//  While on, 'millis' and 'micros' read the PC's clock instead, for timing the
+	//  server's own code.  Nothing else changes - the virtual clock moves as before.
+	void RealTime(bool on);
+
+	//  A file on the card, e.g. AddFile("/WWW/index.html", "<html>...").  Directories are
+	//  made as needed.  Files are read only unless 'readOnly' is false.  As on a real
+	//  card, a removed file's directory slot and cluster are given to the next new file.
+	void AddFile(const char *path, const std::string &contents, bool readOnly = true);
+	void AddDir(const char *path);
+	void RemoveFile(const char *path);
+	bool FileExists(const char *path);
+	std::string FileContents(const char *path);
+
+	//  A client connecting to 'port' from address 10.0.0.<peer number + 1>.  'request'
+	//  is sent as fast as the socket takes it, and the response is read at
+	//  'readBytesPerMilli' (0 for as fast as the wire goes).  Returns the peer number, or
+	//  -1 if the connection was refused (nothing listening, or no free socket).
+	int Connect(uint16_t port, const std::string &request,
+				uint32_t readBytesPerMilli = 0);
+
+	//  The peer hangs up.
+	void Disconnect(int peer);
+
+	//  All the peer has received so far, and whether the server has hung up on it.
+	const std::string &Received(int peer);
+	bool Closed(int peer);
+
+	//  Virtual time when the server hung up, 0 if it hasn't.
+	uint64_t ClosedAt(int peer);
+
+	//  How many times the server wrote to the peer's socket.  On the chip each is a SEND
+	//  command, and often a packet of its own.
+	uint32_t Writes(int peer);
+
+	//  The body of a response - everything after the blank line ending the header.
+	std::string Body(const std::string &response);
+
+	//  The status line of a response, e.g. "HTTP/1.0 200 OK".
+	std::string StatusLine(const std::string &response);
+
+	//  Calls the server once, then moves the clock on a tick.  Returns how much virtual
+	//  time the call itself took.
+	uint32_t Step(YAAWS &web);
+
+	//  Steps the server until 'peer' has been hung up on, or 'limitMicros' of virtual
+	//  time passes.  True if the peer was hung up on.
+	bool RunUntilClosed(YAAWS &web, int peer, uint64_t limitMicros = 60000000ULL);
+
+	//  The longest single call since the last Reset.
+	uint32_t LongestCall();
+}
+
+#endif
@@ -0,0 +1,299 @@
+//  MIT License
+//
+//  Copyright(c) 2019 M Hotchin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this
+//  software and associated documentation files(the "Software"), to deal in the Software
+//  without restriction, including without limitation the rights to use, copy, modify,
+//  merge, publish, distribute, sublicense, and/or sell copies of the Software, andto
+//  permit persons to whom the Software is furnished to do so, subject to the following
+//  conditions :
+//
+//  The above copyright notice andthis permission notice shall be included in all copies
+//  or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+//  CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+//  OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//  Load test, run against the simulation.  The same kinds of request as
+//  'extras/yaaws_bench.py' - small files, large downloads, form GETs, POSTs, 404s and
+//  slow clients - each from several clients at once, then the request parsing
+//  micro-benchmarks.  Results are printed as one JSON object:
+//
+//  - For each scenario, requests/s, bytes/s and p50/p99/max latency as the clients saw
+//    them, in virtual time, so the figures are the same on every run and every PC.
+//  - 'server', the server's own 'PrintStatistics' for the scenario, with its histogram
+//    of the (virtual) time each call to 'ServiceWebServer' took.
+//  - 'host_call_ns', the PC time each call took, which shows changes in the amount of
+//    work done per call.  Unlike the rest, it varies from run to run.
+//  - 'micro', 'PrintBenchmarks' timed on the PC's clock.
+//
+//  A scenario where a request fails or doesn't finish says so in 'errors'.
+
+#include "YaawsSim.h"
+
+using namespace YaawsSim;
+
+namespace
+{
+	SdFat card;
+
+	//  Takes any form data.
+	class Accepter : public YaawsCallback
+	{
+	public:
+		using YaawsCallback::ProcessFormData;
+
+		bool ProcessFormData(const char *path, char *formData) override
+		{
+			return true;
+		}
+	};
+
+
+	//  Collects what is printed to it.
+	class StringPrint : public Print
+	{
+	public:
+		using Print::write;
+
+		size_t write(uint8_t c) override
+		{
+			text += (char)c;
+			return 1;
+		}
+
+		std::string text;
+	};
+
+
+	struct Scenario
+	{
+		const char *name;
+		int clients;
+		int requestsEach;
+		uint32_t readBytesPerMilli;     //  0 for as fast as the wire goes
+		const char *status;             //  Expected status line
+		std::string (*request)(int n);
+	};
+
+
+	std::string Get(const char *path)
+	{
+		return std::string("GET ") + path + " HTTP/1.1\r\nHost: yaaws\r\n\r\n";
+	}
+
+
+	std::string SmallFile(int)
+	{
+		return Get("/index.html");
+	}
+
+
+	std::string LargeFile(int)
+	{
+		return Get("/big.bin");
+	}
+
+
+	std::string FormGet(int n)
+	{
+		return Get(("/form.html?name=bench&value=" + std::to_string(n)).c_str());
+	}
+
+
+#ifndef YAAWS_GET_IS_ALL_WE_NEED
+	std::string FormPost(int n)
+	{
+		std::string body = "name=bench&value=" + std::to_string(n);
+
+		return "POST /form.html HTTP/1.1\r\nHost: yaaws\r\n"
+			"Content-Type: application/x-www-form-urlencoded\r\n"
+			"Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+	}
+#endif
+
+
+	std::string Missing(int n)
+	{
+		return Get(("/no/such/file" + std::to_string(n) + ".html").c_str());
+	}
+
+
+	std::string Medium(int)
+	{
+		return Get("/medium.html");
+	}
+
+
+	const Scenario scenarios[] =
+	{
+		{"small", 4, 25, 0, "HTTP/1.0 200 OK", SmallFile},
+		{"large", 2, 3, 0, "HTTP/1.0 200 OK", LargeFile},
+		{"form", 4, 25, 0, "HTTP/1.0 200 OK", FormGet},
+#ifndef YAAWS_GET_IS_ALL_WE_NEED
+		{"post", 4, 25, 0, "HTTP/1.0 200 OK", FormPost},
+#endif
+		{"missing", 4, 25, 0, "HTTP/1.0 404 Not Found", Missing},
+		{"slow", 3, 4, 20, "HTTP/1.0 200 OK", Medium},
+	};
+
+
+	//  'values' sorted, 'p' percent of the way along.
+	uint64_t Percentile(std::vector<uint64_t> values, unsigned p)
+	{
+		if (values.empty())
+		{
+			return 0;
+		}
+
+		std::sort(values.begin(), values.end());
+		return values[min(values.size() - 1, values.size() * p / 100)];
+	}
+
+
+	void PrintPercentiles(const char *name, const std::vector<uint64_t> &values)
+	{
+		printf("\"%s\":{\"p50\":%llu,\"p99\":%llu,\"max\":%llu}", name,
+			   (unsigned long long)Percentile(values, 50),
+			   (unsigned long long)Percentile(values, 99),
+			   (unsigned long long)Percentile(values, 100));
+	}
+
+
+	//  Each client sends its requests one after another, until all are done.
+	void Run(const Scenario &scenario)
+	{
+		Reset();
+		AddFile("/WWW/index.html", std::string(2000, 'i'));
+		AddFile("/WWW/form.html", std::string(1000, 'f'));
+		AddFile("/WWW/medium.html", std::string(16000, 'm'));
+		AddFile("/WWW/big.bin", std::string(256000, 'b'));
+
+		Accepter accepter;
+		YAAWS web(card, accepter);
+
+		web.begin();
+		web.ResetStatistics();
+
+		struct Client
+		{
+			int peer = -1;
+			int sent = 0;
+			bool waiting = false;       //  For a socket to connect to
+			uint64_t started = 0;
+		};
+
+		std::vector<Client> clients(scenario.clients);
+		std::vector<uint64_t> latencies;
+		std::vector<uint64_t> callNanos;
+		uint64_t bytes = 0;
+		int errors = 0;
+		int next = 0;
+		const uint64_t limit = Now() + 600000000ULL;
+		bool busy = true;
+
+		while (busy && (Now() < limit))
+		{
+			busy = false;
+
+			for (Client &client : clients)
+			{
+				if ((client.peer >= 0) && Closed(client.peer))
+				{
+					const std::string &response = Received(client.peer);
+
+					latencies.push_back((ClosedAt(client.peer) - client.started) / 1000);
+					bytes += response.size();
+					errors += (StatusLine(response) != scenario.status);
+					client.peer = -1;
+				}
+
+				if ((client.peer < 0) && (client.sent < scenario.requestsEach))
+				{
+					if (!client.waiting)
+					{
+						client.waiting = true;
+						client.started = Now();
+					}
+
+					client.peer = Connect(80, scenario.request(next),
+										  scenario.readBytesPerMilli);
+
+					if (client.peer >= 0)
+					{
+						client.waiting = false;
+						client.sent++;
+						next++;
+					}
+				}
+
+				busy = busy || (client.peer >= 0) ||
+					(client.sent < scenario.requestsEach);
+			}
+
+			auto start = std::chrono::steady_clock::now();
+
+			web.ServiceWebServer();
+			callNanos.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - start).count());
+			Advance(Config().tickMicros);
+		}
+
+		//  Requests still going when time ran out.
+		for (Client &client : clients)
+		{
+			errors += (client.peer >= 0);
+		}
+
+		const double seconds = Now() / 1e6;
+
+		printf("\"%s\":{\"clients\":%d,\"requests\":%zu,\"errors\":%d,"
+			   "\"virtual_s\":%.3f,\"requests_per_s\":%.1f,\"bytes_per_s\":%.0f,",
+			   scenario.name, scenario.clients, latencies.size(), errors, seconds,
+			   latencies.size() / seconds, bytes / seconds);
+		PrintPercentiles("latency_ms", latencies);
+		printf(",");
+		PrintPercentiles("host_call_ns", callNanos);
+
+		StringPrint statistics;
+
+		web.PrintStatistics(statistics);
+		statistics.text.erase(statistics.text.find_last_not_of("\r\n") + 1);
+		printf(",\"server\":%s}", statistics.text.c_str());
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	printf("{\"scenarios\":{");
+
+	for (const Scenario &scenario : scenarios)
+	{
+		if (&scenario != scenarios)
+		{
+			printf(",");
+		}
+
+		Run(scenario);
+	}
+
+	Reset();
+
+	YAAWS web(card);
+	StringPrint micro;
+
+	RealTime(true);
+	web.PrintBenchmarks(micro);
+	RealTime(false);
+
+	micro.text.erase(micro.text.find_last_not_of("\r\n") + 1);
+	printf("},\"micro\":%s}\n", micro.text.c_str());
+	return 0;
+}
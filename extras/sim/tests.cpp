@@ -0,0 +1,1582 @@
+//  MIT License
+//
+//  Copyright(c) 2019 M Hotchin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this
+//  software and associated documentation files(the "Software"), to deal in the Software
+//  without restriction, including without limitation the rights to use, copy, modify,
+//  merge, publish, distribute, sublicense, and/or sell copies of the Software, andto
+//  permit persons to whom the Software is furnished to do so, subject to the following
+//  conditions :
+//
+//  The above copyright notice andthis permission notice shall be included in all copies
+//  or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+//  CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+//  OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+//  Regression tests, run against the simulation.  Each test starts from an empty card
+//  and a fresh server, so they don't depend on each other or on their order.  They only
+//  check what every configuration does, so they can be run with any CONFIG (see the
+//  Makefile).
+
+#include "YaawsSim.h"
+
+#if defined(YAAWS_GZIP_STREAM) || defined(YAAWS_BODY_SOURCES)
+#include <zlib.h>
+#endif
+
+using namespace YaawsSim;
+
+namespace
+{
+	int checks = 0;
+	int failures = 0;
+
+#define CHECK(condition) Check((condition), #condition, __LINE__)
+
+	void Check(bool passed, const char *condition, int line)
+	{
+		checks++;
+
+		if (!passed)
+		{
+			printf("  line %d: CHECK(%s) failed\n", line, condition);
+			failures++;
+		}
+	}
+
+
+	SdFat card;
+
+	const char indexPage[] = "<html><body><h1>Hello</h1></body></html>";
+
+
+	std::string Request(const char *method, const char *path,
+						const std::string &body = "")
+	{
+		std::string request = std::string(method) + " " + path + " HTTP/1.1\r\n"
+			"Host: yaaws\r\n";
+
+		if (!body.empty())
+		{
+			request += "Content-Type: application/x-www-form-urlencoded\r\n"
+				"Content-Length: " + std::to_string(body.size()) + "\r\n";
+		}
+
+		return request + "\r\n" + body;
+	}
+
+
+	//  'size' bytes that are easy to check, and differ for each 'seed'.
+	std::string Pattern(size_t size, char seed)
+	{
+		std::string data;
+
+		for (size_t i = 0; i < size; i++)
+		{
+			data += (char)('A' + ((i / 64 + seed) % 26));
+		}
+
+		return data;
+	}
+
+
+	//  Connects to port 80, retrying as a browser would until a socket is listening.
+	int ConnectTo(YAAWS &web, const std::string &request, uint32_t readBytesPerMilli = 0)
+	{
+		int peer = Connect(80, request, readBytesPerMilli);
+
+		for (int tries = 0; (peer < 0) && (tries < 100000); tries++)
+		{
+			Step(web);
+			peer = Connect(80, request, readBytesPerMilli);
+		}
+
+		return peer;
+	}
+
+
+	//  Records the form data it is given.
+	class Recorder : public YaawsCallback
+	{
+	public:
+		using YaawsCallback::ProcessFormData;
+
+		bool ProcessFormData(const char *path, char *formData) override
+		{
+			lastPath = path;
+			lastData = formData;
+			return true;
+		}
+
+		std::string lastPath;
+		std::string lastData;
+	};
+
+
+#ifdef YAAWS_BODY_SOURCES
+	//  'data' gzip'd, as 'extras/yaaws_pack.py --gzip' stores it.
+	std::string Gzip(const std::string &data)
+	{
+		z_stream stream = {};
+		std::string packed(compressBound(data.size()) + 32, '\0');
+
+		deflateInit2(&stream, 9, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+		stream.next_in = (Bytef *)data.data();
+		stream.avail_in = data.size();
+		stream.next_out = (Bytef *)&packed[0];
+		stream.avail_out = packed.size();
+		deflate(&stream, Z_FINISH);
+		packed.resize(stream.total_out);
+		deflateEnd(&stream);
+
+		return packed;
+	}
+#endif
+
+
+#if defined(YAAWS_GZIP_STREAM) || defined(YAAWS_PACKED_SITE)
+	//  The gzip stream 'data' unpacked, or "<bad gzip>" if it isn't one.
+	std::string Gunzip(const std::string &data)
+	{
+		z_stream stream = {};
+		std::string unpacked;
+		int result = inflateInit2(&stream, 16 + MAX_WBITS);
+
+		stream.next_in = (Bytef *)data.data();
+		stream.avail_in = data.size();
+
+		while (result == Z_OK)
+		{
+			char chunk[4096];
+
+			stream.next_out = (Bytef *)chunk;
+			stream.avail_out = sizeof(chunk);
+			result = inflate(&stream, Z_NO_FLUSH);
+			unpacked.append(chunk, sizeof(chunk) - stream.avail_out);
+		}
+
+		inflateEnd(&stream);
+		return ((result == Z_STREAM_END) && (stream.avail_in == 0)) ? unpacked
+																	: "<bad gzip>";
+	}
+#endif
+
+
+	void GetFile()
+	{
+		AddFile("/WWW/index.html", indexPage);
+
+		YAAWS web(card);
+
+		CHECK(web.begin());
+
+		int peer = ConnectTo(web, Request("GET", "/index.html"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 200 OK");
+		CHECK(Received(peer).find("Content-Type: text/html") != std::string::npos);
+		CHECK(Body(Received(peer)) == indexPage);
+	}
+
+
+	void MissingFile()
+	{
+		AddFile("/WWW/index.html", indexPage);
+
+		YAAWS web(card);
+
+		web.begin();
+
+		int peer = ConnectTo(web, Request("GET", "/nothing.html"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 404 Not Found");
+	}
+
+
+	void HeadHasNoBody()
+	{
+		AddFile("/WWW/index.html", indexPage);
+
+		YAAWS web(card);
+
+		web.begin();
+
+		int peer = ConnectTo(web, Request("HEAD", "/index.html"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 200 OK");
+		CHECK(Body(Received(peer)).empty());
+	}
+
+
+	void QueryString()
+	{
+		AddFile("/WWW/form.html", indexPage);
+
+		Recorder recorder;
+		YAAWS web(card, recorder);
+
+		web.begin();
+
+		int peer = ConnectTo(web, Request("GET", "/form.html?led=on&level=3"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 200 OK");
+		CHECK(recorder.lastData == "led=on&level=3");
+	}
+
+
+#ifndef YAAWS_GET_IS_ALL_WE_NEED
+	void PostForm()
+	{
+		AddFile("/WWW/form.html", indexPage);
+
+		Recorder recorder;
+		YAAWS web(card, recorder);
+
+		web.begin();
+
+		int peer = ConnectTo(web, Request("POST", "/form.html", "led=off&level=7"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 200 OK");
+		CHECK(recorder.lastData == "led=off&level=7");
+		CHECK(Body(Received(peer)) == indexPage);
+	}
+#endif
+
+
+	//  Binds the form data into its members, and turns away forms that aren't valid.
+	class Settings : public YaawsCallback
+	{
+	public:
+		using YaawsCallback::ProcessFormData;
+
+		bool ProcessFormData(const char *path, char *formData) override
+		{
+			static const char fnName[] PROGMEM = "name";
+			static const char fnCount[] PROGMEM = "count";
+			static const char fnRatio[] PROGMEM = "ratio";
+			static const char fnLed[] PROGMEM = "led";
+			static const formField fields[] PROGMEM =
+			{
+				{fnName, fieldString, 1, sizeof(name), name},
+				{fnCount, fieldInt, 1, 10, &count},
+				{fnRatio, fieldFloat, 0, 1, &ratio},
+				{fnLed, fieldBool, 0, 0, &led},
+			};
+
+			led = false;
+			result = bindFormFields(formData, fields, 4);
+			return result.Valid(3);
+		}
+
+		char name[8] = "";
+		int count = 0;
+		float ratio = 0;
+		bool led = true;
+		formResult result = {0, 0};
+	};
+
+
+	void FormBinding()
+	{
+		AddFile("/WWW/form.html", indexPage);
+
+		Settings settings;
+		YAAWS web(card, settings);
+
+		web.begin();
+
+		int peer = ConnectTo(web, Request("GET", "/form.html?name=Bob%20S&count=7&"
+										  "ratio=0.5&led=on&other=1"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 200 OK");
+		CHECK(std::string(settings.name) == "Bob S");
+		CHECK(settings.count == 7);
+		CHECK(settings.ratio == 0.5f);
+		CHECK(settings.led);
+		CHECK(settings.result.found == 0xF);
+
+		//  Out of range, too long, and missing.  Bad values leave the old ones alone.
+		peer = ConnectTo(web, Request("GET", "/form.html?count=11&name=Robert%20S"));
+
+		CHECK(RunUntilClosed(web, peer));
+#ifndef YAAWS_404_THE_ONE_TRUE_ERROR
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 400 Bad Request");
+#else
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 404 Not Found");
+#endif
+		CHECK(settings.count == 7);
+		CHECK(std::string(settings.name) == "Bob S");
+		CHECK(!settings.led);
+		CHECK(settings.result.invalid == 0x3);
+		CHECK(settings.result.Missing(4) == 0xC);
+	}
+
+
+	//  Several downloads at once, each bigger than the socket buffers.  More peers than
+	//  connections, so some wait for a connection to come free.
+	std::string ManyDownloads(uint32_t readBytesPerMilli)
+	{
+		const int count = 6;
+		std::string files[count];
+		int peers[count];
+
+		for (int i = 0; i < count; i++)
+		{
+			files[i] = Pattern(20000 + 1000 * i, (char)i);
+			AddFile(("/WWW/big" + std::to_string(i) + ".txt").c_str(), files[i]);
+		}
+
+		YAAWS web(card);
+
+		web.begin();
+
+		for (int i = 0; i < count; i++)
+		{
+			std::string path = "/big" + std::to_string(i) + ".txt";
+
+			peers[i] = ConnectTo(web, Request("GET", path.c_str()), readBytesPerMilli);
+			CHECK(peers[i] >= 0);
+		}
+
+		std::string transcript;
+
+		for (int i = 0; i < count; i++)
+		{
+			CHECK(RunUntilClosed(web, peers[i]));
+
+			//  Turned away while every connection was busy, so try again, as a browser
+			//  would.
+			for (int tries = 0; (tries < 100) && (StatusLine(Received(peers[i])) ==
+													 "HTTP/1.0 503 Service Unavailable");
+				 tries++)
+			{
+				std::string path = "/big" + std::to_string(i) + ".txt";
+
+				peers[i] = ConnectTo(web, Request("GET", path.c_str()),
+									 readBytesPerMilli);
+				CHECK(RunUntilClosed(web, peers[i]));
+			}
+
+			CHECK(StatusLine(Received(peers[i])) == "HTTP/1.0 200 OK");
+			CHECK(Body(Received(peers[i])) == files[i]);
+
+			transcript += Received(peers[i]) + "@" + std::to_string(ClosedAt(peers[i]));
+		}
+
+		return transcript;
+	}
+
+
+	void ConcurrentDownloads()
+	{
+		ManyDownloads(0);
+	}
+
+
+	//  A slow reader fills the socket's send buffer.  The server must not wait for it to
+	//  empty, but come back later - except at the very end, where 'flush' waits for the
+	//  reader to take the last buffer full before the connection is closed.
+	void SlowReader()
+	{
+		const uint32_t readBytesPerMilli = 10;
+		std::string big = Pattern(30000, 'x');
+
+		AddFile("/WWW/big.txt", big);
+
+		YAAWS web(card);
+
+		web.begin();
+
+		int peer = ConnectTo(web, Request("GET", "/big.txt"), readBytesPerMilli);
+		uint32_t longest = 0;
+		uint32_t last = 0;
+
+		while (!Closed(peer) && (Now() < 60000000ULL))
+		{
+			longest = max(longest, last);
+			last = Step(web);
+		}
+
+		CHECK(Closed(peer));
+		CHECK(Body(Received(peer)) == big);
+		CHECK(longest < 20000);
+		CHECK(last <= (Config().bufferSize / readBytesPerMilli + 10) * 1000);
+	}
+
+
+	//  The same scenario gives the same bytes at the same times.
+	void Deterministic()
+	{
+		std::string first = ManyDownloads(40);
+		uint64_t firstEnd = Now();
+
+		Reset();
+
+		std::string second = ManyDownloads(40);
+
+		CHECK(first == second);
+		CHECK(firstEnd == Now());
+	}
+
+
+	//  A peer that hangs up part way through frees its connection for the next one.
+	void PeerHangsUp()
+	{
+		std::string big = Pattern(40000, 'q');
+
+		AddFile("/WWW/big.txt", big);
+		AddFile("/WWW/index.html", indexPage);
+
+		YAAWS web(card);
+
+		web.begin();
+
+		int quitter = ConnectTo(web, Request("GET", "/big.txt"), 5);
+
+		for (int i = 0; i < 2000; i++)
+		{
+			Step(web);
+		}
+
+		CHECK(!Closed(quitter));
+		Disconnect(quitter);
+		CHECK(RunUntilClosed(web, quitter));
+
+		int peer = ConnectTo(web, Request("GET", "/index.html"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == indexPage);
+	}
+
+
+#if (YAAWS_SCHEDULER == YAAWS_SCHEDULE_DEFICIT) && !defined(YAAWS_ONE_STREAM_ONLY)
+	//  '/urgent' paths go first.
+	class Prioritizer : public YaawsCallback
+	{
+	public:
+		byte RequestPriority(const char *path) override
+		{
+			return (strncmp(path, "/urgent", 7) == 0) ? 2 : 0;
+		}
+	};
+
+
+	//  With the server rather than the wire holding things up, a connection at priority
+	//  2 gets four times the bytes of one at priority 0.
+	void DeficitShares()
+	{
+		std::string big = Pattern(100000, 'd');
+
+		AddFile("/WWW/urgent.txt", big);
+		AddFile("/WWW/bulk.txt", big);
+
+		SimConfig saved = Config();
+
+		Config().wireBytesPerMilli = 1000000;
+		Config().bufferSize = 16384;
+
+		Prioritizer prioritizer;
+		YAAWS web(card, prioritizer);
+
+		web.begin();
+
+		int bulk = ConnectTo(web, Request("GET", "/bulk.txt"));
+		int urgent = ConnectTo(web, Request("GET", "/urgent.txt"));
+
+		CHECK(RunUntilClosed(web, urgent));
+
+		double share = (double)Received(bulk).size() / Received(urgent).size();
+
+		CHECK((share > 0.2) && (share < 0.3));
+		CHECK(RunUntilClosed(web, bulk));
+		CHECK(Body(Received(bulk)) == big);
+
+		Config() = saved;
+	}
+#endif
+
+
+#ifdef YAAWS_PATH_CACHE
+	std::string Fetch(YAAWS &web, const char *path)
+	{
+		int peer = ConnectTo(web, Request("GET", path));
+
+		CHECK(RunUntilClosed(web, peer));
+		return Received(peer);
+	}
+
+
+	//  A cached file whose directory slot now holds another file isn't served in its
+	//  place.
+	void PathCacheSlotReused()
+	{
+		AddFile("/WWW/a.html", "first");
+
+		YAAWS web(card);
+
+		web.begin();
+
+		CHECK(Body(Fetch(web, "/a.html")) == "first");
+
+		RemoveFile("/WWW/a.html");
+		AddFile("/WWW/b.html", "second");
+
+		CHECK(StatusLine(Fetch(web, "/a.html")) == "HTTP/1.0 404 Not Found");
+		CHECK(Body(Fetch(web, "/b.html")) == "second");
+	}
+
+
+	//  A file known to be missing is looked for again once YAAWS_PATH_CACHE_MISS_MS has
+	//  passed.
+	void PathCacheMissExpires()
+	{
+		AddFile("/WWW/index.html", indexPage);
+
+		YAAWS web(card);
+
+		web.begin();
+
+		CHECK(StatusLine(Fetch(web, "/late.html")) == "HTTP/1.0 404 Not Found");
+
+		AddFile("/WWW/late.html", "here now");
+
+		CHECK(StatusLine(Fetch(web, "/late.html")) == "HTTP/1.0 404 Not Found");
+
+		Advance(YAAWS_PATH_CACHE_MISS_MS * 1000UL);
+
+		CHECK(Body(Fetch(web, "/late.html")) == "here now");
+	}
+#endif
+
+
+#ifdef YAAWS_SECTOR_CACHE
+	uint32_t FirstCluster(const char *path)
+	{
+		SdFile file;
+
+		return file.open(path, O_RDONLY) ? file.firstCluster() : 0;
+	}
+
+
+	//  A file deleted and written again starts on the same cluster, but isn't served
+	//  from the cached sectors of the old one.
+	void SectorCacheRecreated()
+	{
+		AddFile("/WWW/a.html", Pattern(1000, 'a'));
+
+		YAAWS web(card);
+
+		web.begin();
+
+		int peer = ConnectTo(web, Request("GET", "/a.html"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == Pattern(1000, 'a'));
+
+		uint32_t cluster = FirstCluster("/WWW/a.html");
+
+		RemoveFile("/WWW/a.html");
+		AddFile("/WWW/a.html", Pattern(900, 'b'));
+		CHECK(FirstCluster("/WWW/a.html") == cluster);
+
+		peer = ConnectTo(web, Request("GET", "/a.html"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == Pattern(900, 'b'));
+	}
+#endif
+
+
+#ifdef YAAWS_AUTOINDEX
+	size_t Count(const std::string &text, const std::string &what)
+	{
+		size_t count = 0;
+
+		for (size_t at = text.find(what); at != std::string::npos;
+			 at = text.find(what, at + 1))
+		{
+			count++;
+		}
+
+		return count;
+	}
+
+
+	//  A directory without 'index.html' is listed.  Links are percent-encoded, the text
+	//  HTML-escaped, and out of range paging values are brought into range.
+	void DirectoryListing()
+	{
+		AddFile("/WWW/docs/a b#1.txt", "one");
+		AddFile("/WWW/docs/100%.txt", "two");
+		AddFile("/WWW/docs/x&y?.txt", "three");
+
+		YAAWS web(card);
+
+		web.begin();
+
+		int peer = ConnectTo(web, Request("GET", "/docs/"));
+
+		CHECK(RunUntilClosed(web, peer));
+
+		std::string body = Body(Received(peer));
+
+		CHECK(body.find("href=\"a%20b%231.txt\">a b#1.txt</a>") != std::string::npos);
+		CHECK(body.find("href=\"100%25.txt\">100%.txt</a>") != std::string::npos);
+		CHECK(body.find("href=\"x%26y%3F.txt\">x&amp;y?.txt</a>") != std::string::npos);
+		CHECK(body.find("More") == std::string::npos);
+
+		//  A limit of 0 lists one entry rather than none, so 'More' moves on.
+		peer = ConnectTo(web, Request("GET", "/docs/?offset=-5&limit=0"));
+
+		CHECK(RunUntilClosed(web, peer));
+		body = Body(Received(peer));
+		CHECK(Count(body, "<tr><td>") == 1);
+		CHECK(body.find("?offset=1&amp;limit=1") != std::string::npos);
+
+		peer = ConnectTo(web, Request("GET", "/docs/?offset=2&limit=99999999"));
+
+		CHECK(RunUntilClosed(web, peer));
+		body = Body(Received(peer));
+		CHECK(Count(body, "<tr><td>") == 1);
+		CHECK(body.find("More") == std::string::npos);
+
+		peer = ConnectTo(web, Request("GET", "/docs/?offset=99999999"));
+
+		CHECK(RunUntilClosed(web, peer));
+		body = Body(Received(peer));
+		CHECK(Count(body, "<tr><td>") == 0);
+		CHECK(body.find("More") == std::string::npos);
+	}
+#endif
+
+
+#ifdef YAAWS_LOG_TAIL
+	//  '?tail=N' starts at the first whole line in the last N bytes, and doesn't search
+	//  a line without end for one.
+	void Tail()
+	{
+		std::string lines;
+
+		for (int i = 0; i < 100; i++)
+		{
+			lines += "line " + std::to_string(i) + "\n";
+		}
+
+		std::string noBreaks = Pattern(5000, 'n');
+
+		AddFile("/WWW/lines.log", lines);
+		AddFile("/WWW/nobreaks.log", noBreaks);
+
+		YAAWS web(card);
+
+		web.begin();
+
+		int peer = ConnectTo(web, Request("GET", "/lines.log?tail=20"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == "line 98\nline 99\n");
+
+		peer = ConnectTo(web, Request("GET", "/nobreaks.log?tail=3000"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == noBreaks.substr(2000));
+	}
+#endif
+
+
+#ifdef YAAWS_CSV_INDEX
+	//  Rows 'first' to 'last' of a log with a row every ten seconds.
+	std::string CsvRows(int first, int last)
+	{
+		std::string rows;
+
+		for (int i = first; i <= last; i++)
+		{
+			rows += std::to_string(1000 + i * 10) + "," + std::to_string(i % 97) + "\n";
+		}
+
+		return rows;
+	}
+
+
+	//  The index of the CSV file at 'path', which is named for its first cluster.
+	std::string CsvIndexOf(const char *path)
+	{
+		SdFile file;
+
+		if (!file.open(path, O_RDONLY))
+		{
+			return "";
+		}
+
+		char name[32];
+
+		snprintf(name, sizeof(name), YAAWS_CSV_INDEX_DIR "/%lX.IDX",
+				 (unsigned long)file.firstCluster());
+		file.close();
+
+		return FileContents(name);
+	}
+
+
+	uint32_t Word(const std::string &data, size_t at)
+	{
+		uint32_t word = 0;
+
+		if (at + sizeof(word) <= data.size())
+		{
+			memcpy(&word, data.data() + at, sizeof(word));
+		}
+
+		return word;
+	}
+
+
+	//  Time ranges of a CSV file come from the index, which is kept and brought up to
+	//  date as rows are added.
+	void CsvRange()
+	{
+		AddFile("/WWW/data.csv", CsvRows(0, 999), false);
+
+		YAAWS web(card);
+
+		web.begin();
+
+		//  Inside the first block of YAAWS_CSV_INDEX_ROWS rows.
+		int peer = ConnectTo(web, Request("GET", "/data.csv?from=1050&to=1100"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == CsvRows(5, 10));
+
+		//  The index is a header, then an entry for every YAAWS_CSV_INDEX_ROWS'th row.
+		std::string index = CsvIndexOf("/WWW/data.csv");
+		uint32_t entries = (1000 + YAAWS_CSV_INDEX_ROWS - 1) / YAAWS_CSV_INDEX_ROWS;
+
+		CHECK(index.compare(0, 4, "YCI1") == 0);
+		CHECK(Word(index, 4) == CsvRows(0, 999).size());
+		CHECK(Word(index, 8) == 1000);
+		CHECK(index.size() == 12 + entries * 8);
+		CHECK(Word(index, 12) == 1000);
+		CHECK(Word(index, 16) == 0);
+		CHECK(Word(index, 12 + 8) == 1000 + YAAWS_CSV_INDEX_ROWS * 10);
+		CHECK(Word(index, 16 + 8) == CsvRows(0, YAAWS_CSV_INDEX_ROWS - 1).size());
+
+		//  Open ended either way, and from the index already made.
+		peer = ConnectTo(web, Request("GET", "/data.csv?from=10000"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == CsvRows(900, 999));
+
+		peer = ConnectTo(web, Request("GET", "/data.csv?to=1020"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == CsvRows(0, 2));
+
+		peer = ConnectTo(web, Request("GET", "/data.csv?from=5005&to=7004"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == CsvRows(401, 600));
+		CHECK(CsvIndexOf("/WWW/data.csv") == index);
+
+		//  Rows added since are indexed on the next query.
+		SdFile log;
+
+		CHECK(log.open("/WWW/data.csv", O_WRONLY | O_APPEND));
+		log.write(CsvRows(1000, 1199).data(), CsvRows(1000, 1199).size());
+		log.close();
+
+		peer = ConnectTo(web, Request("GET", "/data.csv?from=10950&to=11050"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == CsvRows(995, 1005));
+
+		index = CsvIndexOf("/WWW/data.csv");
+		entries = (1200 + YAAWS_CSV_INDEX_ROWS - 1) / YAAWS_CSV_INDEX_ROWS;
+
+		CHECK(Word(index, 8) == 1200);
+		CHECK(index.size() == 12 + entries * 8);
+
+		peer = ConnectTo(web, Request("GET", "/data.csv?from=12900"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == CsvRows(1190, 1199));
+	}
+#endif
+
+
+#ifdef YAAWS_GZIP_STREAM
+	//  Text is compressed for a client that takes gzip, and unpacks to the file.  Half
+	//  the file hardly compresses, so a call's output fills the write buffer.
+	void GzipStream()
+	{
+		std::string page;
+		uint32_t random = 1;
+
+		for (int i = 0; i < 1000; i++)
+		{
+			page += "<p>Line " + std::to_string(i) + "</p>\n<p>";
+
+			for (int j = 0; j < 40; j++)
+			{
+				random = random * 1103515245 + 12345;
+				page += (char)('a' + (random >> 16) % 26);
+			}
+
+			page += "</p>\n";
+		}
+
+		AddFile("/WWW/big.html", page);
+		AddFile("/WWW/index.html", indexPage);
+
+		YAAWS web(card);
+
+		web.begin();
+
+		std::string acceptGzip = "GET /big.html HTTP/1.1\r\n"
+			"Accept-Encoding: deflate, gzip\r\n\r\n";
+		int peer = ConnectTo(web, acceptGzip);
+
+		CHECK(RunUntilClosed(web, peer, 10000000ULL));
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 200 OK");
+		CHECK(Received(peer).find("Content-Encoding: gzip") != std::string::npos);
+		CHECK(Body(Received(peer)).size() < page.size());
+		CHECK(Gunzip(Body(Received(peer))) == page);
+
+		//  Not for a client that doesn't ask, or a file too small to be worth it.
+		peer = ConnectTo(web, Request("GET", "/big.html"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Received(peer).find("Content-Encoding") == std::string::npos);
+		CHECK(Body(Received(peer)) == page);
+
+		peer = ConnectTo(web, "GET /index.html HTTP/1.1\r\n"
+			"Accept-Encoding: gzip\r\n\r\n");
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Received(peer).find("Content-Encoding") == std::string::npos);
+		CHECK(Body(Received(peer)) == indexPage);
+	}
+#endif
+
+
+#ifdef YAAWS_PACKED_SITE
+	struct PackedFile
+	{
+		const char *path;
+		std::string contents;
+		uint8_t flags;          //  1 if gzip'd, 2 if cacheable
+	};
+
+
+	template <class T> void Append(std::string &data, T value)
+	{
+		data.append((const char *)&value, sizeof(value));
+	}
+
+
+	//  An archive of 'files', laid out as 'extras/yaaws_pack.py' does it.  Every file is
+	//  served as HTML, and its ETag is its position in the list.
+	std::string Pack(const std::vector<PackedFile> &files)
+	{
+		uint32_t buckets = 1;
+
+		while (buckets < 2 * files.size())
+		{
+			buckets *= 2;
+		}
+
+		std::vector<std::string> table(buckets);
+		std::string blobs;
+		uint32_t offset = 16 + buckets * 20;
+
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			const PackedFile &file = files[i];
+			uint32_t hash = 2166136261UL;
+
+			for (const char *c = file.path; *c != '\0'; c++)
+			{
+				hash = (hash ^ (uint8_t)tolower(*c)) * 16777619UL;
+			}
+
+			offset += strlen(file.path);
+
+			std::string entry;
+
+			Append(entry, hash);
+			Append(entry, offset);
+			Append(entry, (uint32_t)file.contents.size());
+			Append(entry, (uint32_t)i + 1);
+			Append(entry, (uint8_t)strlen(file.path));
+			Append(entry, (uint8_t)1);
+			Append(entry, file.flags);
+			Append(entry, (uint8_t)0);
+
+			uint32_t bucket = hash & (buckets - 1);
+
+			while (!table[bucket].empty())
+			{
+				bucket = (bucket + 1) & (buckets - 1);
+			}
+
+			table[bucket] = entry;
+			blobs += file.path + file.contents;
+			offset += file.contents.size();
+		}
+
+		std::string archive = "YAWP";
+
+		Append(archive, (uint16_t)1);
+		Append(archive, (uint16_t)0);
+		Append(archive, buckets);
+		Append(archive, (uint32_t)files.size());
+
+		for (const std::string &entry : table)
+		{
+			archive += entry.empty() ? std::string(20, '\0') : entry;
+		}
+
+		return archive + blobs;
+	}
+
+
+	//  Files in the archive are served from it, ahead of the web root, and a gzip'd one
+	//  only to a client that takes gzip.  Anything else comes from the web root.
+	void PackedSite()
+	{
+		std::string script = Pattern(3000, 's');
+
+		AddFile(YAAWS_PACKED_SITE_FILE, Pack({
+			{"/index.html", "packed index", 2},
+			{"/app/main.js", Gzip(script), 3},
+			{"/plain.js", script, 0},
+		}));
+		AddFile("/WWW/index.html", indexPage);
+		AddFile("/WWW/card.html", "card only");
+
+		YAAWS web(card);
+
+		CHECK(web.begin());
+
+		int peer = ConnectTo(web, Request("GET", "/index.html"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 200 OK");
+		CHECK(Received(peer).find("ETag: \"1\"") != std::string::npos);
+		CHECK(Body(Received(peer)) == "packed index");
+
+		//  FAT doesn't care about case, so neither does the archive.
+		peer = ConnectTo(web, Request("GET", "/INDEX.html"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == "packed index");
+
+		peer = ConnectTo(web, Request("GET", "/card.html"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == "card only");
+
+		peer = ConnectTo(web, "GET /app/main.js HTTP/1.1\r\n"
+			"Accept-Encoding: gzip\r\n\r\n");
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Received(peer).find("Content-Encoding: gzip") != std::string::npos);
+		CHECK(Gunzip(Body(Received(peer))) == script);
+
+		peer = ConnectTo(web, Request("GET", "/plain.js"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Received(peer).find("Content-Encoding") == std::string::npos);
+		CHECK(Body(Received(peer)) == script);
+
+		//  Only a gzip'd copy, so a client that can't take it gets the web root's copy,
+		//  or nothing.
+		peer = ConnectTo(web, Request("GET", "/app/main.js"));
+
+		CHECK(RunUntilClosed(web, peer));
+#ifndef YAAWS_404_THE_ONE_TRUE_ERROR
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 406 Not Acceptable");
+#else
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 404 Not Found");
+#endif
+
+		AddFile("/WWW/app/main.js", "from the card");
+#ifdef YAAWS_PATH_CACHE
+		web.InvalidateCache();
+#endif
+
+		peer = ConnectTo(web, Request("GET", "/app/main.js"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == "from the card");
+	}
+#endif
+
+
+#ifdef YAAWS_FLASH_SITE
+	//  Files built into the sketch are served without touching the card, ahead of the
+	//  web root, and a gzip'd one only to a client that takes gzip.
+	void FlashSite()
+	{
+		static const char about[] = "about, from flash";
+		static const char index[] = "index, from flash";
+		static const std::string style = Gzip(Pattern(2000, 'c'));
+
+		//  Sorted by path, ignoring case, as 'extras/yaaws_flash.py' does it.
+		static const YaawsFlashFile files[] =
+		{
+			{"/About.html", (const uint8_t *)about, sizeof(about) - 1, 0x11, 1,
+			 YAAWS_FLASH_CACHEABLE},
+			{"/index.html", (const uint8_t *)index, sizeof(index) - 1, 0x22, 1, 0},
+			{"/style.css", (const uint8_t *)style.data(), (uint32_t)style.size(), 0x33, 10,
+			 YAAWS_FLASH_GZIP | YAAWS_FLASH_CACHEABLE},
+		};
+
+		AddFile("/WWW/index.html", indexPage);
+		AddFile("/WWW/card.html", "card only");
+
+		YAAWS web(card);
+
+		web.SetFlashSite(files, sizeof(files) / sizeof(files[0]));
+		CHECK(web.begin());
+
+		//  A card this slow would take seconds to find a file.
+		SimConfig saved = Config();
+
+		Config().readMicros = 1000000;
+
+		int peer = ConnectTo(web, Request("GET", "/index.html"));
+		uint64_t start = Now();
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(ClosedAt(peer) - start < 100000);
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 200 OK");
+		CHECK(Received(peer).find("ETag: \"22\"") != std::string::npos);
+		CHECK(Body(Received(peer)) == index);
+
+		peer = ConnectTo(web, Request("GET", "/about.HTML"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == about);
+
+		peer = ConnectTo(web, "GET /style.css HTTP/1.1\r\n"
+			"Accept-Encoding: gzip\r\n\r\n");
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Received(peer).find("Content-Type: text/css") != std::string::npos);
+		CHECK(Received(peer).find("Content-Encoding: gzip") != std::string::npos);
+		CHECK(Body(Received(peer)) == style);
+
+		Config() = saved;
+
+		peer = ConnectTo(web, Request("GET", "/card.html"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == "card only");
+
+		peer = ConnectTo(web, Request("GET", "/style.css"));
+
+		CHECK(RunUntilClosed(web, peer));
+#ifndef YAAWS_404_THE_ONE_TRUE_ERROR
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 406 Not Acceptable");
+#else
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 404 Not Found");
+#endif
+	}
+#endif
+
+
+#ifdef YAAWS_SD_PREFETCH
+	//  Two slow readers of different files, their sockets taking a few bytes at a time.
+	//  Returns how long the calls to the server took in all.
+	uint64_t TwoSlowReaders(const std::string &a, const std::string &b)
+	{
+		Reset();
+		AddFile("/WWW/a.txt", a);
+		AddFile("/WWW/b.txt", b);
+
+		YAAWS web(card);
+
+		web.begin();
+
+		int peerA = ConnectTo(web, Request("GET", "/a.txt"), 2);
+		int peerB = ConnectTo(web, Request("GET", "/b.txt"), 2);
+		uint64_t busy = 0;
+
+		CHECK((peerA >= 0) && (peerB >= 0));
+
+		while (!(Closed(peerA) && Closed(peerB)) && (Now() < 60000000ULL))
+		{
+			busy += Step(web);
+		}
+
+		CHECK(Body(Received(peerA)) == a);
+		CHECK(Body(Received(peerB)) == b);
+
+		return busy;
+	}
+
+
+	//  Each sector is read from the card once, into the staging buffer, however little
+	//  room the sockets have each time.  Without it, every few bytes sent are read again,
+	//  and the two files take turns pushing each other's sector out of the card's cache.
+	void PrefetchReadsAhead()
+	{
+		SimConfig saved = Config();
+		std::string a = Pattern(2048 + 37, 'a');
+		std::string b = Pattern(2048 + 11, 'b');
+		const uint64_t sectors = 5 + 5;
+
+		Config().bufferSize = 512;
+
+		Config().readMicros = 0;
+		uint64_t withoutCard = TwoSlowReaders(a, b);
+
+		Config().readMicros = saved.readMicros;
+		uint64_t withCard = TwoSlowReaders(a, b);
+
+		CHECK(withCard - withoutCard <= sectors * Config().readMicros);
+
+		Config() = saved;
+	}
+#endif
+
+
+#ifdef YAAWS_WRITE_COMBINING
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+	//  Makes the body of every file with a lot of small prints.
+	class Rows : public YaawsCallback
+	{
+	public:
+		using YaawsCallback::IsMutable;
+		using YaawsCallback::FileAction;
+
+		bool IsMutable(const char *path) override
+		{
+			return true;
+		}
+
+		bool FileAction(WebClientType &client, WebFileType &file) override
+		{
+			for (int i = 0; i < 20; i++)
+			{
+				client.print(F("row "));
+				client.print(i);
+				client.println();
+			}
+
+			return false;
+		}
+	};
+#endif
+
+
+	//  The header goes out with the start of the body, and a callback's prints are
+	//  gathered up, so a short response is one write to the socket.
+	void WriteCombining()
+	{
+		AddFile("/WWW/small.html", Pattern(300, 's'));
+
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+		Rows rows;
+		YAAWS web(card, rows);
+#else
+		YAAWS web(card);
+#endif
+
+		web.begin();
+
+		int peer = ConnectTo(web, Request("GET", "/small.html"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == Pattern(300, 's'));
+		CHECK(Writes(peer) == 1);
+
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+		std::string expected;
+
+		for (int i = 0; i < 20; i++)
+		{
+			expected += "row " + std::to_string(i) + "\r\n";
+		}
+
+		AddFile("/WWW/live.html", "", false);
+		peer = ConnectTo(web, Request("GET", "/live.html"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == expected);
+		CHECK(Writes(peer) == 1);
+#endif
+	}
+#endif
+
+
+#ifdef YAAWS_ACCESS_LOG
+	//  Gives the time as 1 Jan 2020, midnight.
+	class Clock : public YaawsCallback
+	{
+	public:
+		uint32_t CurrentTime() override
+		{
+			return 1577836800UL;
+		}
+	};
+
+
+	//  Requests are logged once they finish, but written to the card only once the
+	//  server has nothing else to do, and has waited YAAWS_ACCESS_LOG_FLUSH_MS.
+	void AccessLog()
+	{
+		AddFile("/WWW/index.html", Pattern(1000, 'i'));
+
+		Clock clock;
+		YAAWS web(card, clock);
+
+		web.begin();
+
+		int found = ConnectTo(web, Request("GET", "/index.html"));
+
+		CHECK(RunUntilClosed(web, found));
+
+		int missing = ConnectTo(web, Request("GET", "/missing.html"));
+
+		CHECK(RunUntilClosed(web, missing));
+		CHECK(FileContents(YAAWS_ACCESS_LOG_FILE).empty());
+
+		uint64_t until = Now() + (YAAWS_ACCESS_LOG_FLUSH_MS + 100) * 1000ULL;
+
+		while (Now() < until)
+		{
+			Step(web);
+		}
+
+		std::string log = FileContents(YAAWS_ACCESS_LOG_FILE);
+
+		//  The last field, the milliseconds taken, depends on the timing.
+		CHECK(log.find("10.0.0.1 - - [01/Jan/2020:00:00:00 +0000] "
+					   "\"GET /index.html HTTP/1.1\" 200 1000 ") == 0);
+		CHECK(log.find("\n10.0.0.2 - - [01/Jan/2020:00:00:00 +0000] "
+					   "\"GET /missing.html HTTP/1.1\" 404 - ") == log.find('\n'));
+		CHECK(std::count(log.begin(), log.end(), '\n') == 2);
+		CHECK(web.AccessLogDropped() == 0);
+	}
+#endif
+
+
+#if YAAWS_MAX_LISTENERS > 1
+	//  A second port, with its own web root and callback, and a connection kept for it.
+	//  It gets in while every other connection is busy with the first port.
+	void MultipleListeners()
+	{
+		AddFile("/WWW/index.html", indexPage);
+		AddFile("/WWW/big.html", Pattern(20000, 'w'));
+		AddFile("/API/index.html", "api");
+
+		Recorder pages;
+		Recorder api;
+		EthernetServer apiServer(8080);
+		YAAWS web(card, pages);
+
+		CHECK(web.AddListener(apiServer, api, PSTR("/API"), 1));
+		web.begin();
+
+		int peer = ConnectTo(web, Request("GET", "/index.html?page=1"));
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == indexPage);
+		CHECK(pages.lastData == "page=1");
+
+		int slow[YAAWS_MAX_CLIENTS];
+
+		for (int i = 0; i < YAAWS_MAX_CLIENTS; i++)
+		{
+			slow[i] = ConnectTo(web, Request("GET", "/big.html"), 1);
+
+			for (int steps = 0; steps < 50; steps++)
+			{
+				Step(web);
+			}
+		}
+
+		//  The last has to wait for one of the others.
+		CHECK(Received(slow[YAAWS_MAX_CLIENTS - 1]).empty());
+
+		peer = Connect(8080, Request("GET", "/index.html?api=1"), 0);
+
+		CHECK(RunUntilClosed(web, peer));
+		CHECK(Body(Received(peer)) == "api");
+		CHECK(api.lastData == "api=1");
+		CHECK(pages.lastData == "page=1");
+
+		for (int i = 0; i < YAAWS_MAX_CLIENTS; i++)
+		{
+			CHECK(!Closed(slow[i]));
+		}
+	}
+#endif
+
+
+	//  A server of its own kind on port 8080, set up to take one connection at a time,
+	//  GET and HEAD only, with every error a 404.  The usual server beside it is not
+	//  changed by it.
+	struct LeanConfig : YaawsConfig
+	{
+		static constexpr byte maxClients = 1;
+		static constexpr bool getIsAllWeNeed = true;
+		static constexpr bool only404Errors = true;
+	};
+
+	typedef BasicYaaws<YaawsDefaultTransport, YaawsDefaultFileSystem, LeanConfig>
+		LeanYaaws;
+
+	//  Calls both servers once.
+	void StepBoth(YAAWS &web, LeanYaaws &lean)
+	{
+		lean.ServiceWebServer();
+		Step(web);
+	}
+
+	//  Connects to port 8080, retrying until the lean server is listening again.
+	int ConnectToLean(YAAWS &web, LeanYaaws &lean, const std::string &request,
+					  uint32_t readBytesPerMilli = 0)
+	{
+		int peer = Connect(8080, request, readBytesPerMilli);
+
+		for (int tries = 0; (peer < 0) && (tries < 100000); tries++)
+		{
+			StepBoth(web, lean);
+			peer = Connect(8080, request, readBytesPerMilli);
+		}
+
+		return peer;
+	}
+
+	bool RunBothUntilClosed(YAAWS &web, LeanYaaws &lean, int peer)
+	{
+		uint64_t end = Now() + 60000000ULL;
+
+		while (!Closed(peer) && (Now() < end))
+		{
+			StepBoth(web, lean);
+		}
+
+		return Closed(peer);
+	}
+
+	void TwoConfigurations()
+	{
+		std::string big = Pattern(3000, 't');
+
+		AddFile("/WWW/index.html", indexPage);
+		AddFile("/WWW/big.html", big);
+
+		YAAWS web(card);
+		LeanYaaws lean(card, nullptr, 8080);
+
+		CHECK(web.begin());
+		CHECK(lean.begin());
+
+		int slow = ConnectToLean(web, lean, Request("GET", "/big.html"), 1);
+		int waiting = ConnectToLean(web, lean, Request("GET", "/index.html"));
+
+		for (int steps = 0; steps < 200; steps++)
+		{
+			StepBoth(web, lean);
+		}
+
+		//  One at a time - the second waits for the slow download, or is turned away.
+		CHECK(!Received(slow).empty());
+#ifdef YAAWS_OVERLOAD_REJECT
+		CHECK(StatusLine(Received(waiting)) == "HTTP/1.0 503 Service Unavailable");
+#else
+		CHECK(Received(waiting).empty());
+#endif
+
+		//  Meanwhile the usual server still takes POST, and says what was wrong.
+		int peer = ConnectTo(web, Request("POST", "/index.html", "led=on"));
+
+		CHECK(RunUntilClosed(web, peer));
+#ifndef YAAWS_GET_IS_ALL_WE_NEED
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 200 OK");
+#endif
+
+		peer = ConnectTo(web, Request("DELETE", "/index.html"));
+
+		CHECK(RunUntilClosed(web, peer));
+#ifndef YAAWS_404_THE_ONE_TRUE_ERROR
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 405 Method Not Allowed");
+#endif
+
+		CHECK(RunBothUntilClosed(web, lean, slow));
+		CHECK(RunBothUntilClosed(web, lean, waiting));
+		CHECK(Body(Received(slow)) == big);
+#ifndef YAAWS_OVERLOAD_REJECT
+		CHECK(Body(Received(waiting)) == indexPage);
+#endif
+
+		peer = ConnectToLean(web, lean, Request("POST", "/index.html", "led=on"));
+
+		CHECK(RunBothUntilClosed(web, lean, peer));
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 404 Not Found");
+
+		peer = ConnectToLean(web, lean, Request("DELETE", "/index.html"));
+
+		CHECK(RunBothUntilClosed(web, lean, peer));
+		CHECK(StatusLine(Received(peer)) == "HTTP/1.0 404 Not Found");
+	}
+
+
+	//  A sketch that sleeps calls the server only when there is work.  It still sees
+	//  a request arrive, and a slow reader's download through to the end, but isn't
+	//  called while the reader's socket is full.
+	void PendingWork()
+	{
+		std::string big = Pattern(3000, 'p');
+
+		AddFile("/WWW/big.txt", big);
+
+		YAAWS web(card);
+
+		web.begin();
+		Step(web);
+
+		CHECK(!web.HasPendingWork());
+#if YAAWS_ACCEPT_INTERVAL_MICROS == 0
+		CHECK(web.NextDeadlineMicros() == 0xFFFFFFFFUL);
+#else
+		CHECK(web.NextDeadlineMicros() <= YAAWS_ACCEPT_INTERVAL_MICROS);
+#endif
+
+		int peer = Connect(80, Request("GET", "/big.txt"), 1);
+		uint64_t until = Now() + YAAWS_ACCEPT_INTERVAL_MICROS;
+
+		CHECK(peer >= 0);
+
+		while (!web.HasPendingWork() && (Now() <= until))
+		{
+			Advance(Config().tickMicros);
+		}
+
+		CHECK(web.HasPendingWork());
+		CHECK(web.NextDeadlineMicros() == 0);
+
+		int calls = 0;
+		int skipped = 0;
+
+		while (!Closed(peer) && (Now() < 60000000ULL))
+		{
+			if (web.HasPendingWork())
+			{
+				Step(web);
+				calls++;
+			}
+			else
+			{
+				Advance(Config().tickMicros);
+				skipped++;
+			}
+		}
+
+		CHECK(Body(Received(peer)) == big);
+		CHECK(skipped > calls);
+
+		Step(web);
+		CHECK(!web.HasPendingWork());
+	}
+
+
+	struct Test
+	{
+		const char *name;
+		void (*run)();
+	};
+
+	const Test tests[] =
+	{
+		{"GetFile", GetFile},
+		{"MissingFile", MissingFile},
+		{"HeadHasNoBody", HeadHasNoBody},
+		{"QueryString", QueryString},
+#ifndef YAAWS_GET_IS_ALL_WE_NEED
+		{"PostForm", PostForm},
+#endif
+		{"FormBinding", FormBinding},
+		{"ConcurrentDownloads", ConcurrentDownloads},
+		{"SlowReader", SlowReader},
+		{"Deterministic", Deterministic},
+		{"PeerHangsUp", PeerHangsUp},
+#if (YAAWS_SCHEDULER == YAAWS_SCHEDULE_DEFICIT) && !defined(YAAWS_ONE_STREAM_ONLY)
+		{"DeficitShares", DeficitShares},
+#endif
+#ifdef YAAWS_PATH_CACHE
+		{"PathCacheSlotReused", PathCacheSlotReused},
+		{"PathCacheMissExpires", PathCacheMissExpires},
+#endif
+#ifdef YAAWS_SECTOR_CACHE
+		{"SectorCacheRecreated", SectorCacheRecreated},
+#endif
+#ifdef YAAWS_AUTOINDEX
+		{"DirectoryListing", DirectoryListing},
+#endif
+#ifdef YAAWS_LOG_TAIL
+		{"Tail", Tail},
+#endif
+#ifdef YAAWS_CSV_INDEX
+		{"CsvRange", CsvRange},
+#endif
+#ifdef YAAWS_GZIP_STREAM
+		{"GzipStream", GzipStream},
+#endif
+#ifdef YAAWS_PACKED_SITE
+		{"PackedSite", PackedSite},
+#endif
+#ifdef YAAWS_FLASH_SITE
+		{"FlashSite", FlashSite},
+#endif
+#ifdef YAAWS_SD_PREFETCH
+		{"PrefetchReadsAhead", PrefetchReadsAhead},
+#endif
+#ifdef YAAWS_WRITE_COMBINING
+		{"WriteCombining", WriteCombining},
+#endif
+#ifdef YAAWS_ACCESS_LOG
+		{"AccessLog", AccessLog},
+#endif
+#if YAAWS_MAX_LISTENERS > 1
+		{"MultipleListeners", MultipleListeners},
+#endif
+		{"TwoConfigurations", TwoConfigurations},
+		{"PendingWork", PendingWork},
+	};
+}
+
+
+int main(int argc, char *argv[])
+{
+	Verbose(argc > 1);
+
+	for (const Test &test : tests)
+	{
+		int failuresBefore = failures;
+
+		Reset();
+		test.run();
+
+		printf("%s %s\n", (failures == failuresBefore) ? "OK  " : "FAIL", test.name);
+	}
+
+	printf("%d checks, %d failed\n", checks, failures);
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+#
+#  MIT License
+#
+#  Copyright(c) 2019 M Hotchin
+#
+#  Load test for a YAAWS server.  Runs a mix of concurrent HTTP clients for a fixed
+#  time, then prints the results as JSON so they can be compared between releases:
+#  requests/s, bytes/s and p50/p99/max latency, overall and for each kind of request.
+#
+#  If the sketch serves 'PrintStatistics' output (YAAWS_STATISTICS) at some path, give it
+#  with --stats and the server's own figures (including the per-call time histogram)
+#  are fetched after the run and included.
+#
+#  usage: yaaws_bench.py [options] <host>
+#
+#  The default mix expects the files from 'examples/WebSite' in the web root, plus a
+#  large file for --large (default '/big.bin').
+
+import argparse
+import json
+import random
+import socket
+import threading
+import time
+
+KINDS = ('small', 'large', 'form', 'post', 'missing', 'slow')
+
+
+def request_for(kind, args):
+    if kind == 'small':
+        return b'GET %s HTTP/1.0\r\n\r\n' % args.small.encode()
+    if kind == 'large':
+        return b'GET %s HTTP/1.0\r\n\r\n' % args.large.encode()
+    if kind == 'form':
+        return b'GET %s?name=bench&value=%d HTTP/1.0\r\n\r\n' % (
+            args.small.encode(), random.randint(0, 99999))
+    if kind == 'post':
+        body = b'name=bench&value=%d' % random.randint(0, 99999)
+        return (b'POST %s HTTP/1.0\r\nContent-Type: application/x-www-form-urlencoded\r\n'
+                b'Content-Length: %d\r\n\r\n%s' % (args.small.encode(), len(body), body))
+    if kind == 'missing':
+        return b'GET /no/such/file%d.html HTTP/1.0\r\n\r\n' % random.randint(0, 99999)
+    return b'GET %s HTTP/1.0\r\n\r\n' % args.small.encode()
+
+
+def one_request(kind, args):
+    """Returns (bytes received, status) for one request."""
+    data = request_for(kind, args)
+    with socket.create_connection((args.host, args.port), timeout=args.timeout) as s:
+        if kind == 'slow':
+            #  Dribble the request out, like a client on a bad link.
+            for i in range(0, len(data), 4):
+                s.sendall(data[i:i + 4])
+                time.sleep(args.slow_delay)
+        else:
+            s.sendall(data)
+
+        received = 0
+        first = b''
+        while True:
+            chunk = s.recv(4096)
+            if not chunk:
+                break
+            if len(first) < 16:
+                first += chunk[:16]
+            received += len(chunk)
+            if kind == 'slow':
+                time.sleep(args.slow_delay)
+
+    parts = first.split(b' ')
+    status = int(parts[1]) if len(parts) > 1 and parts[1].isdigit() else 0
+    return received, status
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100.0))]
+
+
+def summarize(results, elapsed):
+    latencies = [r[1] for r in results if r[3] is None]
+    received = sum(r[2] for r in results)
+    return {
+        'requests': len(latencies),
+        'errors': sum(1 for r in results if r[3] is not None),
+        'requests_per_s': round(len(latencies) / elapsed, 2),
+        'bytes_per_s': round(received / elapsed, 1),
+        'latency_ms': {
+            'p50': percentile(latencies, 50),
+            'p99': percentile(latencies, 99),
+            'max': max(latencies) if latencies else None,
+        },
+    }
+
+
+def fetch_stats(args):
+    with socket.create_connection((args.host, args.port), timeout=args.timeout) as s:
+        s.sendall(b'GET %s HTTP/1.0\r\n\r\n' % args.stats.encode())
+        data = b''
+        while True:
+            chunk = s.recv(4096)
+            if not chunk:
+                break
+            data += chunk
+    body = data.split(b'\r\n\r\n', 1)[-1].split(b'\n\n', 1)[-1]
+    return json.loads(body.decode())
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Load test a YAAWS server.')
+    parser.add_argument('host')
+    parser.add_argument('--port', type=int, default=80)
+    parser.add_argument('--duration', type=float, default=30.0, help='seconds')
+    parser.add_argument('--clients', type=int, default=4,
+                        help='concurrent clients (default 4)')
+    parser.add_argument('--mix', default='small=6,large=1,form=2,post=1,missing=2,slow=1',
+                        help='relative weight of each kind of request')
+    parser.add_argument('--small', default='/index.html')
+    parser.add_argument('--large', default='/big.bin')
+    parser.add_argument('--slow-delay', type=float, default=0.05,
+                        help='seconds between pieces for slow clients')
+    parser.add_argument('--timeout', type=float, default=30.0)
+    parser.add_argument('--stats', help='path serving the server\'s statistics')
+    parser.add_argument('--seed', type=int, default=1)
+    args = parser.parse_args()
+
+    weights = dict((k, 0) for k in KINDS)
+    for item in args.mix.split(','):
+        name, weight = item.split('=')
+        if name not in weights:
+            parser.error('unknown request kind: ' + name)
+        weights[name] = int(weight)
+    kinds = [k for k in KINDS if weights[k] > 0]
+
+    random.seed(args.seed)
+    results = []
+    lock = threading.Lock()
+    deadline = time.monotonic() + args.duration
+
+    def worker(n):
+        rng = random.Random(args.seed + n)
+        while time.monotonic() < deadline:
+            kind = rng.choices(kinds, [weights[k] for k in kinds])[0]
+            start = time.monotonic()
+            try:
+                received, status = one_request(kind, args)
+                error = None
+            except OSError as e:
+                received, status, error = 0, 0, str(e)
+            latency = round((time.monotonic() - start) * 1000.0, 2)
+            with lock:
+                results.append((kind, latency, received, error, status))
+
+    started = time.monotonic()
+    threads = [threading.Thread(target=worker, args=(n,)) for n in range(args.clients)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.monotonic() - started
+
+    report = {
+        'host': args.host,
+        'clients': args.clients,
+        'duration_s': round(elapsed, 2),
+        'mix': dict((k, weights[k]) for k in kinds),
+        'overall': summarize(results, elapsed),
+        'by_kind': dict((k, summarize([r for r in results if r[0] == k], elapsed))
+                        for k in kinds),
+    }
+
+    if args.stats:
+        try:
+            report['server'] = fetch_stats(args)
+        except (OSError, ValueError) as e:
+            report['server'] = {'error': str(e)}
+
+    print(json.dumps(report, indent=2))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+#
+#  MIT License
+#
+#  Copyright(c) 2019 M Hotchin
+#
+#  Turns a directory on your PC into a header of PROGMEM data for a YAAWS flash site
+#  (see YAAWS_FLASH_SITE in YAAWS.h).  Include the header in your sketch, then:
+#
+#      web.SetFlashSite(siteFiles, siteFileCount);
+#
+#  before calling 'web.begin()'.
+#
+#  usage: yaaws_flash.py [--gzip] [--no-cache] [--name site] <site directory> <header>
+#
+#  With --gzip, files stored gzip'd are only sent to clients that send
+#  'Accept-Encoding: gzip'.  Other clients get a plain copy from the packed site or the SD
+#  card web root if there is one, otherwise 406 Not Acceptable.
+
+import argparse
+import gzip
+import os
+import sys
+import zlib
+
+from yaaws_pack import (TEXT_TYPES, PACK_CACHEABLE, PACK_GZIP, collect,
+                        response_type)
+
+
+def ascii_lower(data):
+    """Lower case the way strcasecmp() does, so our sort order matches YAAWS."""
+    return bytes(b + 32 if 65 <= b <= 90 else b for b in data)
+
+
+def c_bytes(data, indent='\t'):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append(indent + ', '.join('0x%02x' % b for b in data[i:i + 16]) + ',')
+    return '\n'.join(lines)
+
+
+def c_string(text):
+    return '"' + text.replace('\\', '\\\\').replace('"', '\\"') + '"'
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Build a YAAWS flash site header.')
+    parser.add_argument('--gzip', action='store_true',
+                        help='store text files gzip\'d, when that makes them smaller')
+    parser.add_argument('--no-cache', action='store_true',
+                        help='do not mark files as cacheable by clients')
+    parser.add_argument('--name', default='site',
+                        help='prefix for the generated names (default: site)')
+    parser.add_argument('site', help='directory holding the web site')
+    parser.add_argument('header', help='header file to write')
+    args = parser.parse_args()
+
+    files = sorted(collect(args.site),
+                   key=lambda f: ascii_lower(f[0].encode('utf-8')))
+
+    out = []
+    out.append('//  Generated by yaaws_flash.py from \'%s\' - do not edit.' %
+               os.path.basename(os.path.normpath(args.site)))
+    out.append('')
+    out.append('#pragma once')
+    out.append('')
+
+    total = 0
+    index = []
+
+    for n, (url, full) in enumerate(files):
+        with open(full, 'rb') as f:
+            data = f.read()
+
+        rt = response_type(url)
+        flags = 0 if args.no_cache else PACK_CACHEABLE
+
+        if args.gzip and rt in TEXT_TYPES:
+            packed = gzip.compress(data, compresslevel=9, mtime=0)
+            if len(packed) < len(data):
+                data = packed
+                flags |= PACK_GZIP
+
+        path_name = '%s_path%d' % (args.name, n)
+        data_name = '%s_data%d' % (args.name, n)
+
+        out.append('//  %s' % url)
+        out.append('const char %s[] PROGMEM = %s;' % (path_name, c_string(url)))
+        out.append('const uint8_t %s[] PROGMEM =\n{\n%s\n};' %
+                   (data_name, c_bytes(data) if data else '\t0'))
+        out.append('')
+
+        index.append('\t{%s, %s, %dUL, 0x%08xUL, %d, 0x%02x},' %
+                     (path_name, data_name, len(data), zlib.crc32(data), rt, flags))
+        total += len(data)
+
+    out.append('//  Sorted by path, ignoring case.')
+    out.append('const YaawsFlashFile %sFiles[] PROGMEM =\n{' % args.name)
+    out.extend(index)
+    out.append('};')
+    out.append('')
+    out.append('constexpr size_t %sFileCount = %d;' % (args.name, len(files)))
+
+    with open(args.header, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+    print('%d files, %d bytes of flash' % (len(files), total))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+#
+#  MIT License
+#
+#  Copyright(c) 2019 M Hotchin
+#
+#  Reports how much flash and static RAM YAAWS takes in each configuration, by building
+#  an example sketch with 'arduino-cli' once per set of YAAWS_* options.  Static RAM does
+#  not include the stack; build with YAAWS_STACK_USAGE and see 'PrintStackUsage' for that.
+#
+#  usage: yaaws_footprint.py [--fqbn arduino:avr:mega] [--sketch examples/BasicWebServer]
+#                            [--config "-DYAAWS_X -DYAAWS_Y" ...]
+#
+#  With no --config, a standard list is built.  Results are printed as JSON.
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+CONFIGS = [
+    '',
+    '-DYAAWS_LEAN_AND_MEAN',
+    '-DYAAWS_ONE_STREAM_ONLY',
+    '-DYAAWS_MAX_CLIENTS=8',
+    '-DYAAWS_OVERLOAD_REJECT',
+    '-DYAAWS_AUTOINDEX',
+    '-DYAAWS_PACKED_SITE',
+    '-DYAAWS_FLASH_SITE',
+    '-DYAAWS_STATISTICS',
+    '-DYAAWS_SCHEDULER=1',
+    '-DYAAWS_SCHEDULER=2',
+    '-DYAAWS_SD_PREFETCH',
+    '-DYAAWS_WRITE_COMBINING',
+    '-DYAAWS_CONTEXT_SIZE=8',
+    '-DYAAWS_STACK_USAGE',
+]
+
+FLASH_RE = re.compile(r'Sketch uses (\d+) bytes')
+RAM_RE = re.compile(r'Global variables use (\d+) bytes')
+
+
+def build(args, config, build_dir):
+    command = ['arduino-cli', 'compile', '--fqbn', args.fqbn,
+               '--library', args.library, '--build-path', build_dir,
+               '--build-property', 'compiler.cpp.extra_flags=' + config,
+               args.sketch]
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                            universal_newlines=True)
+    flash = FLASH_RE.search(result.stdout)
+    ram = RAM_RE.search(result.stdout)
+
+    if result.returncode != 0 or not flash:
+        return {'config': config, 'error': result.stdout.strip().splitlines()[-1:]}
+
+    return {'config': config,
+            'flash': int(flash.group(1)),
+            'ram': int(ram.group(1)) if ram else None}
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    root = os.path.dirname(here)
+
+    parser = argparse.ArgumentParser(description='Report YAAWS flash and RAM use.')
+    parser.add_argument('--fqbn', default='arduino:avr:mega')
+    parser.add_argument('--sketch', default=os.path.join(root, 'examples', 'BasicWebServer'))
+    parser.add_argument('--library', default=root, help='YAAWS library directory')
+    parser.add_argument('--config', action='append',
+                        help='compiler flags for one configuration, may be repeated')
+    args = parser.parse_args()
+
+    results = []
+    for config in (args.config if args.config else CONFIGS):
+        with tempfile.TemporaryDirectory() as build_dir:
+            result = build(args, config, build_dir)
+        print(result, file=sys.stderr)
+        results.append(result)
+
+    #  Each configuration as a difference from the first one (the default, normally).
+    base = results[0] if results and 'flash' in results[0] else None
+    if base:
+        for result in results[1:]:
+            if 'flash' in result:
+                result['flash_delta'] = result['flash'] - base['flash']
+                if result['ram'] is not None and base['ram'] is not None:
+                    result['ram_delta'] = result['ram'] - base['ram']
+
+    print(json.dumps({'fqbn': args.fqbn, 'sketch': args.sketch, 'builds': results},
+                     indent=2))
+
+
+if __name__ == '__main__':
+    main()
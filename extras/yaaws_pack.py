@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+#
+#  MIT License
+#
+#  Copyright(c) 2019 M Hotchin
+#
+#  Builds a packed site archive for YAAWS (see YAAWS_PACKED_SITE in YAAWS.h) from a
+#  directory on your PC.  Copy the result to the root of the SD card as 'SITE.PAK'
+#  (or whatever YAAWS_PACKED_SITE_FILE says).  Copying it to a freshly formatted card
+#  keeps it contiguous, which keeps seeks cheap.
+#
+#  usage: yaaws_pack.py [--gzip] [--no-cache] <site directory> <archive>
+#
+#  With --gzip, files stored gzip'd are only sent to clients that send
+#  'Accept-Encoding: gzip'.  Other clients get a plain copy from the SD card web root if
+#  there is one, otherwise 406 Not Acceptable.
+#
+#  The layout must match the PackHeader / PackEntry structures in YAAWS.h.
+
+import argparse
+import gzip
+import os
+import struct
+import sys
+import zlib
+
+MAGIC = b'YAWP'
+VERSION = 1
+
+PACK_GZIP = 0x01
+PACK_CACHEABLE = 0x02
+
+#  Same values as YaawsBase::ResponseType in YAAWS.h.
+RESPONSE_TYPES = {
+    'htm': 1, 'html': 1,
+    'jpg': 2, 'jpeg': 2,
+    'gif': 3,
+    'png': 4,
+    'bmp': 5,
+    'ico': 6,
+    'svg': 7,
+    'txt': 8, 'log': 8,
+    'js': 9,
+    'css': 10,
+    'csv': 11,
+    'eot': 12,
+    'woff': 13,
+    'woff2': 14,
+    'ttf': 15,
+    'json': 16,
+}
+DEFAULT_TYPE = 17
+
+#  Types worth compressing.  Images and fonts are compressed already.
+TEXT_TYPES = {1, 7, 8, 9, 10, 11, 16}
+
+
+def path_hash(path):
+    """FNV-1a of the path, ignoring (ASCII) case.  Never 0."""
+    h = 2166136261
+    for b in path.encode('utf-8'):
+        h ^= b + 32 if 65 <= b <= 90 else b
+        h = (h * 16777619) & 0xFFFFFFFF
+    return h or 1
+
+
+def response_type(path):
+    ext = os.path.splitext(path)[1][1:].lower()
+    return RESPONSE_TYPES.get(ext, DEFAULT_TYPE)
+
+
+def collect(root):
+    files = []
+    for dirpath, dirnames, filenames in os.walk(root):
+        dirnames.sort()
+        for name in sorted(filenames):
+            full = os.path.join(dirpath, name)
+            url = '/' + os.path.relpath(full, root).replace(os.sep, '/')
+            files.append((url, full))
+    return files
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Build a YAAWS packed site archive.')
+    parser.add_argument('--gzip', action='store_true',
+                        help='store text files gzip\'d, when that makes them smaller')
+    parser.add_argument('--no-cache', action='store_true',
+                        help='do not mark files as cacheable by clients')
+    parser.add_argument('site', help='directory holding the web site')
+    parser.add_argument('archive', help='archive file to write')
+    args = parser.parse_args()
+
+    files = collect(args.site)
+
+    buckets = 1
+    while buckets < 2 * len(files):
+        buckets *= 2
+
+    header_size = 16
+    entry_size = 20
+    table = [None] * buckets
+    blobs = []
+    offset = header_size + buckets * entry_size
+
+    for url, full in files:
+        encoded = url.encode('utf-8')
+        if len(encoded) > 255:
+            sys.exit('Path too long: ' + url)
+
+        with open(full, 'rb') as f:
+            data = f.read()
+
+        rt = response_type(url)
+        flags = 0 if args.no_cache else PACK_CACHEABLE
+
+        if args.gzip and rt in TEXT_TYPES:
+            packed = gzip.compress(data, compresslevel=9, mtime=0)
+            if len(packed) < len(data):
+                data = packed
+                flags |= PACK_GZIP
+
+        h = path_hash(url)
+        offset += len(encoded)
+        entry = struct.pack('<IIIIBBBB', h, offset, len(data), zlib.crc32(data),
+                            len(encoded), rt, flags, 0)
+
+        bucket = h & (buckets - 1)
+        while table[bucket] is not None:
+            bucket = (bucket + 1) & (buckets - 1)
+        table[bucket] = entry
+
+        blobs.append(encoded)
+        blobs.append(data)
+        offset += len(data)
+
+    with open(args.archive, 'wb') as out:
+        out.write(struct.pack('<4sHHII', MAGIC, VERSION, 0, buckets, len(files)))
+        for entry in table:
+            out.write(entry if entry is not None else bytes(entry_size))
+        for blob in blobs:
+            out.write(blob)
+
+    print('%d files, %d bytes' % (len(files), offset))
+
+
+if __name__ == '__main__':
+    main()
@@ -21,59 +21,59 @@
 //
 
 #include <Arduino.h>
+#ifndef YAAWS_SERVER_TYPE
 #include <Ethernet.h>
+#endif
+#ifndef YAAWS_FILESYSTEM_TYPE
 #include <SdFat.h>
-#include <alloca.h>
+#endif
 
+#define YAAWS_IMPLEMENTATION
 #include "YAAWS.h"
 
+#ifdef __AVR__
 extern int __heap_start, *__brkval;
-namespace
-{
-	int freeRam()
-	{
-
-		int v;
-		return (int)&v - (__brkval == 0 ? (int)&__heap_start : (int)__brkval);
-	}
+#endif
+#if defined(YAAWS_STACK_USAGE) && !defined(__AVR__)
+extern "C" char *sbrk(int incr);
+#endif
 
-#ifndef YAAWS_HUSH_NOW
-#define TRACE(X) Serial.print(millis()),Serial.print(F("  ")),Serial.println(X)
-#define IF_TRACE(X) (X)
-	void quotedTrace(const char *p)
-	{
-		Serial.print(F("\""));
-		Serial.print(p);
-		Serial.println(F("\""));
-	}
-#else
-#define TRACE(X) (void)0
-#define IF_TRACE(X) (void)0
+//  What every kind of server shares, whatever its transport, file system and config.  The
+//  members of BasicYaaws itself are in YaawsImpl.h.
 
-#define quotedTrace(x) (void)0;
+#ifdef __AVR__
+int YaawsBase::freeRam()
+{
 
+	int v;
+	return (int)&v - (__brkval == 0 ? (int)&__heap_start : (int)__brkval);
+}
+#else
+//  Other cores have far more stack than we will ever ask for.
+int YaawsBase::freeRam()
+{
+	return 0x7FFF;
+}
 #endif
-	class FlashyFlashy
-	{
-	public:
-#ifndef YAAWS_NO_FLASHY_FLASHY
-		FlashyFlashy();
-		~FlashyFlashy();
-#endif
-	};
 
-#ifndef YAAWS_NO_FLASHY_FLASHY
-	FlashyFlashy::FlashyFlashy()
-	{
-		digitalWrite(LED_BUILTIN, HIGH);
-	}
+#ifdef YAAWS_STACK_USAGE
+constexpr byte YaawsBase::stackPaint;
+constexpr uint16_t YaawsBase::stackMargin;
+constexpr byte YaawsBase::stackRun;
 
-	FlashyFlashy::~FlashyFlashy()
-	{
-		digitalWrite(LED_BUILTIN, LOW);
-	}
+//  Lowest address the stack may grow to.
+byte *YaawsBase::StackBottom()
+{
+#ifdef __AVR__
+	return (byte *)(__brkval == 0 ? (int)&__heap_start : (int)__brkval);
+#else
+	return (byte *)sbrk(0);
+#endif
+}
 #endif
 
+namespace
+{
 	// URl decoder, taken from
 	// https://stackoverflow.com/questions/2673207/c-c-url-decode-library/19826808
 	// License is CC-BY-SA https://creativecommons.org/licenses/by-sa/4.0/
@@ -123,58 +123,38 @@ namespace
 	}
 }
 
-//  Number of items in an array
-#define COUNTOF(x) (sizeof(x)/sizeof(x[0]))
-
-//  Default implementation accepts all inputs as valid.
-bool YaawsCallback::ProcessFormData(
-	const char *path, char *formData)
+void YaawsBase::urldecode2(char *srcdst)
 {
-	return true;
+	return ::urldecode2(srcdst);
 }
 
+#if YAAWS_SCHEDULER != YAAWS_SCHEDULE_ROUND_ROBIN
+constexpr byte YaawsBase::MAX_PRIORITY;
+#endif
 
-#ifndef YAAWS_GET_IS_ALL_WE_NEED
+#ifdef YAAWS_BODY_SOURCES
+constexpr byte YaawsBase::bodyGzip;
+constexpr byte YaawsBase::bodyCacheable;
+#endif
 
-//  Default implementation just passes the POST data as a URL query string to the GET
-//  handler.
-bool YaawsCallback::ProcessPostData(
-	const char *path,
-	EthernetClient &client,
-	unsigned long contentLength)
+#ifdef YAAWS_STATISTICS
+//  Histogram bucket for a value - the number of bits needed to hold it.
+byte YaawsBase::HistogramBucket(unsigned long value)
 {
-	constexpr size_t bufferSize = 128;
-	char buffer[bufferSize + 1];
+	byte bucket = 0;
 
-	if (contentLength > bufferSize)
+	while ((value != 0) && (bucket < 15))
 	{
-		return false;
+		value >>= 1;
+		bucket++;
 	}
 
-	auto amountRead = client.readBytes(buffer, bufferSize);
-
-	buffer[amountRead] = '\0';
-
-	return ProcessFormData(path, buffer);
+	return bucket;
 }
 #endif
 
-#ifndef YAAWS_NOTHING_EVER_CHANGES
-bool YaawsCallback::IsMutable(
-	const char *)
-{
-	return false;
-}
 
-
-bool YaawsCallback::FileAction(
-	EthernetClient &, WebFileType &)
-{
-	return false;
-}
-#endif
-
-char *YaawsCallback::getNextQueryPair(
+char *YaawsCallbackBase::getNextQueryPair(
 	char *queryString,
 	queryPair &nameValuePair)
 {
@@ -215,65 +195,160 @@ char *YaawsCallback::getNextQueryPair(
 	return retVal;
 }
 
-void YaawsCallback::urlDecode(
-	char *encodedString)
+//  Converts and stores one value.  Returns false if the value is bad.
+bool YaawsCallbackBase::bindField(
+	const formField &field,
+	const char *value)
 {
-	urldecode2(encodedString);
+	char *end;
+
+	switch (field.type)
+	{
+	case fieldInt:
+	case fieldLong:
+	{
+		if ((value == nullptr) || (*value == '\0'))
+		{
+			return false;
+		}
+
+		long number = strtol(value, &end, 10);
+
+		if ((*end != '\0') || (number < field.min) || (number > field.max))
+		{
+			return false;
+		}
+
+		if (field.type == fieldInt)
+		{
+			*static_cast<int *>(field.dest) = (int)number;
+		}
+		else
+		{
+			*static_cast<long *>(field.dest) = number;
+		}
+		return true;
+	}
+
+	case fieldFloat:
+	{
+		if ((value == nullptr) || (*value == '\0'))
+		{
+			return false;
+		}
+
+		double number = strtod(value, &end);
+
+		if ((*end != '\0') || (number < field.min) || (number > field.max))
+		{
+			return false;
+		}
+
+		*static_cast<float *>(field.dest) = (float)number;
+		return true;
+	}
+
+	case fieldBool:
+		*static_cast<bool *>(field.dest) =
+			(value == nullptr) ||
+			((strcmp_P(value, PSTR("0")) != 0) &&
+			 (strcasecmp_P(value, PSTR("off")) != 0) &&
+			 (strcasecmp_P(value, PSTR("false")) != 0));
+		return true;
+
+	case fieldString:
+	{
+		size_t length = (value != nullptr) ? strlen(value) : 0;
+
+		if ((length < (size_t)field.min) || (length >= (size_t)field.max))
+		{
+			return false;
+		}
+
+		memcpy(field.dest, (value != nullptr) ? value : "", length + 1);
+		return true;
+	}
+	}
+
+	return false;
 }
 
-YaawsCallback defaultCallback;
 
-//  All the different HTML 'Content-types' supported.
-//
-enum YAAWS::ResponseType : byte
+YaawsCallbackBase::formResult YaawsCallbackBase::bindFormFields(
+	char *queryString,
+	const formField *fields,
+	byte count)
 {
-	htm404,
-	htm200,
-	jpg200,
-	gif200,
-	png200,
-	bmp200,
-	ico200,
-	svg200,
-	txt200,
-	js200,
-	css200,
-	csv200,
-	eot200,
-	woff200,
-	woff2200,
-	ttf200,
-	default200,  //  Everything else
-	UNKNOWN,     //  Response type not yet identified
-	FINISHED     //  Response has been sent
+	formResult result = {0, 0};
+	queryPair nameValuePair;
 
-};
+	count = min(count, (byte)32);
 
+	while (queryString != nullptr)
+	{
+		queryString = getNextQueryPair(queryString, nameValuePair);
 
-namespace
+		if (nameValuePair._name == nullptr)
+		{
+			continue;
+		}
+
+		for (byte n = 0; n < count; n++)
+		{
+			formField field;
+
+			memcpy_P(&field, fields + n, sizeof(field));
+
+			if (strcmp_P(nameValuePair._name, field.name) == 0)
+			{
+				const uint32_t bit = 1UL << n;
+
+				result.found |= bit;
+
+				if (!bindField(field, nameValuePair._value))
+				{
+					result.invalid |= bit;
+				}
+
+				break;
+			}
+		}
+	}
+
+	return result;
+}
+
+
+void YaawsCallbackBase::urlDecode(
+	char *encodedString)
 {
-	//  Text for all the different HTML Response headers. Except for 404, all the rest
-	//  differ only by the value of the 'Content-Type' directive.
-	const char str200Header[] PROGMEM =
-		"HTTP/1.0 200 OK\n"
-		"Server: YAAWS/1.0\n"
-		"Connection: close\n"
-		"Content-Type: ";
+	urldecode2(encodedString);
+}
+
+//  Text for all the different HTML Response headers. Except for 404, all the rest differ
+//  only by the value of the 'Content-Type' directive.
+const char YaawsBase::str200Header[] PROGMEM =
+	"HTTP/1.0 200 OK\n"
+	"Server: YAAWS/1.0\n"
+	"Connection: close\n"
+	"Content-Type: ";
+
+//  Read-only files are marked cachable.
+const char YaawsBase::strCacheable[] PROGMEM =
+	"Cache-Control: public, max-age=604800\n";
 
+//  If not read-only, the files are not cachable.  If you update these files, the client
+//  will always get the latest version.
+const char YaawsBase::strNonCacheable[] PROGMEM =
+	"Cache-Control: no-cache, no-store, must-revalidate\n";
+
+namespace
+{
 	const char str404[] PROGMEM =
 		"HTTP/1.0 404 Not Found\n"
 		"Content-Type: text/html\n"
 		"Connection: close\n\n";
 
-	//  Read-only files are marked cachable.
-	const char strCacheable[] PROGMEM =
-		"Cache-Control: public, max-age=604800\n";
-
-	//  If not read-only, the files are not cachable.  If you update these files, the
-	//  client will always get the latest version.
-	const char strNonCacheable[] PROGMEM =
-		"Cache-Control: no-cache, no-store, must-revalidate\n";
-
 	const char strHtm200[] PROGMEM = "text/html";
 	const char strJpg200[] PROGMEM = "image/jpeg";
 	const char strGif200[] PROGMEM = "image/gif";
@@ -289,32 +364,10 @@ namespace
 	const char strWoff200[] PROGMEM = "font/woff";
 	const char strWoff2200[] PROGMEM = "font/woff2";
 	const char strTtf200[] PROGMEM = "font/ttf";
+	const char strJson200[] PROGMEM = "application/json";
 	const char strDefault200[] PROGMEM = "application/octet-stream";
 
 
-	//  Same order as ResponseType, above
-	const char *const aResponses[] PROGMEM =
-	{
-		str404,
-		strHtm200,
-		strJpg200,
-		strGif200,
-		strPng200,
-		strBmp200,
-		strIco200,
-		strSvg200,
-		strTxt200,
-		strJs200,
-		strCss200,
-		strCsv200,
-		strEot200,
-		strWoff200,
-		strWoff2200,
-		strTtf200,
-		strDefault200
-	};
-
-
 	//  The diferent types of file extensions supported....
 #define DECLARE_EXT(x) const char ext##x[] PROGMEM = #x;
 	DECLARE_EXT(HTM);
@@ -335,98 +388,68 @@ namespace
 	DECLARE_EXT(WOFF); //  Web Fonts
 	DECLARE_EXT(WOFF2); // Web Fonts
 	DECLARE_EXT(TTF);
+	DECLARE_EXT(JSON);
 
 	struct ExtensionResponseType
 	{
 		const char *strExt;
-		YAAWS::ResponseType rt;
+		YaawsBase::ResponseType rt;
 	};
 
 	// ...and the response type for each one.
 	const ExtensionResponseType ext2rt[] PROGMEM =
 	{
-		{extHTM, YAAWS::htm200},
-	{extHTML, YAAWS::htm200},
-	{extJPG, YAAWS::jpg200},
-	{extJPEG, YAAWS::jpg200},
-	{extGIF, YAAWS::gif200},
-	{extPNG, YAAWS::png200},
-	{extICO, YAAWS::ico200},
-	{extBMP, YAAWS::bmp200},
-	{extSVG, YAAWS::svg200},
-	{extTXT, YAAWS::txt200},
-	{extLOG, YAAWS::txt200},
-	{extJS, YAAWS::js200},
-	{extJPG, YAAWS::js200},
-	{extCSS, YAAWS::css200},
-	{extCSV, YAAWS::csv200},
-	{extEOT, YAAWS::eot200},
-	{extWOFF, YAAWS::woff200},
-	{extWOFF2, YAAWS::woff2200},
-	{extTTF, YAAWS::ttf200}
+		{extHTM, YaawsBase::htm200},
+	{extHTML, YaawsBase::htm200},
+	{extJPG, YaawsBase::jpg200},
+	{extJPEG, YaawsBase::jpg200},
+	{extGIF, YaawsBase::gif200},
+	{extPNG, YaawsBase::png200},
+	{extICO, YaawsBase::ico200},
+	{extBMP, YaawsBase::bmp200},
+	{extSVG, YaawsBase::svg200},
+	{extTXT, YaawsBase::txt200},
+	{extLOG, YaawsBase::txt200},
+	{extJS, YaawsBase::js200},
+	{extJPG, YaawsBase::js200},
+	{extCSS, YaawsBase::css200},
+	{extCSV, YaawsBase::csv200},
+	{extEOT, YaawsBase::eot200},
+	{extWOFF, YaawsBase::woff200},
+	{extWOFF2, YaawsBase::woff2200},
+	{extTTF, YaawsBase::ttf200},
+	{extJSON, YaawsBase::json200}
 	};
 
 	constexpr size_t NumExtensions = COUNTOF(ext2rt);
 }
 
-
-
-YAAWS::YAAWS(
-	webSdCard &SdCard,
-	YaawsCallback &callback,
-	const char *webRoot,
-	uint16_t port)
-	: _server(port), _SdCard(SdCard), _callback(callback), _webRoot(webRoot),
-	_activeConnections(0)
-
+//  Same order as ResponseType, in YAAWS.h
+const char *const YaawsBase::aResponses[] PROGMEM =
 {
-#ifndef YAAWS_ONE_STREAM_ONLY
-	_serviceIndex = 0;
-#endif
-}
-
-
-
-
-YAAWS::YAAWS(
-	webSdCard &SdCard,
-	const char *webRoot,
-	uint16_t port)
-	: _server(port), _SdCard(SdCard), _callback(defaultCallback), _webRoot(webRoot),
-	_activeConnections(0)
-{
-#ifndef YAAWS_ONE_STREAM_ONLY
-	_serviceIndex = 0;
-#endif
-}
-
-
-
-
-//  If this returns false, your webserver won't be working.  Check that your ethernet and
-//  SD Card are working.
-bool YAAWS::begin(void)
-{
-#ifndef YAAWS_NO_FLASHY_FLASHY
-	pinMode(LED_BUILTIN, OUTPUT);
-	digitalWrite(LED_BUILTIN, LOW);
-#endif
-
-	_server.begin();
-
-	if ((bool)_server)
-	{
-		TRACE(F("YAAWS is listening"));
-	}
-
-	return ((bool)_server && (Ethernet.hardwareStatus() != EthernetNoHardware) &&
-		(_SdCard.volumeBlockCount() > 0));
-
+	str404,
+	strHtm200,
+	strJpg200,
+	strGif200,
+	strPng200,
+	strBmp200,
+	strIco200,
+	strSvg200,
+	strTxt200,
+	strJs200,
+	strCss200,
+	strCsv200,
+	strEot200,
+	strWoff200,
+	strWoff2200,
+	strTtf200,
+	strJson200,
+	strDefault200
+};
 
-}
 
 //  Check the filename and return the extension type.
-YAAWS::ResponseType YAAWS::GetResponseType(const char *fileName)
+YaawsBase::ResponseType YaawsBase::GetResponseType(const char *fileName)
 {
 	// Find start of filename, then the extension if it exists
 	const char *nameStart = strrchr(fileName, '/');
@@ -455,292 +478,212 @@ YAAWS::ResponseType YAAWS::GetResponseType(const char *fileName)
 
 	TRACE(F("Using default file type!"));
 
-	return YAAWS::default200;
+	return default200;
 }
 
 
-
-//  Send the first part of the response - the HTML Response Header.  The 'Content-Type'
-//  directive is determined by the file's extension.
-void YAAWS::SendResponseHeader()
+#ifdef YAAWS_GZIP_STREAM
+//  Content types worth compressing.
+bool YaawsBase::IsText(ResponseType rt)
 {
-	TRACE(F("SendResponseHeader"));
-	constexpr size_t buffSize = 256;
-	char buffer[buffSize + 1] = {0};
-	ContinuationData &contData = _contData[_serviceIndex];
-
-
-	//  404 is one piece, all others are made up of three pieces.
-	if (contData.rt != htm404)
+	switch (rt)
 	{
-		strncpy_P(buffer, str200Header, buffSize);
-	}
+	case htm200:
+	case svg200:
+	case txt200:
+	case js200:
+	case css200:
+	case csv200:
+	case json200:
+		return true;
 
-	strncat_P(buffer, pgm_read_ptr(&aResponses[contData.rt]), buffSize);
+	default:
+		return false;
+	}
+}
+#endif
 
-	if (contData.rt != htm404)
-	{
-		strncat_P(buffer, PSTR("\n"), buffSize);
 
-		bool isCacheable = contData.sdFile.isReadOnly();
+#if defined(YAAWS_PACKED_SITE) || defined(YAAWS_PATH_CACHE)
+//  FNV-1a hash of a path, ignoring case (FAT doesn't care either).  Never 0.
+uint32_t YaawsBase::PathHash(const char *path, size_t length)
+{
+	uint32_t hash = 2166136261UL;
 
-		if (isCacheable)
-		{
-			strncat_P(buffer, strCacheable, buffSize);
-		}
-		else
-		{
-			strncat_P(buffer, strNonCacheable, buffSize);
-		}
+	while ((length-- != 0) && (*path != '\0'))
+	{
+		hash ^= (byte)tolower(*path++);
+		hash *= 16777619UL;
+	}
 
-		//  If the file is not mutable, we can provide a Content-length: directive.  Only
-		//  mutable files will have this set at this point.
-#ifndef YAAWS_NOTHING_EVER_CHANGES
-		if (!contData.doFileAction)
+	return hash ? hash : 1;
+}
 #endif
-		{
-			strncat_P(buffer, PSTR("Content-length: "), buffSize);
-			ltoa(_contData[_serviceIndex].sdFile.fileSize(), buffer + strlen(buffer), 10);
-			strncat_P(buffer, PSTR("\n"), buffSize);
-
-			//  TODO - Etag validation not yet implemented.
-		}
 
-		strncat_P(buffer, PSTR("\n"), buffSize);
-	}
-
-	buffer[buffSize] = '\0';
+#ifdef YAAWS_PACKED_SITE
+const char YaawsBase::packMagic[] PROGMEM = {'Y', 'A', 'W', 'P'};
+constexpr uint16_t YaawsBase::packVersion;
+#endif
 
-	FlashyFlashy ff;
-	contData.client.write(buffer);
 
-	return;
+#if defined(YAAWS_AUTOINDEX) || defined(YAAWS_ACCESS_LOG)
+//  Appends a PROGMEM string to 'dst'.  Returns the new end of 'dst'.
+char *YaawsBase::AppendP(char *dst, const char *src)
+{
+	strcpy_P(dst, src);
+	return dst + strlen(dst);
 }
 
-
-//  Clean up our connection once we are done with it, whatever the reason.  Flush the
-//  data, mark the connection as available
-void YAAWS::FinishConnection()
+//  Appends a number of at least 'digits' digits, zero padded.
+char *YaawsBase::AppendNumber(char *dst, unsigned long value, byte digits)
 {
-	ContinuationData &contData = _contData[_serviceIndex];
+	char number[11];
 
-	FlashyFlashy ff;
+	ultoa(value, number, 10);
 
-	if (contData.client.connected())
+	for (byte len = strlen(number); len < digits; len++)
 	{
-		contData.client.flush();
-		contData.client.stop();
-
-		contData.sdFile.close();
+		*dst++ = '0';
 	}
 
-	_activeConnections &= ~(1 << _serviceIndex);
-
-	TRACE(F("Request complete."));
+	strcpy(dst, number);
+	return dst + strlen(dst);
 }
-
-
-//  Send the actual file to the requestor.  Will return before sending the whole file,
-//  called repeatedly to keep things going.
-void YAAWS::SendSdFile()
-{
-	ContinuationData &contData = _contData[_serviceIndex];
-	int amountToWrite = contData.client.availableForWrite();
-
-	if (amountToWrite > 0)
-	{
-		//  Maximum we will write in one go. If we have only one client, use as much of
-		//  the underlying Ethernet frame size as possible.  Otherwise, limit to a
-		//  multiple of the SD sector size to reduce SD card redundant reads. 
-		constexpr int maxBufferSize = (MAX_CLIENTS == 1) ? 1400 : 1024;
-
-		amountToWrite = min(amountToWrite, maxBufferSize);
-
-#ifndef YAAWS_ONE_STREAM_ONLY
-		//  If we want aligned reads, then make sure we are actually aligned.
-		int alignment = (maxBufferSize - (contData.sdFile.curPosition() % 512));
-		amountToWrite = min(amountToWrite, alignment);
 #endif
 
-		//  Leaving 100 bytes seems to work fine.
-		//  TO-DO - Fine tune this somehow?
-		const int stackAvailable = freeRam() - 100;
-		const int sdFileLeft = contData.sdFile.available();
+#ifdef YAAWS_AUTOINDEX
+const char YaawsBase::strListPrologue[] PROGMEM =
+	"<HTML>\n<HEAD>\n<title>Index</title>\n</HEAD>\n<BODY>\n<table>\n"
+	"<tr><th align=\"left\">Name</th><th align=\"right\">Size</th>"
+	"<th>Modified</th></tr>\n";
 
-		amountToWrite = min(amountToWrite, stackAvailable);
-		amountToWrite = min(amountToWrite, sdFileLeft);
+const char YaawsBase::strJsonPrologue[] PROGMEM = "{\"entries\":[";
 
-		if (amountToWrite > 0)
-		{
-			byte *pBuffer = alloca(amountToWrite);
+constexpr size_t YaawsBase::listingLineSize;
 
-			FlashyFlashy ff;
+//  Appends 'src' to 'dst', escaped for HTML text or a JSON string, cut short rather
+//  than go past 'end'.  Returns the new end of 'dst'.
+char *YaawsBase::AppendEscaped(char *dst, const char *end, const char *src, bool json)
+{
+	while ((*src != '\0') && (dst + 6 < end))
+	{
+		char c = *src++;
 
-			amountToWrite = contData.sdFile.read(pBuffer, amountToWrite);
-			contData.client.write(pBuffer, amountToWrite);
+		if (json && ((c == '"') || (c == '\\')))
+		{
+			*dst++ = '\\';
+			*dst++ = c;
+		}
+		else if (!json && (c == '&'))
+		{
+			dst = AppendP(dst, PSTR("&amp;"));
+		}
+		else if (!json && (c == '<'))
+		{
+			dst = AppendP(dst, PSTR("&lt;"));
+		}
+		else if (!json && (c == '"'))
+		{
+			dst = AppendP(dst, PSTR("&#34;"));
 		}
 		else
 		{
-			FinishConnection();
+			*dst++ = c;
 		}
 	}
+
+	*dst = '\0';
+	return dst;
 }
 
-// In general, we don't want Service calls to take *too* long. If a request is waiting,
-// then the first call will receive it, next will send back the response header. After
-// that, each call will transmit part of the response file.
-void YAAWS::ContinueRequest(void)
+//  Appends 'src' to 'dst', percent-encoded for a URL.  Anything but letters, digits
+//  and '-._~' is encoded, so it also needs no escaping in an HTML attribute.
+//  Returns the new end of 'dst'.
+char *YaawsBase::AppendUrlEncoded(char *dst, const char *end, const char *src)
 {
-	ContinuationData &contData = _contData[_serviceIndex];
-
-	if (contData.rt != FINISHED)
-	{
-		SendResponseHeader();
-		contData.rt = FINISHED;
-	}
-#ifndef YAAWS_NOTHING_EVER_CHANGES
-	else if (contData.doFileAction)
-	{
-		contData.doFileAction =
-			_callback.FileAction(contData.client, contData.sdFile);
-	}
-#endif
-	else
+	while ((*src != '\0') && (dst + 3 < end))
 	{
-		SendSdFile();
+		byte c = *src++;
 
-		if (contData.sdFile.available() == 0)
+		if (isalnum(c) || (c == '-') || (c == '.') || (c == '_') || (c == '~'))
+		{
+			*dst++ = c;
+		}
+		else
 		{
-			IF_TRACE(Serial.println(F("SendSdFile() completed")));
-			FinishConnection();
+			*dst++ = '%';
+			*dst++ = "0123456789ABCDEF"[c >> 4];
+			*dst++ = "0123456789ABCDEF"[c & 0x0F];
 		}
 	}
 
-	return;
+	*dst = '\0';
+	return dst;
 }
 
-
-//  Uses 'filename' as a caller provided buffer for building the filename.  Reduces max
-//  stack usage by re-using already allocated space.  We'll just assume things fit.
-void YAAWS::Return404(char *fileName)
+//  FAT date and time as 'YYYY-MM-DD HH:MM:SS', with a 'T' in the middle for JSON.
+char *YaawsBase::AppendFatTime(char *dst, uint16_t date, uint16_t time, bool json)
 {
-	TRACE(F("404!"));
-	strcpy_P(fileName, GetWebRoot());
-
-	strcat_P(fileName, PSTR("/404.html"));
+	dst = AppendNumber(dst, FAT_YEAR(date), 4);
+	*dst++ = '-';
+	dst = AppendNumber(dst, FAT_MONTH(date), 2);
+	*dst++ = '-';
+	dst = AppendNumber(dst, FAT_DAY(date), 2);
+	*dst++ = json ? 'T' : ' ';
+	dst = AppendNumber(dst, FAT_HOUR(time), 2);
+	*dst++ = ':';
+	dst = AppendNumber(dst, FAT_MINUTE(time), 2);
+	*dst++ = ':';
+	return AppendNumber(dst, FAT_SECOND(time), 2);
+}
+#endif
 
-	ContinuationData &contData = _contData[_serviceIndex];
+#ifdef YAAWS_CSV_INDEX
+const char YaawsBase::csvIndexMagic[] PROGMEM = "YCI1";
 
-	contData.sdFile.open(fileName, O_READ);
-	contData.rt = htm404;
+//  Number at the start of a row.
+uint32_t YaawsBase::RowTime(const byte *row, size_t length)
+{
+	uint32_t time = 0;
 
-	//  If there is no custom 404 file, send a canned response.
-	if (!contData.sdFile.isOpen())
+	for (size_t i = 0; (i < length) && isdigit(row[i]); i++)
 	{
-		FlashyFlashy ff;
-
-		contData.client.print(F(
-			"HTTP/1.0 404 Not Found\n"
-			"Content-Type: text/html\n"
-			"Connection: close\n\n"
-			"<HTML>\n"
-			"<HEAD>\n"
-			"<title>Page Not Found</title>\n"
-			"</HEAD>\n"
-			"<BODY>\n"
-			"<h1>Error 404</h1>\n"
-			"<br>Page Not Found\n"
-			"</BODY>\n"
-			"</HTML>\n\n"));
-
-		FinishConnection();
+		time = time * 10 + (row[i] - '0');
 	}
 
-	//  Normal file processing will send the 404 file back to the client.
-}
-
-#ifndef YAAWS_404_THE_ONE_TRUE_ERROR
-void YAAWS::Return400BadRequest()
-{
-	FlashyFlashy ff;
-
-	_contData[_serviceIndex].client.print(F(
-		"HTTP/1.0 400 Bad Request\n"
-		"Content-Type: text/html\n"
-		"Connection: close\n\n"
-		"<HTML>\n"
-		"<HEAD>\n"
-		"<title>Bad Request</title>\n"
-		"</HEAD>\n"
-		"<BODY>\n"
-		"<h1>Error 400</h1>\n"
-		"<br>The Request is malformed.\n"
-		"</BODY>\n"
-		"</HTML>\n\n"));
-
-	FinishConnection();
+	return time;
 }
+#endif
 
+#ifdef YAAWS_OVERLOAD_REJECT
+#define YAAWS_STR(x) #x
+#define YAAWS_XSTR(x) YAAWS_STR(x)
 
-void YAAWS::Return405MethodNotAllowed()
+namespace
 {
-	FlashyFlashy ff;
-
-	_contData[_serviceIndex].client.print(F(
-		"HTTP/1.0 405 Method Not Allowed\n"
+	const char str503[] PROGMEM =
+		"HTTP/1.0 503 Service Unavailable\n"
+		"Retry-After: " YAAWS_XSTR(YAAWS_RETRY_AFTER_SECONDS) "\n"
 		"Content-Type: text/html\n"
-#ifndef YAAWS_GET_IS_ALL_WE_NEED		
-		"Allow: GET, HEAD, POST\n"
-#else
-		"Allow: GET, HEAD\n"
-#endif
 		"Connection: close\n\n"
-		"<HTML>\n"
-		"<HEAD>\n"
-		"<title>Method Not Allowed</title>\n"
-		"</HEAD>\n"
-		"<BODY>\n"
-		"<h1>Error 405</h1>\n"
-		"<br>The Request Method is invalid for this resource.\n"
-		"</BODY>\n"
-		"</HTML>\n\n"));
-
-	FinishConnection();
+		"<HTML><BODY><h1>Error 503</h1>"
+		"<br>Server busy, try again shortly.</BODY></HTML>\n";
 }
 
-
-void YAAWS::Return414UriTooLong()
+//  Writes the 503 response in one piece (not byte by byte, as 'print' would from PROGMEM)
+//  so it goes out as a single packet.
+void YaawsBase::WriteOverload(Print &client)
 {
-	FlashyFlashy ff;
+	char buffer[sizeof(str503)];
 
-	_contData[_serviceIndex].client.print(F(
-		"HTTP/1.0 414 URI Too Long\n"
-		"Content-Type: text/html\n"
-		"Connection: close\n\n"
-		"<HTML>\n"
-		"<HEAD>\n"
-		"<title>Request Too Long</title>\n"
-		"</HEAD>\n"
-		"<BODY>\n"
-		"<h1>Error 414</h1>\n"
-		"<br>The Request is too long.  Limit is 128 characters\n"
-		"</BODY>\n"
-		"</HTML>\n\n"));
-
-	FinishConnection();
+	memcpy_P(buffer, str503, sizeof(buffer));
+	client.write((const uint8_t *)buffer, sizeof(buffer) - 1);
 }
 #endif
 
+
 namespace
 {
-	enum RequestType
-	{
-		rtGet,
-		rtHead,
-		rtPost,
-		rtUnknown
-	};
-
 	const char strGet[] PROGMEM = "GET /";
 	const char strHead[] PROGMEM = "HEAD /";
 #ifndef YAAWS_GET_IS_ALL_WE_NEED
@@ -748,475 +691,546 @@ namespace
 #endif
 	struct Request
 	{
-		RequestType rt;
+		YaawsBase::RequestType rt;
 		const char *rs;
 	};
 
 	const Request aRequests[] PROGMEM =
 	{
-		{rtGet, strGet},
-	{rtHead, strHead},
+		{YaawsBase::rtGet, strGet},
+	{YaawsBase::rtHead, strHead},
 #ifndef YAAWS_GET_IS_ALL_WE_NEED
-	{rtPost, strPost},
+	{YaawsBase::rtPost, strPost},
 #endif
 	};
+}
 
 
-	//  Figure out the request type and move the URI down.
-	RequestType GetRequestType(char *str)
-	{
-		IF_TRACE(Serial.println(str));
+//  Figure out the request type and move the URI down.
+YaawsBase::RequestType YaawsBase::GetRequestType(char *str)
+{
+	IF_TRACE(Serial.println(str));
 
-		RequestType rt = rtUnknown;
+	RequestType rt = rtUnknown;
 
-		for (size_t i = 0; i < COUNTOF(aRequests); i++)
-		{
-			//  Get the request type data from PROGMEM...
-			Request r;
+	for (size_t i = 0; i < COUNTOF(aRequests); i++)
+	{
+		//  Get the request type data from PROGMEM...
+		Request r;
 
-			memcpy_P(&r, &aRequests[i], sizeof(r));
+		memcpy_P(&r, &aRequests[i], sizeof(r));
 
-			size_t len = strlen_P(r.rs);
+		size_t len = strlen_P(r.rs);
 
-			// ... and see if it matches.
-			if (memcmp_P(str, r.rs, len) == 0)
-			{
-				rt = r.rt;
-				char *filename = str + len - 1;
+		// ... and see if it matches.
+		if (memcmp_P(str, r.rs, len) == 0)
+		{
+			rt = r.rt;
+			char *filename = str + len - 1;
 
-				memmove(str, filename, strlen(filename) + 1);
+			memmove(str, filename, strlen(filename) + 1);
 
-				break;
-			}
+			break;
 		}
-
-		//  Do nothing for unknown request types
-		return rt;
 	}
 
-	const char contentLengthMarker[] PROGMEM = "content-length: ";
+	//  Do nothing for unknown request types
+	return rt;
 }
 
+#ifndef YAAWS_GET_IS_ALL_WE_NEED
+const char YaawsBase::contentLengthMarker[] PROGMEM = "content-length: ";
+#ifdef YAAWS_ACCEPT_ENCODING
+const char YaawsBase::acceptEncodingMarker[] PROGMEM = "accept-encoding:";
+#endif
 
-
-
-//  Initial processing of any request:
-//   - Read the request from the client.
-//   - Validate request type
-//   - Validate file to return
-//   - Process any form data
-void YAAWS::AcceptIncoming()
+//  Keep track of how far into 'marker' (lower case, in PROGMEM) we've matched, given
+//  the next (lower case) character.  True once the whole marker has been seen.
+bool YaawsBase::MatchMarker(const char *marker, const char *&pMatch, byte l)
 {
-	// TO-DO - better buffer size for this?
-	constexpr size_t buffSize = 128;
-	char inputFileName[buffSize + 1] = {0};
+	if (l == pgm_read_byte(pMatch))
+	{
+		pMatch++;
 
-	inputFileName[buffSize] = '\0';
+		return pgm_read_byte(pMatch) == '\0';
+	}
 
-	ContinuationData &contData = _contData[_serviceIndex];
+	//  No match, start over...
+	pMatch = marker;
 
-	//  Well isn't THAT special.  I'm seeing cases where the connection does not arrive
-	//  with the payload.  If you wait long enough, it seems to show up.  Up to 30 ms
-	//  seems possible.
-	if ((contData.rt == UNKNOWN) && !contData.client.available())
+	//  ... but see if we've started a new match with this character
+	if (l == pgm_read_byte(pMatch))
 	{
-		//  There's no timeout on this - we will wait as long as the connection is held
-		//  open.
-		TRACE(F("Awaiting incoming payload"));
-		return;
+		pMatch++;
 	}
 
-	//  Start building the filename to be returned.
-	strcpy_P(inputFileName, GetWebRoot());
+	return false;
+}
+#endif
 
-	size_t inputOffset = strlen(inputFileName);
-	char *pRequestStart = inputFileName + inputOffset;
+#if defined(YAAWS_AUTOINDEX) || defined(YAAWS_LOG_TAIL) || defined(YAAWS_CSV_INDEX)
+//  Value of a numeric parameter (name in PROGMEM) in a query string, or
+//  'defaultValue' if it isn't there.  The query string is not changed.
+long YaawsBase::QueryNumber(const char *query, const char *name, long defaultValue)
+{
+	size_t len = strlen_P(name);
 
-	//  Read in incoming request until buffer is full, or no more data, or end of line,
-	//  whatever comes first.
-	while (contData.client.available() && (inputOffset < COUNTOF(inputFileName) - 1))
+	while ((query != nullptr) && (*query != '\0'))
 	{
-		inputFileName[inputOffset] = contData.client.read();
+		if ((strncmp_P(query, name, len) == 0) && (query[len] == '='))
+		{
+			return atol(query + len + 1);
+		}
 
-		if (inputFileName[inputOffset] == '\n')
-			break;
+		query = strchr(query, '&');
 
-		inputOffset++;
+		if (query != nullptr)
+		{
+			query++;
+		}
 	}
 
-	inputFileName[inputOffset + 1] = '\0';
-
-	if (inputFileName[inputOffset] != '\n')
-	{
-		//  If we never saw the line ending then punt
-#ifndef YAAWS_404_THE_ONE_TRUE_ERROR
-		Return414UriTooLong();
-#else
-		Return404(inputFileName);
+	return defaultValue;
+}
 #endif
-		return;
-	}
 
-	//  Look for the "HTTP" marker.  URL is encoded, so marker should never be in the URL.
-	char *end = strstr_P(inputFileName, PSTR(" HTTP"));
 
-	if (end == nullptr)
+#ifdef YAAWS_STATISTICS
+namespace
+{
+	//  Smallest value (power of two) that 'percent' of the counts in the histogram are
+	//  at or below.
+	unsigned long HistogramPercentile(const unsigned long *histogram, byte percent)
 	{
-#ifndef YAAWS_404_THE_ONE_TRUE_ERROR
-		Return400BadRequest();
-#else
-		Return404(inputFileName);
-#endif
-		return;
-	}
+		unsigned long total = 0;
 
-	//  Re-terminate the request at the marker.  Now all we have is a NUL terminated URI.
-	*end = '\0';
+		for (byte i = 0; i < 16; i++)
+		{
+			total += histogram[i];
+		}
 
-	//  Determines the type of the request, then moves the URI down.  This appends it to
-	//  the webroot we initialized with (above), and gives us the filename.
-	RequestType rt = GetRequestType(pRequestStart);
+		unsigned long wanted = (total * percent + 99) / 100;
+		unsigned long seen = 0;
 
-	//  A 'HEAD' request is just a 'GET' without the actual payload.  In that case set the
-	//  file position to the end of the file, normal processing takes care of the rest.
-	bool skipFileData = false;
+		for (byte i = 0; i < 16; i++)
+		{
+			seen += histogram[i];
 
-	switch (rt)
-	{
-	case rtGet:
-		break;
+			if ((seen >= wanted) && (seen != 0))
+			{
+				return (i == 0) ? 0 : (1UL << i) - 1;
+			}
+		}
 
-	case rtHead:
-		skipFileData = true;
-		break;
+		return 0;
+	}
 
-#ifndef YAAWS_GET_IS_ALL_WE_NEED
-	case rtPost:
-		break;
-#endif
+	//  Gives us access to the protected query string helpers.
+	struct BenchmarkCallback : public YaawsCallbackBase
+	{
+		using YaawsCallbackBase::queryPair;
+		using YaawsCallbackBase::getNextQueryPair;
+	};
+}
 
-	default:
-		TRACE(F("Unknown request type"));
-#ifndef YAAWS_404_THE_ONE_TRUE_ERROR
-		Return405MethodNotAllowed();
-#else
-		Return404(inputFileName);
-#endif
-		return;
+void YaawsBase::PrintHistogram(Print &out, const __FlashStringHelper *name,
+							   const unsigned long *histogram, unsigned long maximum)
+{
+	out.print(F(",\""));
+	out.print(name);
+	out.print(F("\":{\"p50\":"));
+	out.print(HistogramPercentile(histogram, 50));
+	out.print(F(",\"p99\":"));
+	out.print(HistogramPercentile(histogram, 99));
+	out.print(F(",\"max\":"));
+	out.print(maximum);
+	out.print(F(",\"histogram\":["));
+
+	for (byte i = 0; i < 16; i++)
+	{
+		if (i != 0)
+		{
+			out.print(',');
+		}
 
+		out.print(histogram[i]);
 	}
 
-#ifndef YAAWS_GET_IS_ALL_WE_NEED
-	//  The end of the HTML request header is marked by the 4 character sequence
-	//  "\r\n\r\n".  Data after that may be needed for processing (e.g., POST requests)
-	//  We also want the 'Content-Length' value if there is one.
-	const char *pContentLengthMatch = contentLengthMarker;
-	bool fGetLength = false;
-	unsigned long contentLength = 0;
-
-	if (rt == rtPost)
-	{
-		int HeaderMarker = 0;
+	out.print(F("]}"));
+}
 
-		while (contData.client.available() && HeaderMarker != 4)
-		{
-			byte c = contData.client.read();
+void YaawsBase::PrintBenchmarks(Print &out)
+{
+	constexpr unsigned long iterations = YAAWS_BENCHMARK_ITERATIONS;
+	constexpr size_t buffSize = 64;
+	char buffer[buffSize + 1];
+	unsigned long start;
+	volatile byte sink = 0;  //  Stops the optimizer throwing the work away
 
-			switch (HeaderMarker)
-			{
-			case 0:
-			case 2:
-				if (c == '\r') HeaderMarker++; else HeaderMarker = 0;
-				break;
+	out.print(F("{\"iterations\":"));
+	out.print(iterations);
 
-			case 1:
-			case 3:
-				if (c == '\n') HeaderMarker++; else HeaderMarker = 0;
-				break;
-			}
+	//  File names are looked at in RAM, copy them there first.
+	char font[25], page[12], other[13];
 
-			//  If we found the the 'Content-length' marker, then the following digits
-			//  define the length.
-			if (fGetLength)
-			{
-				if (isdigit(c))
-				{
-					contentLength = contentLength * 10 + (c - '0');
-				}
-				else
-				{
-					//  All done
-					fGetLength = false;
-				}
-			}
+	strcpy_P(font, PSTR("/images/Background.woff2"));
+	strcpy_P(page, PSTR("/index.html"));
+	strcpy_P(other, PSTR("/data/readme"));
 
-			//  Spec says case-insensitive!
-			byte l = tolower(c);
+	start = micros();
+	for (unsigned long i = 0; i < iterations; i++)
+	{
+		sink += GetResponseType(font) + GetResponseType(page) + GetResponseType(other);
+	}
+	out.print(F(",\"GetResponseType_ns\":"));
+	out.print((micros() - start) * 1000UL / (iterations * 3));
 
-			//  Keep track of how far into the marker we've matched.
-			if (l == pgm_read_byte(pContentLengthMatch))
-			{
-				pContentLengthMatch++;
+	start = micros();
+	for (unsigned long i = 0; i < iterations; i++)
+	{
+		strcpy_P(buffer, PSTR("POST /forms/settings.html?a=1"));
+		sink += GetRequestType(buffer);
+	}
+	out.print(F(",\"GetRequestType_ns\":"));
+	out.print((micros() - start) * 1000UL / iterations);
 
-				//  If we've reached the end of the string, then we can read the length
-				//  value (above).
-				if (pgm_read_byte(pContentLengthMatch) == '\0')
-				{
-					fGetLength = true;
-				}
-			}
-			else
-			{
-				//  No match, start over...
-				pContentLengthMatch = contentLengthMarker;
+	start = micros();
+	for (unsigned long i = 0; i < iterations; i++)
+	{
+		strcpy_P(buffer, PSTR("/My%20Files/caf%C3%A9+menu%2Bextras.html"));
+		urldecode2(buffer);
+		sink += buffer[0];
+	}
+	out.print(F(",\"urldecode2_ns\":"));
+	out.print((micros() - start) * 1000UL / iterations);
 
-				//  ... but see if we've started a new match with this character
-				if (l == pgm_read_byte(pContentLengthMatch))
-				{
-					pContentLengthMatch++;
-				}
-			}
+	start = micros();
+	for (unsigned long i = 0; i < iterations; i++)
+	{
+		strcpy_P(buffer, PSTR("name=Fred+Bloggs&age=42&city=Nowhere%2C+NZ&flag"));
 
-		}
+		BenchmarkCallback::queryPair nameValuePair;
+		char *nextPair = buffer;
 
-		if (HeaderMarker != 4)
+		while (nextPair != nullptr)
 		{
-#ifndef YAAWS_404_THE_ONE_TRUE_ERROR
-			Return400BadRequest();
-#else
-			Return404(inputFileName);
-#endif
-			return;
+			nextPair = BenchmarkCallback::getNextQueryPair(nextPair, nameValuePair);
+			sink += (nameValuePair._name != nullptr);
 		}
 	}
+	out.print(F(",\"getNextQueryPair_ns\":"));
+	out.print((micros() - start) * 1000UL / iterations);
+
+	out.println('}');
+	(void)sink;
+}
 #endif
 
-	char *FormDataString = strchr(inputFileName, '?');
 
-	if (FormDataString != nullptr)
-	{
-		//  Split the string into the filename and the form data.
-		*FormDataString = '\0';
-		FormDataString++;
+#ifdef YAAWS_ACCESS_LOG
+namespace
+{
+	const char strMonths[] PROGMEM = "JanFebMarAprMayJunJulAugSepOctNovDec";
+}
 
-		//  Input buffer now has a NUL terminated filename, then a NUL terminated string
-		//  of form data.  
+const char YaawsBase::strMethods[] PROGMEM = "GET\0HEAD\0POST";
+
+//  Appends seconds since 1970 as a Common Log Format date, '[10/Oct/2000:13:55:36
+//  +0000]'.  Days to a date from Howard Hinnant's 'civil_from_days'.
+char *YaawsBase::AppendLogTime(char *dst, uint32_t time)
+{
+	uint32_t seconds = time % 86400UL;
+	uint32_t days = time / 86400UL + 719468UL;
+	uint32_t era = days / 146097UL;
+	uint32_t dayOfEra = days - era * 146097UL;
+	uint32_t yearOfEra =
+		(dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+	uint32_t dayOfYear =
+		dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+	uint32_t monthIndex = (5 * dayOfYear + 2) / 153;      //  March is 0
+	uint32_t day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+	uint32_t month = (monthIndex < 10) ? monthIndex + 3 : monthIndex - 9;
+	uint32_t year = yearOfEra + era * 400 + ((month <= 2) ? 1 : 0);
+
+	*dst++ = '[';
+	dst = AppendNumber(dst, day, 2);
+	*dst++ = '/';
+	memcpy_P(dst, strMonths + (month - 1) * 3, 3);
+	dst += 3;
+	*dst++ = '/';
+	dst = AppendNumber(dst, year, 4);
+	*dst++ = ':';
+	dst = AppendNumber(dst, seconds / 3600, 2);
+	*dst++ = ':';
+	dst = AppendNumber(dst, (seconds / 60) % 60, 2);
+	*dst++ = ':';
+	dst = AppendNumber(dst, seconds % 60, 2);
+	return AppendP(dst, PSTR(" +0000]"));
+}
+#endif
 
-		//  No sense 'processing' an empty query string.
-		if (*FormDataString == '\0')
-		{
-			FormDataString = nullptr;
-		}
-		else
-		{
-			IF_TRACE(Serial.println(FormDataString));
-		}
-	}
 
-	//  Only decode the filename!  If you decode the query string, it may then contain
-	//  extra '=' or '&' characters, which will hopelessly mess up parsing the query
-	//  string.
-	urldecode2(inputFileName);
+#ifdef YAAWS_GZIP_STREAM
+namespace
+{
+	//  Deflate (RFC 1951) length and distance codes - the smallest length or distance
+	//  each one stands for.  The number of extra bits follows from the position.
+	const uint16_t lengthBase[] PROGMEM =
+	{
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+	};
 
-	if (inputFileName[strlen(inputFileName) - 1] == '/')
+	const uint16_t distanceBase[] PROGMEM =
 	{
-		//  Path but no filename, use default
-		TRACE(F("Adding default filename"));
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+	};
 
-		strcat_P(inputFileName, PSTR("index.html"));
+	byte LengthExtraBits(byte code)
+	{
+		return ((code < 8) || (code == 28)) ? 0 : (code - 4) / 4;
+	}
 
-		//  We might have stomped over form data.  New rule! - default files can't have
-		//  form data!
-		FormDataString = nullptr;
+	byte DistanceExtraBits(byte code)
+	{
+		return (code < 4) ? 0 : (code - 2) / 2;
 	}
 
-	TRACE(F("Requested file:"));
-	IF_TRACE(quotedTrace(inputFileName));
+	//  CRC-32 (as used by gzip) a nibble at a time, to keep the table small.
+	const uint32_t crcTable[] PROGMEM =
+	{
+		0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+		0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+		0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+		0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+	};
 
-	if (!contData.sdFile.open(inputFileName, O_READ))
+	uint32_t Crc32(uint32_t crc, byte b)
 	{
-		{
-			TRACE(F("Unknown file"));
+		crc ^= b;
+		crc = pgm_read_dword(&crcTable[crc & 0x0F]) ^ (crc >> 4);
+		crc = pgm_read_dword(&crcTable[crc & 0x0F]) ^ (crc >> 4);
 
-			//  Unknown file or filetype
-			Return404(inputFileName);
-			return;
-		}
+		return crc;
 	}
 
-#ifndef YAAWS_NOTHING_EVER_CHANGES
-	//  You can apply 'FileAction' only to mutable files.  We supply the URL path, NOT the
-	//  full file-system path.
-	contData.doFileAction =
-		!contData.sdFile.isReadOnly() && _callback.IsMutable(pRequestStart);
-#endif
+	//  gzip member header - deflate, no file name, no time stamp, unknown OS.
+	const byte gzipHeader[] PROGMEM = {0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF};
+}
 
-	//  Determine 'Content-type' of the file.
-	contData.rt = GetResponseType(inputFileName);
 
-	if (skipFileData)
+void YaawsDeflate::Start()
+{
+	_busy = true;
+	_in = _end = 0;
+	_crc = 0xFFFFFFFF;
+	_bits = 0;
+	_bitCount = 0;
+	_outLength = 0;
+
+	for (byte i = 0; i < sizeof(gzipHeader); i++)
 	{
-		//  Implement HEAD by seeking immediately to the end of the file.
-		contData.sdFile.seekEnd();
+		PutByte(pgm_read_byte(&gzipHeader[i]));
 	}
 
-	//  Process form data.  We assume that only 'GET' requests have data in the request
-	//  header that needs to be processed.
-	if ((rt == rtGet) && (FormDataString != nullptr))
+	//  One block with the fixed codes ('BTYPE' 01), which runs to the end of the stream.
+	PutBits(2, 3);
+}
+
+
+size_t YaawsDeflate::Compress(const uint8_t *buf, size_t size)
+{
+	size_t taken = 0;
+
+	for (;;)
 	{
-		TRACE(F("Form data:"));
+		//  Take in what we can without overwriting the half of the window we look back
+		//  into.
+		while ((taken < size) && ((_end - _in) < WINDOW / 2))
+		{
+			byte b = buf[taken++];
 
-		IF_TRACE(Serial.println(FormDataString));
-		if (!_callback.ProcessFormData(pRequestStart, FormDataString))
+			_window[_end & (WINDOW - 1)] = b;
+			_end++;
+			_crc = Crc32(_crc, b);
+		}
+
+		//  Hold back enough to find a long match in.
+		while (((_end - _in) > LOOKAHEAD) && !OutputFull())
 		{
-#ifndef YAAWS_404_THE_ONE_TRUE_ERROR
-			Return400BadRequest();
-#else
-			Return404(inputFileName);
-#endif
-			return;
+			EncodeNext();
 		}
-	}
 
-#ifndef YAAWS_GET_IS_ALL_WE_NEED
-	if (rt == rtPost)
-	{
-		if (!_callback.ProcessPostData(pRequestStart, contData.client, contentLength))
+		if ((taken == size) || OutputFull())
 		{
-#ifndef YAAWS_404_THE_ONE_TRUE_ERROR
-			Return400BadRequest();
-#else
-			Return404(inputFileName);
-#endif
-			return;
+			return taken;
 		}
 	}
-#endif
-
-	//  We've processed any form data.  More calls to 'ServiceWebServer' will send the
-	//  HTTP Response Header and the file back.
 }
 
 
-
-
-//  Move to the next active connection, to be serviced on the next call.
-void YAAWS::AdvanceServiceIndex()
+bool YaawsDeflate::Finish()
 {
-#ifndef YAAWS_ONE_STREAM_ONLY
-	if ((_activeConnections != 0))
+	while (_in != _end)
 	{
-		//  No need to look for the 'next' connection if this one is the only one.
-		if (_activeConnections != (1 << _serviceIndex))
+		if (OutputFull())
 		{
-			for (size_t i = 0; i < MAX_CLIENTS; i++)
-			{
-				_serviceIndex++;
-				_serviceIndex %= MAX_CLIENTS;
-
-				if (_activeConnections & (1 << _serviceIndex))
-				{
-					return;
-				}
-			}
+			return false;
 		}
+
+		EncodeNext();
 	}
-	else
+
+	//  Need room for the end of block, the final (empty) block and the trailer.
+	if (_outLength > OUT_SIZE - 16)
 	{
-		//  No active connections.
-		_serviceIndex = 0;
+		return false;
 	}
-#endif
-}
 
+	if (_busy)
+	{
+		PutSymbol(256);
+		PutBits(3, 3);          //  'BFINAL', fixed codes
+		PutSymbol(256);
 
-const char *
-YAAWS::GetWebRoot()
-{
-	return (const char *)(_webRoot ? _webRoot : PSTR("/WWW"));
+		if (_bitCount > 0)
+		{
+			PutBits(0, 8 - _bitCount);
+		}
+
+		PutLong(~_crc);
+		PutLong(_end);          //  Length of the input, modulo 2^32
+		_busy = false;
+	}
+
+	return true;
 }
 
 
-void YAAWS::ServiceWebServer(void)
+//  Compress the next byte, or run of bytes.  Repeats are looked for with a one entry
+//  hash table, and the first match found is taken.
+void YaawsDeflate::EncodeNext()
 {
-#ifndef YAAWS_ONE_STREAM_ONLY
-	if ((_activeConnections & clientsMask) != clientsMask)
+	const uint32_t available = _end - _in;
+	uint16_t length = 0;
+	uint16_t distance = 0;
+
+	if (available >= 3)
 	{
-		//  At least one unused connection exists
-		for (size_t i = 0; i < MAX_CLIENTS; i++)
-		{
-			if (!(_activeConnections & (1 << i)))
-			{
-				ContinuationData &contData = _contData[i];
+		byte h = Hash(_in);
+		distance = static_cast<uint16_t>(_in) - _head[h];
+		_head[h] = static_cast<uint16_t>(_in);
 
-				contData.client = _server.accept();
+		//  The table may be stale, or from an earlier stream.  Only look back over what
+		//  this stream has had, and what the window still holds.
+		if ((distance > 0) && (distance <= _in) && (distance <= WINDOW - available))
+		{
+			const uint16_t longest = min(available, (uint32_t)MAX_MATCH);
+			const uint32_t from = _in - distance;
 
-				if (contData.client.connected())
-				{
-					//  If there are no other active connections, make this one the next
-					//  to be serviced.
-					if (_activeConnections == 0)
-					{
-						_serviceIndex = i;
-					}
-
-					//  Mark connection as active.
-					_activeConnections |= (1 << i);
-					contData.rt = UNKNOWN;
-#ifndef YAAWS_NOTHING_EVER_CHANGES
-					contData.doFileAction = true;
-#endif
-				}
-				else
-				{
-					//  No need to continue looking for incoming connections.
-					break;
-				}
+			while ((length < longest) && (At(from + length) == At(_in + length)))
+			{
+				length++;
 			}
 		}
 	}
-#else  //  Only one stream
-	if (_activeConnections == 0)
+
+	if (length < 3)
 	{
-		ContinuationData &contData = _contData[_serviceIndex];
-		contData.client = _server.accept();
+		PutSymbol(At(_in));
+		_in++;
+		return;
+	}
 
-		if (contData.client.connected())
-		{
-			_activeConnections |= (1 << _serviceIndex);
-			contData.rt = UNKNOWN;
-#ifndef YAAWS_NOTHING_EVER_CHANGES
-			contData.doFileAction = true;
-#endif
-		}
+	byte code = COUNTOF(lengthBase) - 1;
+
+	while (pgm_read_word(&lengthBase[code]) > length)
+	{
+		code--;
 	}
-#endif
 
-	if (_activeConnections & (1 << _serviceIndex))
+	PutSymbol(257 + code);
+	PutBits(length - pgm_read_word(&lengthBase[code]), LengthExtraBits(code));
+
+	code = COUNTOF(distanceBase) - 1;
+
+	while (pgm_read_word(&distanceBase[code]) > distance)
 	{
-		ContinuationData &contData = _contData[_serviceIndex];
+		code--;
+	}
 
-		if (!contData.client.connected())
-		{
-			TRACE(F("Connection unexpectedly closed"));
+	PutCode(code, 5);
+	PutBits(distance - pgm_read_word(&distanceBase[code]), DistanceExtraBits(code));
 
-			FinishConnection();
-		}
-		else
-		{
-			if (contData.rt == UNKNOWN)
-			{
-				AcceptIncoming();
-			}
-			else
-			{
-				ContinueRequest();
-			}
-		}
+	//  Remember where the rest of the match starts, for later matches.
+	for (uint16_t i = 1; (i < length) && (_end - (_in + i) >= 3); i++)
+	{
+		_head[Hash(_in + i)] = static_cast<uint16_t>(_in + i);
+	}
+
+	_in += length;
+}
+
+
+//  Deflate packs bits from the least significant end of each byte.
+void YaawsDeflate::PutBits(uint16_t value, uint8_t count)
+{
+	_bits |= static_cast<uint32_t>(value) << _bitCount;
+	_bitCount += count;
+
+	while (_bitCount >= 8)
+	{
+		PutByte(static_cast<uint8_t>(_bits));
+		_bits >>= 8;
+		_bitCount -= 8;
 	}
+}
 
-	AdvanceServiceIndex();
+
+//  Huffman codes go most significant bit first, so are reversed.
+void YaawsDeflate::PutCode(uint16_t code, uint8_t length)
+{
+	uint16_t reversed = 0;
+
+	for (uint8_t i = 0; i < length; i++)
+	{
+		reversed = (reversed << 1) | (code & 1);
+		code >>= 1;
+	}
+
+	PutBits(reversed, length);
 }
 
 
+//  A literal byte, end of block or length code, using the fixed Huffman codes.
+void YaawsDeflate::PutSymbol(uint16_t symbol)
+{
+	if (symbol < 144)
+	{
+		PutCode(0x30 + symbol, 8);
+	}
+	else if (symbol < 256)
+	{
+		PutCode(0x190 + symbol - 144, 9);
+	}
+	else if (symbol < 280)
+	{
+		PutCode(symbol - 256, 7);
+	}
+	else
+	{
+		PutCode(0xC0 + symbol - 280, 8);
+	}
+}
+
 
+void YaawsDeflate::PutLong(uint32_t value)
+{
+	for (byte i = 0; i < 4; i++)
+	{
+		PutByte(static_cast<uint8_t>(value));
+		value >>= 8;
+	}
+}
+#endif
@@ -30,15 +30,67 @@
 #endif
 
 
+//  The web server is a class template, 'BasicYaaws<Transport, FileSystem, Config>'.  The
+//  transport is the listening server and the client connections it hands out, the file
+//  system is the volume and its files, and the config is the choices in YaawsConfig
+//  (below).  'YAAWS' is the server with the defaults - the Ethernet library, SdFat and
+//  the #defines in this file.  To change the default transport or file system - a WiFi
+//  server and client, SdFat's exFAT classes, a host build - define the replacement
+//  types here (or as compiler options), and add the #include for them.  Or give just
+//  one server its own:
+//
+//    typedef YaawsTransport<WiFiServer, WiFiClient> WiFiTransport;
+//    typedef YaawsFileSystem<SdExFat, ExFatFile> ExFatFileSystem;
+//
+//    BasicYaaws<WiFiTransport, ExFatFileSystem> wifiWeb(exFat);
+//
+//  Its callback is then a 'BasicYaawsCallback<WiFiClient, ExFatFile>'.  The replacements
+//  must provide the same methods YAAWS uses on the default types.  Servers of different
+//  kinds can share a sketch, each with the code for its own types.  The optional
+//  features (YAAWS_AUTOINDEX and the rest, below) are compiled in or out for the whole
+//  program.
+
+// #define YAAWS_SERVER_TYPE        WiFiServer
+// #define YAAWS_CLIENT_TYPE        WiFiClient
+// #define YAAWS_FILESYSTEM_TYPE    SdExFat
+// #define YAAWS_FILE_TYPE          ExFatFile
+
+//  Likewise the clock.  The server reads the time only through these, so a simulation
+//  (with the transport and file system above replaced by models) can run the server on
+//  virtual time, and get the same result every run.
+#ifndef YAAWS_MILLIS
+#define YAAWS_MILLIS() millis()
+#endif
+
+#ifndef YAAWS_MICROS
+#define YAAWS_MICROS() micros()
+#endif
+
+#ifndef YAAWS_SERVER_TYPE
+#define YAAWS_ETHERNET_TRANSPORT
+#define YAAWS_SERVER_TYPE EthernetServer
+#define YAAWS_CLIENT_TYPE EthernetClient
+#endif
+
+#ifndef YAAWS_FILESYSTEM_TYPE
+#define YAAWS_SDFAT_FILESYSTEM
+#define YAAWS_FILESYSTEM_TYPE SdFileSystem<SdSpiCard>
+#define YAAWS_FILE_TYPE SdFile
+#endif
+
+#ifdef YAAWS_SDFAT_FILESYSTEM
 #ifndef SdFat_h
 #pragma GCC warning "Include 'SdFat.h' before including YAAWS.h"
 #include <SdFat.h>
 #endif
+#endif
 
+#ifdef YAAWS_ETHERNET_TRANSPORT
 #ifndef ethernet_h_
 #pragma GCC warning "Include 'Ethernet.h' before including YAAWS.h"
 #include <Ethernet.h>
 #endif
+#endif
 
 //  You can control how much functionality (and hence memory use) you have using the
 //  #defines below.  By default, we provide all functionality.
@@ -80,8 +132,536 @@
 // #define YAAWS_NOTHING_EVER_CHANGES		//  All files are immutable.
 // #define YAAWS_NO_FLASHY_FLASHY			//  Don't flash built-in LED on activity
 
-//  Web server will use this for its files.
-typedef SdFile WebFileType;
+//  These, and YAAWS_MAX_CLIENTS, are the defaults for YaawsConfig (further down), so
+//  one server can still be set up differently.
+
+//  Number of simultaneous connections.  4 works on all 5X00 chips, the W5500 has 8
+//  hardware sockets so can go higher.  Any value up to 32 is accepted, as long as the
+//  transport has the sockets for it (YAAWS_MAX_SOCKETS).  Ignored (always 1) if
+//  YAAWS_ONE_STREAM_ONLY is defined.
+#ifndef YAAWS_MAX_CLIENTS
+#define YAAWS_MAX_CLIENTS 4
+#endif
+
+#ifndef YAAWS_MAX_SOCKETS
+#ifdef YAAWS_ETHERNET_TRANSPORT
+#define YAAWS_MAX_SOCKETS MAX_SOCK_NUM
+#else
+#define YAAWS_MAX_SOCKETS 32
+#endif
+#endif
+
+//  Keep one hardware socket free for the listener, so new connections can always be
+//  accepted (and the server never stops listening), even when all connections are busy.
+//  YAAWS_MAX_CLIENTS must then be at most MAX_SOCK_NUM - 1.
+// #define YAAWS_RESERVE_LISTENER_SOCKET
+
+//  When every connection is busy, accept the extra connection just long enough to send
+//  back '503 Service Unavailable' with a 'Retry-After' header, rather than leaving it
+//  waiting until it times out.  Works best along with YAAWS_RESERVE_LISTENER_SOCKET, so
+//  there is always a socket to accept on.
+// #define YAAWS_OVERLOAD_REJECT
+
+#ifndef YAAWS_RETRY_AFTER_SECONDS
+#define YAAWS_RETRY_AFTER_SECONDS 2
+#endif
+
+//  Listen on more than one port - say the web pages on 80, and an API or configuration
+//  pages on 8080 - each with its own web root and callback.  Add the extra listeners with
+//  'AddListener' before calling 'begin'.  Each listener can have some connections kept
+//  for it alone, so that it can always get in however busy the others are; the rest are
+//  shared, first come first served.  Every listener needs a socket of its own to listen
+//  on.
+#ifndef YAAWS_MAX_LISTENERS
+#define YAAWS_MAX_LISTENERS 1
+#endif
+
+//  Look for new connections at most this often (microseconds).  Each look is a scan of
+//  the W5x00 socket registers over SPI, which is most of the cost of an idle call - with
+//  this set, an idle call that isn't due to look just returns.  A new connection waits
+//  up to this long to be noticed.  0 looks on every call.
+#ifndef YAAWS_ACCEPT_INTERVAL_MICROS
+#define YAAWS_ACCEPT_INTERVAL_MICROS 0
+#endif
+
+//  If a directory is requested and it has no 'index.html', send back a listing of it
+//  (name, size and modification time) rather than a 404.  Add '?format=json' to the URL
+//  to get JSON instead of HTML, and '?offset=N&limit=N' to page through big directories
+//  ('limit' is at most YAAWS_AUTOINDEX_LIMIT).
+//  Each call to 'ServiceWebServer' lists at most YAAWS_AUTOINDEX_PER_CALL entries.
+// #define YAAWS_AUTOINDEX
+
+#ifndef YAAWS_AUTOINDEX_LIMIT
+#define YAAWS_AUTOINDEX_LIMIT 100       //  Entries per page, and the most 'limit=' gets
+#endif
+
+#ifndef YAAWS_AUTOINDEX_PER_CALL
+#define YAAWS_AUTOINDEX_PER_CALL 4
+#endif
+
+#ifndef YAAWS_AUTOINDEX_NAME_MAX
+#define YAAWS_AUTOINDEX_NAME_MAX 64     //  Longer names are cut short
+#endif
+
+//  Let clients watch a growing log without downloading all of it again.  Add '?tail=N'
+//  to the URL of a '.txt', '.log' or '.csv' file to get only its last N bytes (from the
+//  first whole line in them), and '?follow=1' to keep the connection open and be sent
+//  whatever is added to the file from then on.  A followed file is looked at again every
+//  YAAWS_FOLLOW_POLL_MS, by opening it afresh - the open file doesn't see what the sketch
+//  appends through its own handle, and the sketch must 'sync' (or close) the file for
+//  the new data to show.  If the file goes away or gets shorter (the log was rotated),
+//  the response ends.  A follower holds its connection until the client goes away.
+//  Paths longer than YAAWS_FOLLOW_PATH - 1 characters can only be tailed.  The start of
+//  the first whole line is looked for in at most YAAWS_TAIL_SCAN bytes, so a file with
+//  no line breaks costs no more than a sector or two - if none is found, the last N
+//  bytes are sent as they are.
+// #define YAAWS_LOG_TAIL
+
+#ifndef YAAWS_FOLLOW_POLL_MS
+#define YAAWS_FOLLOW_POLL_MS 1000
+#endif
+
+#ifndef YAAWS_FOLLOW_PATH
+#define YAAWS_FOLLOW_PATH 48
+#endif
+
+#ifndef YAAWS_TAIL_SCAN
+#define YAAWS_TAIL_SCAN 512
+#endif
+
+//  Let clients ask for part of a CSV data log by time.  Add '?from=T&to=T' to the URL of
+//  a '.csv' file to get only the rows with times 'from' to 'to' (inclusive, either may be
+//  left out).  A row's time is the number it starts with (seconds since 1970, say), and
+//  rows must be in time order.  Rows that don't start with a number count as time 0.
+//  Each CSV file gets an index in YAAWS_CSV_INDEX_DIR, holding the time and position of
+//  every YAAWS_CSV_INDEX_ROWS'th row.  When a range is asked for, the index is first
+//  brought up to date, YAAWS_CSV_INDEX_PER_CALL bytes of new rows per call.  Only rows
+//  added since the last query are read.  The range is then found with a binary search
+//  of the index and a short scan, and sent like any other file.  One index is updated
+//  at a time, other queries wait their turn.  A row still being written (no end of line
+//  yet) is left out.  Rows must be shorter than YAAWS_CSV_ROW_MAX bytes, which is also
+//  the stack the scan takes.  SdFat only.
+// #define YAAWS_CSV_INDEX
+
+#ifndef YAAWS_CSV_INDEX_DIR
+#define YAAWS_CSV_INDEX_DIR "/CSVIDX"
+#endif
+
+#ifndef YAAWS_CSV_INDEX_ROWS
+#define YAAWS_CSV_INDEX_ROWS 64
+#endif
+
+#ifndef YAAWS_CSV_INDEX_PER_CALL
+#define YAAWS_CSV_INDEX_PER_CALL 2048
+#endif
+
+#ifndef YAAWS_CSV_ROW_MAX
+#define YAAWS_CSV_ROW_MAX 256
+#endif
+
+#if defined(YAAWS_CSV_INDEX) && !defined(YAAWS_SDFAT_FILESYSTEM)
+#error "YAAWS_CSV_INDEX needs the SdFat file system"
+#endif
+
+//  Serve the site from a single packed archive file (built on your PC with
+//  'extras/yaaws_pack.py') rather than from the web root directory.  The archive has a
+//  hashed index, so finding a file is a hash probe plus a seek instead of a walk through
+//  the FAT directories, and files are read sequentially from one open file.  Anything not
+//  in the archive is still looked for in the web root.
+// #define YAAWS_PACKED_SITE
+
+#ifndef YAAWS_PACKED_SITE_FILE
+#define YAAWS_PACKED_SITE_FILE "/SITE.PAK"
+#endif
+
+//  Serve files built into the sketch (in PROGMEM) before looking on the SD card.  Use
+//  'extras/yaaws_flash.py' to turn a directory into a header of PROGMEM data plus a
+//  sorted index, include it in your sketch and pass the index to 'SetFlashSite' before
+//  calling 'begin'.  Flash files take no SD card traffic at all, and with a flash site
+//  'begin' no longer needs an SD card.  Anything not in flash is looked for on the card.
+//  On AVR, the data must all be in the lower 64K of flash.
+// #define YAAWS_FLASH_SITE
+
+//  Files packed or built in gzip'd are only sent to clients that take gzip.  For other
+//  clients the file is looked for in the next place (flash, then the packed site, then
+//  the SD card), and if there is no plain copy anywhere they get 406 Not Acceptable.
+//  With YAAWS_GET_IS_ALL_WE_NEED the request headers aren't read, so gzip'd files are
+//  never sent.
+
+//  Internal - some response bodies don't come from 'sdFile'.
+#if defined(YAAWS_PACKED_SITE) || defined(YAAWS_FLASH_SITE)
+#define YAAWS_BODY_SOURCES
+#endif
+
+//  Read ahead of the network.  Each connection gets a YAAWS_PREFETCH_SIZE byte buffer,
+//  and on calls where its socket has no room to write, the next part of the file is read
+//  into it instead of leaving the SD card idle.  When the socket drains, the staged part
+//  goes out first, straight away.  A socket with room for less than a sector is sent from
+//  the buffer too, so a slow client doesn't have each sector read many times over.
+//  Costs YAAWS_PREFETCH_SIZE bytes of RAM per connection, so mostly of use on the bigger
+//  boards.
+// #define YAAWS_SD_PREFETCH
+
+#ifndef YAAWS_PREFETCH_SIZE
+#define YAAWS_PREFETCH_SIZE 512         //  Keep this a multiple of the SD sector size
+#endif
+
+//  Gather small writes to a connection - the response header, callback 'print's, canned
+//  error pages - into one buffer per connection, so they go out as a few full packets
+//  rather than one W5x00 SEND (and often one packet) each.  The buffer is sent when it is
+//  full, at the end of each call to 'ServiceWebServer', and when the connection is
+//  closed.  The header is held over so it goes out with the start of the body.  Costs
+//  YAAWS_WRITE_BUFFER_SIZE bytes of RAM per connection; up to one MSS (1460) is useful.
+// #define YAAWS_WRITE_COMBINING
+
+#ifndef YAAWS_WRITE_BUFFER_SIZE
+#define YAAWS_WRITE_BUFFER_SIZE 512
+#endif
+
+//  Compress text responses on the fly for clients that send 'Accept-Encoding: gzip'.
+//  HTML, CSS, JavaScript, JSON, CSV, SVG and plain text (including '.log') files are
+//  compressed as they are sent, as is everything 'FileAction' prints.  The compressor
+//  looks for repeats in the last YAAWS_GZIP_WINDOW bytes (a power of two, 256 to 32768)
+//  and uses the fixed Huffman codes, so it needs no tables in RAM and keeps up with the
+//  SD card.  There is only one, so one response is compressed at a time and the others
+//  go out as they are.  Files shorter than YAAWS_GZIP_MIN_SIZE aren't worth it.
+//  Compressed responses have no 'Content-length', they end when the connection closes
+//  (which we always do).  Costs about YAAWS_GZIP_WINDOW + 660 bytes of RAM.  Works best
+//  along with YAAWS_WRITE_COMBINING.
+// #define YAAWS_GZIP_STREAM
+
+#ifndef YAAWS_GZIP_WINDOW
+#define YAAWS_GZIP_WINDOW 1024
+#endif
+
+#ifndef YAAWS_GZIP_MIN_SIZE
+#define YAAWS_GZIP_MIN_SIZE 256
+#endif
+
+#if defined(YAAWS_GZIP_STREAM) && defined(YAAWS_GET_IS_ALL_WE_NEED)
+#error "YAAWS_GZIP_STREAM needs the request headers, which YAAWS_GET_IS_ALL_WE_NEED skips"
+#endif
+
+//  Internal - connections are written through a 'YaawsBufferedClient'.
+#if defined(YAAWS_WRITE_COMBINING) || defined(YAAWS_GZIP_STREAM)
+#define YAAWS_BUFFERED_CLIENT
+#endif
+
+//  Internal - the request's 'Accept-Encoding' header matters.
+#if defined(YAAWS_GZIP_STREAM) || defined(YAAWS_BODY_SOURCES)
+#define YAAWS_ACCEPT_ENCODING
+#endif
+
+//  Give each request its own YAAWS_CONTEXT_SIZE bytes of storage for the callback, so
+//  dynamic pages can keep their state per request rather than in the callback object, and
+//  be served to several clients at once.  The storage is zeroed when the connection is
+//  accepted, and passed as 'context' to the callback functions that take one (see
+//  YaawsCallback).  It is aligned for any basic type.
+// #define YAAWS_CONTEXT_SIZE 8
+
+//  'FileAction' is only called when the connection has room for at least this much more
+//  output, so a callback that prints a piece of the page each time it is called won't
+//  sit waiting for the socket.  0 calls it every time.
+#ifndef YAAWS_FILEACTION_SPACE
+#define YAAWS_FILEACTION_SPACE 256
+#endif
+
+//  Keep performance statistics - requests, bytes, per-request latency and how long each
+//  call to 'ServiceWebServer' takes - and allow them to be printed as JSON (see
+//  'PrintStatistics').  'extras/yaaws_bench.py' drives a server with a mix of clients and
+//  reports the same figures from the client side, and 'make bench' in 'extras/sim' runs
+//  the same mix against a PC build.
+// #define YAAWS_STATISTICS
+
+//  Times round each loop of 'PrintBenchmarks'.  A faster processor needs more to measure.
+#ifndef YAAWS_BENCHMARK_ITERATIONS
+#define YAAWS_BENCHMARK_ITERATIONS 200
+#endif
+
+//  Size each piece of a file to send so that a call takes about this many microseconds,
+//  rather than always sending as much as the socket will take.  The server keeps a
+//  running estimate of how long the SD read and socket write take per byte, and sends
+//  smaller pieces when the card or the SPI bus is slow, larger ones (up to the usual
+//  limit) when there is time to spare.  For sketches that need 'loop' to come round
+//  regularly.  'ChunkSize' shows what it has settled on.
+// #define YAAWS_CALL_TARGET_MICROS 2000
+
+//  Remember where recently requested files are on the card, and which requested files
+//  don't exist.  Opening a file by its path reads and compares every directory entry
+//  along the way, and missing files ('/favicon.ico' and friends) are the worst, as every
+//  entry of their directory is looked at.  With this, a file seen recently is opened
+//  straight from its directory entry, and a missing one is a 404 without touching the
+//  card.  Holds YAAWS_PATH_CACHE_SIZE paths, and keeps YAAWS_PATH_CACHE_DIRS directories
+//  open.  A cached file is only used if the name in its directory entry still matches.
+//  A missing file is remembered for YAAWS_PATH_CACHE_MISS_MS, or until YAAWS makes a file
+//  itself (the access log, a CSV index) or calls 'FileAction'.  If your sketch adds,
+//  removes or renames files in the web root, call 'InvalidateCache' afterwards for them
+//  to be seen straight away.  SdFat only.
+// #define YAAWS_PATH_CACHE
+
+#ifndef YAAWS_PATH_CACHE_SIZE
+#define YAAWS_PATH_CACHE_SIZE 8
+#endif
+
+#ifndef YAAWS_PATH_CACHE_DIRS
+#define YAAWS_PATH_CACHE_DIRS 2
+#endif
+
+#ifndef YAAWS_PATH_CACHE_MISS_MS
+#define YAAWS_PATH_CACHE_MISS_MS 10000
+#endif
+
+#if defined(YAAWS_PATH_CACHE) && !defined(YAAWS_SDFAT_FILESYSTEM)
+#error "YAAWS_PATH_CACHE needs the SdFat file system"
+#endif
+
+//  Share recently read sectors of files between connections.  When several clients
+//  download the same file at once, each sector is read from the card once rather than
+//  once per client.  Holds YAAWS_SECTOR_CACHE_BLOCKS sectors of 512 bytes, least recently
+//  used goes first.  Files that 'FileAction' works on are never cached.  A file that is
+//  added to, or deleted and written again, is fine, but if your sketch rewrites part of a
+//  file in the web root without changing its length, call 'InvalidateCache' afterwards.
+//  'SectorCacheHits' / 'SectorCacheMisses' show how well it is doing.  SdFat only.
+// #define YAAWS_SECTOR_CACHE
+
+#ifndef YAAWS_SECTOR_CACHE_BLOCKS
+#define YAAWS_SECTOR_CACHE_BLOCKS 2
+#endif
+
+#if defined(YAAWS_SECTOR_CACHE) && !defined(YAAWS_SDFAT_FILESYSTEM)
+#error "YAAWS_SECTOR_CACHE needs the SdFat file system"
+#endif
+
+//  Keep an access log on the SD card, in Common Log Format with the time the request took
+//  (milliseconds) added at the end of each line.  Finished requests go into a RAM ring of
+//  YAAWS_ACCESS_LOG_RECORDS entries.  One at a time they are formatted into a sector
+//  buffer, which is written out when full (or after YAAWS_ACCESS_LOG_FLUSH_MS with nothing
+//  written) on a call with no connections to service, so the slow SD writes stay out of
+//  the way of requests.  If the ring fills, records are dropped and counted (see
+//  'AccessLogDropped').  At YAAWS_ACCESS_LOG_MAX_SIZE bytes, the log is renamed to
+//  YAAWS_ACCESS_LOG_OLD (replacing any earlier one) and a new one started.  Paths longer
+//  than YAAWS_ACCESS_LOG_PATH - 1 characters are cut short.  Times come from
+//  'YaawsCallback::CurrentTime'.  Costs about 1K of RAM.
+// #define YAAWS_ACCESS_LOG
+
+#ifndef YAAWS_ACCESS_LOG_FILE
+#define YAAWS_ACCESS_LOG_FILE "/ACCESS.LOG"
+#endif
+
+#ifndef YAAWS_ACCESS_LOG_OLD
+#define YAAWS_ACCESS_LOG_OLD "/ACCESS.OLD"
+#endif
+
+#ifndef YAAWS_ACCESS_LOG_MAX_SIZE
+#define YAAWS_ACCESS_LOG_MAX_SIZE 1048576UL
+#endif
+
+#ifndef YAAWS_ACCESS_LOG_RECORDS
+#define YAAWS_ACCESS_LOG_RECORDS 8
+#endif
+
+#ifndef YAAWS_ACCESS_LOG_PATH
+#define YAAWS_ACCESS_LOG_PATH 32
+#endif
+
+#ifndef YAAWS_ACCESS_LOG_FLUSH_MS
+#define YAAWS_ACCESS_LOG_FLUSH_MS 5000
+#endif
+
+//  Measure how much stack each part of a request takes - accepting it, the response
+//  header, 'FileAction' and sending the body.  'begin' fills the free RAM between the
+//  heap and the stack with a pattern, and after each call the server looks for how far
+//  down the pattern was overwritten.  See 'StackUsed' and 'PrintStackUsage'.  Adds the
+//  time to check (and refill) the used part of the stack to every call.
+//  'extras/yaaws_footprint.py' reports the flash and static RAM each configuration takes.
+//  Only for AVR and ARM cores where the stack sits above the heap.  RTOS cores (ESP32,
+//  ESP8266, mbed) give each task a stack of its own, often inside the heap.
+// #define YAAWS_STACK_USAGE
+
+#if defined(YAAWS_STACK_USAGE) && \
+	!(defined(__AVR__) || (defined(__arm__) && !defined(ARDUINO_ARCH_MBED)))
+#error "YAAWS_STACK_USAGE needs the stack above the heap, as on AVR and ARM with newlib"
+#endif
+
+//  How active connections share the calls to 'ServiceWebServer'.
+//  - YAAWS_SCHEDULE_ROUND_ROBIN: each connection gets one call in turn.  The default.
+//  - YAAWS_SCHEDULE_DEFICIT: deficit round robin.  Connections share by bytes sent
+//    rather than by calls.  Each turn is worth YAAWS_SCHEDULE_QUANTUM bytes, doubled for
+//    each level of 'RequestPriority' (see YaawsCallback).
+//  - YAAWS_SCHEDULE_SHORTEST: the connection with the least left to send goes next,
+//    after any with a higher 'RequestPriority'.  Every YAAWS_SCHEDULE_AGING calls a
+//    plain round robin turn is taken instead, so large downloads are never starved.
+#define YAAWS_SCHEDULE_ROUND_ROBIN 0
+#define YAAWS_SCHEDULE_DEFICIT     1
+#define YAAWS_SCHEDULE_SHORTEST    2
+
+#ifndef YAAWS_SCHEDULER
+#define YAAWS_SCHEDULER YAAWS_SCHEDULE_ROUND_ROBIN
+#endif
+
+#ifndef YAAWS_SCHEDULE_QUANTUM
+#define YAAWS_SCHEDULE_QUANTUM 512
+#endif
+
+#if YAAWS_SCHEDULE_QUANTUM <= 0
+#error "YAAWS_SCHEDULE_QUANTUM must be more than 0"
+#endif
+
+#ifndef YAAWS_SCHEDULE_AGING
+#define YAAWS_SCHEDULE_AGING 8
+#endif
+
+//  Web server will use these for its connections and files, unless given others.
+typedef YAAWS_SERVER_TYPE WebServerType;
+typedef YAAWS_CLIENT_TYPE WebClientType;
+typedef YAAWS_FILE_TYPE WebFileType;
+typedef YAAWS_FILESYSTEM_TYPE webSdCard;
+
+//  A transport - the server that listens for connections, the client type it hands them
+//  out as, and how many sockets there are to go round.  One that can see a connection
+//  waiting without accepting it (for 'HasPendingWork') also says which socket each
+//  client is on, and whether any other socket has a connection, as the Ethernet one does.
+template <class ServerType, class ClientType, byte Sockets = YAAWS_MAX_SOCKETS>
+struct YaawsTransport
+{
+	typedef ServerType Server;
+	typedef ClientType Client;
+
+	static constexpr byte maxSockets = Sockets;
+
+	//  False if the hardware isn't there.
+	static bool Present() { return true; }
+
+	//  Socket 'client' is on, 0xFF if it can't be told.
+	static byte SocketNumber(Client &) { return 0xFF; }
+
+	//  Might a new connection be waiting on a socket not in 'ours' (one bit per socket)?
+	static bool ConnectionWaiting(uint32_t) { return true; }
+};
+
+#ifdef ethernet_h_
+//  The Ethernet library on a W5x00.
+struct YaawsEthernetTransport :
+	YaawsTransport<EthernetServer, EthernetClient, MAX_SOCK_NUM>
+{
+	static bool Present()
+	{
+		return Ethernet.hardwareStatus() != EthernetNoHardware;
+	}
+
+	static byte SocketNumber(EthernetClient &client)
+	{
+		return client.getSocketNumber();
+	}
+
+	//  Any connected socket that isn't one of ours is a new connection.
+	static bool ConnectionWaiting(uint32_t ours)
+	{
+		//  W5x00 socket status register values, for connected sockets.
+		constexpr uint8_t socketEstablished = 0x17;
+		constexpr uint8_t socketCloseWait = 0x1C;
+
+		for (byte socket = 0; socket < MAX_SOCK_NUM; socket++)
+		{
+			if (!(ours & (1UL << socket)))
+			{
+				//  Ethernet.socketStatus() is private, a client can ask on our behalf.
+				uint8_t status = EthernetClient(socket).status();
+
+				if ((status == socketEstablished) || (status == socketCloseWait))
+				{
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+};
+#endif
+
+#ifdef YAAWS_ETHERNET_TRANSPORT
+typedef YaawsEthernetTransport YaawsDefaultTransport;
+#else
+typedef YaawsTransport<WebServerType, WebClientType> YaawsDefaultTransport;
+#endif
+
+//  A file system - the volume the site is on, and its files.  The features marked
+//  'SdFat only' use methods the SdFat classes have, 'sdFat' says that they're there.
+template <class VolumeType, class FileType>
+struct YaawsFileSystem
+{
+	typedef VolumeType Volume;
+	typedef FileType File;
+
+	static constexpr bool sdFat = false;
+};
+
+#ifdef SdFat_h
+//  SdFat, with the card on SPI.
+struct YaawsSdFatFileSystem : YaawsFileSystem<SdFileSystem<SdSpiCard>, SdFile>
+{
+	static constexpr bool sdFat = true;
+};
+#endif
+
+#ifdef YAAWS_SDFAT_FILESYSTEM
+typedef YaawsSdFatFileSystem YaawsDefaultFileSystem;
+#else
+typedef YaawsFileSystem<webSdCard, WebFileType> YaawsDefaultFileSystem;
+#endif
+
+//  How a server is set up.  The defaults come from the #defines above, so 'YAAWS' works
+//  as it always has.  For a server that is different, derive from this and give what
+//  changes:
+//
+//    struct SmallConfig : YaawsConfig
+//    {
+//        static constexpr byte maxClients = 1;
+//        static constexpr bool only404Errors = true;
+//    };
+//
+//    BasicYaaws<YaawsDefaultTransport, YaawsDefaultFileSystem, SmallConfig> small(card);
+//
+//  YAAWS_GET_IS_ALL_WE_NEED and YAAWS_NOTHING_EVER_CHANGES also take methods out of
+//  YaawsCallback, so once defined, no server can turn them back off.
+struct YaawsConfig
+{
+	//  Simultaneous connections, 1 to 32.
+#ifdef YAAWS_ONE_STREAM_ONLY
+	static constexpr byte maxClients = 1;
+#else
+	static constexpr byte maxClients = YAAWS_MAX_CLIENTS;
+#endif
+
+	//  GET and HEAD only, POST is refused.
+#ifdef YAAWS_GET_IS_ALL_WE_NEED
+	static constexpr bool getIsAllWeNeed = true;
+#else
+	static constexpr bool getIsAllWeNeed = false;
+#endif
+
+	//  Never ask the callback whether a file is mutable.
+#ifdef YAAWS_NOTHING_EVER_CHANGES
+	static constexpr bool nothingEverChanges = true;
+#else
+	static constexpr bool nothingEverChanges = false;
+#endif
+
+	//  Every error is reported as a 404.
+#ifdef YAAWS_404_THE_ONE_TRUE_ERROR
+	static constexpr bool only404Errors = true;
+#else
+	static constexpr bool only404Errors = false;
+#endif
+
+	//  Flash the built-in LED on activity.
+#ifdef YAAWS_NO_FLASHY_FLASHY
+	static constexpr bool flashyFlashy = false;
+#else
+	static constexpr bool flashyFlashy = true;
+#endif
+};
 
 
 //
@@ -103,83 +683,897 @@ typedef SdFile WebFileType;
 //  version of SdFat.
 //
 
-class YaawsCallback;
+template <class Client, class File> class BasicYaawsCallback;
+
+//  The callback for the default transport and file system.
+typedef BasicYaawsCallback<WebClientType, WebFileType> YaawsCallback;
+
+#ifdef YAAWS_FLASH_SITE
+//  One file of a flash site.  'extras/yaaws_flash.py' generates a PROGMEM array of these,
+//  sorted by path (ignoring case).  'path' and 'data' must also be in PROGMEM.
+struct YaawsFlashFile
+{
+	const char *path;           //  URL path, e.g. "/index.html"
+	const uint8_t *data;
+	uint32_t length;
+	uint32_t etag;
+	uint8_t rt;                 //  'Content-type', a YAAWS::ResponseType value
+	uint8_t flags;              //  YAAWS_FLASH_GZIP, YAAWS_FLASH_CACHEABLE
+};
+
+#define YAAWS_FLASH_GZIP      0x01  //  Data is gzip'd
+#define YAAWS_FLASH_CACHEABLE 0x02  //  Never changes, clients may cache it
+#endif
+
+#ifdef YAAWS_GZIP_STREAM
+//  Streaming gzip compressor.  Fed as the response is written, and hands back the
+//  compressed data a piece at a time through a small output buffer.  Input is held back
+//  (up to half the window) until there is enough of it to look for repeats in.
+class YaawsDeflate
+{
+public:
+	static constexpr uint16_t WINDOW = YAAWS_GZIP_WINDOW;
+
+	static_assert((WINDOW >= 256) && (WINDOW <= 32768) && ((WINDOW & (WINDOW - 1)) == 0),
+				  "YAAWS_GZIP_WINDOW must be a power of two, 256 to 32768");
+
+	YaawsDeflate() : _busy(false) {}
+
+	//  One stream at a time.  'Start' claims the compressor and writes the gzip header,
+	//  'Finish' (once it returns true) releases it again.
+	bool Busy() const { return _busy; }
+	void Start();
+	void Abandon() { _busy = false; }
+
+	//  Take in as much of 'buf' as there is room for, returning how much that was.
+	size_t Compress(const uint8_t *buf, size_t size);
+
+	//  Compress everything held back and end the stream.  False if the output buffer
+	//  must be emptied first.
+	bool Finish();
+
+	const uint8_t *Output() const { return _out; }
+	uint8_t OutputLength() const { return _outLength; }
+	bool OutputFull() const { return _outLength > OUT_SIZE - OUT_SLACK; }
+	void OutputSent() { _outLength = 0; }
+
+private:
+	static constexpr uint16_t HASH_SIZE = 256;  //  'Hash' gives a byte
+	static constexpr uint16_t MAX_MATCH = 258;
+	static constexpr uint16_t LOOKAHEAD = (WINDOW / 4 < MAX_MATCH) ? WINDOW / 4 : MAX_MATCH;
+	static constexpr uint8_t OUT_SIZE = 128;
+	static constexpr uint8_t OUT_SLACK = 8;  //  Room for one symbol, with its extra bits
+
+	uint8_t At(uint32_t position) const { return _window[position & (WINDOW - 1)]; }
+	uint8_t Hash(uint32_t position) const  //  Of the three bytes there, one per entry
+	{
+		return (At(position) * 33 + At(position + 1)) * 33 + At(position + 2);
+	}
+	void EncodeNext();
+	void PutBits(uint16_t value, uint8_t count);
+	void PutCode(uint16_t code, uint8_t length);
+	void PutSymbol(uint16_t symbol);
+	void PutByte(uint8_t b) { _out[_outLength++] = b; }
+	void PutLong(uint32_t value);
+
+	bool _busy;
+	uint32_t _in;               //  Next byte to compress
+	uint32_t _end;              //  End of the input taken in
+	uint32_t _crc;
+	uint32_t _bits;             //  Bits not yet a whole byte
+	uint8_t _bitCount;
+	uint8_t _outLength;
+	uint16_t _head[HASH_SIZE];  //  Where each hash of three bytes was last seen
+	uint8_t _window[WINDOW];
+	uint8_t _out[OUT_SIZE];
+};
+#endif
+
+#ifdef YAAWS_BUFFERED_CLIENT
+//  A client connection that buffers what is written to it, and (with YAAWS_GZIP_STREAM)
+//  can compress it.  Callbacks still see it as a plain 'Client'.
+template <class Client>
+class YaawsBufferedClient : public Client
+{
+public:
+	YaawsBufferedClient()
+	{
+#ifdef YAAWS_WRITE_COMBINING
+		_pending = 0;
+#endif
+#ifdef YAAWS_GZIP_STREAM
+		_deflate = nullptr;
+#endif
+	}
+
+	YaawsBufferedClient &operator=(const Client &client)
+	{
+		Client::operator=(client);
+#ifdef YAAWS_WRITE_COMBINING
+		_pending = 0;
+#endif
+#ifdef YAAWS_GZIP_STREAM
+		if (_deflate != nullptr)
+		{
+			_deflate->Abandon();
+			_deflate = nullptr;
+		}
+#endif
+		return *this;
+	}
+
+	size_t write(uint8_t b) override;
+	size_t write(const uint8_t *buf, size_t size) override;
+	using Print::write;
+
+	int availableForWrite() override;
+	void flush() override;
+	void stop();
+
+	//  Send anything buffered.
+	void Send();
+
+#ifdef YAAWS_GZIP_STREAM
+	//  Everything written from now on is gzip'd with 'deflate', until 'EndCompression'.
+	void Compress(YaawsDeflate &deflate);
+	void EndCompression();
+#endif
+
+private:
+	size_t RawWrite(const uint8_t *buf, size_t size);
+
+#ifdef YAAWS_GZIP_STREAM
+	void SendCompressed();
 
-typedef SdFileSystem<SdSpiCard> webSdCard;
+	YaawsDeflate *_deflate;     //  Compressing through this, if not null
+#endif
+#ifdef YAAWS_WRITE_COMBINING
+	void SendBuffer();
+
+	uint16_t _pending;
+	uint8_t _buffer[YAAWS_WRITE_BUFFER_SIZE];
+#endif
+};
+#endif
+
+//  Compile time type selection, used to pick the smallest type that will hold a bit mask
+//  of all the connections.
+template <bool B, class T, class F> struct YaawsSelect { typedef T type; };
+template <class T, class F> struct YaawsSelect<false, T, F> { typedef F type; };
 
-class YAAWS
+//  Internal - the part of the web server that is the same for every kind of BasicYaaws,
+//  so it is compiled once (in YAAWS.cpp) however many kinds a sketch has.
+class YaawsBase
 {
 public:
+	//  All the different HTML 'Content-types' supported.
+	enum ResponseType : byte
+	{
+		htm404,
+		htm200,
+		jpg200,
+		gif200,
+		png200,
+		bmp200,
+		ico200,
+		svg200,
+		txt200,
+		js200,
+		css200,
+		csv200,
+		eot200,
+		woff200,
+		woff2200,
+		ttf200,
+		json200,
+		default200,  //  Everything else
+		UNKNOWN,     //  Response type not yet identified
+		FINISHED     //  Response has been sent
+	};
+
+	//  The request methods we know.
+	enum RequestType
+	{
+		rtGet,
+		rtHead,
+		rtPost,
+		rtUnknown
+	};
+
+#ifdef YAAWS_STATISTICS
+	//  Times the request parsing helpers on canned input, and prints the results as a
+	//  JSON object (nanoseconds per call).  Takes a few hundred milliseconds.
+	static void PrintBenchmarks(Print &out);
+#endif
+
+protected:
+	//  Lights the built-in LED for as long as one is in scope, if 'On'.
+	template <bool On>
+	class Flashy
+	{
+	public:
+		//  Does nothing, but stops 'FlashyFlashy ff;' being warned about as unused.
+		Flashy() {}
+
+		static void Begin() {}
+	};
+
+	static ResponseType GetResponseType(const char *filename);
+	static RequestType GetRequestType(char *str);
+	static void urldecode2(char *srcdst);
+	static int freeRam();
+
+	//  Index of the lowest set bit in a connection mask.  'mask' must not be zero.
+	//  Compiles down to the count-trailing-zeros instruction where the CPU has one.
+	template <class T>
+	static byte FirstSetBit(T mask)
+	{
+		return (sizeof(T) <= sizeof(unsigned)) ? __builtin_ctz(mask) : __builtin_ctzl(mask);
+	}
+
+	//  Text for the HTML Response headers, and the 'Content-Type' of each ResponseType.
+	static const char str200Header[] PROGMEM;
+	static const char strCacheable[] PROGMEM;
+	static const char strNonCacheable[] PROGMEM;
+	static const char *const aResponses[] PROGMEM;
+
+#ifndef YAAWS_GET_IS_ALL_WE_NEED
+	static const char contentLengthMarker[] PROGMEM;
+#ifdef YAAWS_ACCEPT_ENCODING
+	static const char acceptEncodingMarker[] PROGMEM;
+#endif
+
+	static bool MatchMarker(const char *marker, const char *&pMatch, byte l);
+#endif
+#if defined(YAAWS_AUTOINDEX) || defined(YAAWS_LOG_TAIL) || defined(YAAWS_CSV_INDEX)
+	static long QueryNumber(const char *query, const char *name, long defaultValue);
+#endif
+#if YAAWS_SCHEDULER != YAAWS_SCHEDULE_ROUND_ROBIN
+	//  Highest priority a request can have.  Each level doubles the share of the link.
+	static constexpr byte MAX_PRIORITY = 3;
+#endif
+#ifdef YAAWS_BODY_SOURCES
+	//  Where the response body comes from.
+	enum BodySource : byte
+	{
+		srcSdFile,   //  'sdFile'
+		srcPacked,   //  The packed site archive
+		srcFlash     //  The flash site
+	};
+
+	//  Flags for each file in the packed site archive or flash site.
+	static constexpr byte bodyGzip = 0x01;       //  Stored gzip'd
+	static constexpr byte bodyCacheable = 0x02;  //  Never changes, clients may cache it
+#endif
+#if defined(YAAWS_PACKED_SITE) || defined(YAAWS_PATH_CACHE)
+	//  FNV-1a hash of a path, ignoring case (FAT doesn't care either).  Never 0.
+	static uint32_t PathHash(const char *path, size_t length = SIZE_MAX);
+#endif
+#ifdef YAAWS_PATH_CACHE
+	template <class File>
+	static bool HasName(File &file, const char *name);
+#endif
+#ifdef YAAWS_PACKED_SITE
+	//  Packed site archive layout (all values little-endian):
+	//   - PackHeader
+	//   - 'buckets' PackEntry records, an open addressed hash table of the files
+	//   - for each file, its path (no NUL) immediately followed by its contents
+	//  'extras/yaaws_pack.py' builds these, keep the two in step.
+	static const char packMagic[] PROGMEM;
+	static constexpr uint16_t packVersion = 1;
+
+	struct PackHeader
+	{
+		char magic[4];
+		uint16_t version;
+		uint16_t reserved;
+		uint32_t buckets;       //  Power of two
+		uint32_t files;
+	};
+
+	struct PackEntry
+	{
+		uint32_t hash;          //  0 marks an empty bucket
+		uint32_t offset;        //  Start of the contents, the path is just before it
+		uint32_t length;
+		uint32_t etag;
+		uint8_t pathLength;
+		uint8_t rt;             //  ResponseType
+		uint8_t flags;          //  bodyGzip, bodyCacheable
+		uint8_t reserved;
+	};
+
+	static_assert(sizeof(PackHeader) == 16, "Packed site header layout");
+	static_assert(sizeof(PackEntry) == 20, "Packed site index layout");
+#endif
+#if defined(YAAWS_AUTOINDEX) || defined(YAAWS_ACCESS_LOG)
+	static char *AppendP(char *dst, const char *src);
+	static char *AppendNumber(char *dst, unsigned long value, byte digits = 1);
+#endif
+#ifdef YAAWS_AUTOINDEX
+	//  Progress through a directory listing.
+	enum ListingState : byte
+	{
+		lsNone,      //  Not a listing, serving a file
+		lsDone,      //  Listing finished (or HEAD request, no listing wanted)
+		lsPrologue,  //  Start of the document still to be sent
+		lsEntries,   //  Sending directory entries
+		lsEpilogue,  //  End of the document still to be sent
+		lsEpilogueMore  //  Same, and there are entries past 'limit='
+	};
+
+	static const char strListPrologue[] PROGMEM;
+	static const char strJsonPrologue[] PROGMEM;
+
+	//  Room for the longest line of a listing - a name percent-encoded for the link
+	//  (up to three characters for each of its own), then escaped for the text.
+	static constexpr size_t listingLineSize = 4 * YAAWS_AUTOINDEX_NAME_MAX + 128;
+
+	static char *AppendEscaped(char *dst, const char *end, const char *src, bool json);
+	static char *AppendUrlEncoded(char *dst, const char *end, const char *src);
+	static char *AppendFatTime(char *dst, uint16_t date, uint16_t time, bool json);
+#endif
+#ifdef YAAWS_CSV_INDEX
+	//  Progress finding the rows of a CSV file in a time range.
+	enum CsvPhase : byte
+	{
+		csvNone,                //  Not a range query, or the range has been found
+		csvIndex,               //  Bringing the index up to date
+		csvStart,               //  Looking for the first row in the range
+		csvEnd                  //  Looking for the first row after it
+	};
+
+	//  A CSV index file is this header, then the time and position of every
+	//  YAAWS_CSV_INDEX_ROWS'th row.
+	struct CsvIndexHeader
+	{
+		char magic[4];
+		uint32_t scanned;       //  Length of the CSV file indexed, always whole rows
+		uint32_t rows;          //  Rows in that length
+	};
+
+	struct CsvIndexEntry
+	{
+		uint32_t time;
+		uint32_t offset;
+	};
+
+	static const char csvIndexMagic[] PROGMEM;
+
+	static uint32_t RowTime(const byte *row, size_t length);
+#endif
+#ifdef YAAWS_GZIP_STREAM
+	//  Content types worth compressing.
+	static bool IsText(ResponseType rt);
+#endif
+#ifdef YAAWS_OVERLOAD_REJECT
+	static void WriteOverload(Print &client);
+#endif
+#ifdef YAAWS_STATISTICS
+	static byte HistogramBucket(unsigned long value);
+	static void PrintHistogram(Print &out, const __FlashStringHelper *name,
+							   const unsigned long *histogram, unsigned long maximum);
+#endif
+#ifdef YAAWS_STACK_USAGE
+	static constexpr byte stackPaint = 0xC5;
+
+	//  Stack within this many bytes of the caller is never painted, so 'memset' and the
+	//  measuring code have room for their own frames.
+	static constexpr uint16_t stackMargin = 64;
+
+	//  A run this long of the pattern is taken to be stack that hasn't been used.
+	static constexpr byte stackRun = 8;
+
+	static byte *StackBottom();
+#endif
+#ifdef YAAWS_ACCESS_LOG
+	static const char strMethods[] PROGMEM;
+
+	static char *AppendLogTime(char *dst, uint32_t time);
+#endif
+};
+
+#ifdef LED_BUILTIN
+template <>
+class YaawsBase::Flashy<true>
+{
+public:
+	Flashy() { digitalWrite(LED_BUILTIN, HIGH); }
+	~Flashy() { digitalWrite(LED_BUILTIN, LOW); }
+
+	static void Begin()
+	{
+		pinMode(LED_BUILTIN, OUTPUT);
+		digitalWrite(LED_BUILTIN, LOW);
+	}
+};
+#endif
+
+template <class Transport = YaawsDefaultTransport,
+		  class FileSystem = YaawsDefaultFileSystem, class Config = YaawsConfig>
+class BasicYaaws : public YaawsBase
+{
+public:
+	typedef typename Transport::Server ServerType;
+	typedef typename Transport::Client ClientType;
+	typedef typename FileSystem::Volume VolumeType;
+	typedef typename FileSystem::File FileType;
+	typedef BasicYaawsCallback<ClientType, FileType> CallbackType;
 
 	//  If you provide a 'webRoot' string, it MUST be declared in PROGMEM, e.g.  like this
 	//  - PSTR("/WebStuff").  Default values are '/WWW' as the web root, and port 80.
-	YAAWS(webSdCard &SdCard,
-		  const char *webRoot = nullptr, uint16_t port = 80);
+	BasicYaaws(VolumeType &SdCard,
+			   const char *webRoot = nullptr, uint16_t port = 80);
 
-	YAAWS(webSdCard &SdCard, YaawsCallback &callback,
-		  const char *webRoot = nullptr, uint16_t port = 80);
+	BasicYaaws(VolumeType &SdCard, CallbackType &callback,
+			   const char *webRoot = nullptr, uint16_t port = 80);
 
 	//  Initialize the web server.  If this returns false, check that your Ethernet and SD
 	//  card are working properly.
 	bool begin();
 
+#if YAAWS_MAX_LISTENERS > 1
+	//  Also accept connections from 'server' (an extra server you declare, with its own
+	//  port), serving files from 'webRoot' (in PROGMEM, as for the constructor) and
+	//  passing its requests to 'callback'.  'reserved' connections are kept for this
+	//  listener only.  False if there are already YAAWS_MAX_LISTENERS listeners, or more
+	//  connections would be reserved than there are.
+	bool AddListener(ServerType &server, CallbackType &callback,
+					 const char *webRoot = nullptr, byte reserved = 0);
+
+	//  Change how many connections are kept for a listener.  Listener 0 is the port given
+	//  to the constructor, the others are numbered in the order they were added.
+	bool ReserveConnections(byte reserved, byte listener = 0);
+#endif
+
+#ifdef YAAWS_FLASH_SITE
+	//  Files to serve from flash.  'files' is a PROGMEM array, sorted by path.
+	void SetFlashSite(const YaawsFlashFile *files, size_t count)
+	{
+		_flashFiles = files;
+		_flashCount = count;
+	}
+#endif
+
 	//  Call whenever you can to receive and service requests.  Typical call time is up to
 	//  about 10 milliseconds on a 2650, *if* there is work to do.  When idle there is
 	//  alomost no overhead.
 	void ServiceWebServer();
 
-	enum ResponseType : byte;
+	//  For sketches that want to sleep, or run other work, rather than call
+	//  'ServiceWebServer' in a tight loop.  'HasPendingWork' is true if a call now would
+	//  get something done - a connection has arrived (or might have, see below), has sent
+	//  its request, or has room in its socket for more of the response.  It is a few SPI
+	//  reads, much cheaper than a call.  'NextDeadlineMicros' is how long until the server
+	//  should be called even if nothing changes: 0 if there is work now, the time to the
+	//  next look for new connections with YAAWS_ACCEPT_INTERVAL_MICROS, or 0xFFFFFFFF if
+	//  there is nothing to wait for.
+	//
+	//  On Ethernet, a new connection shows as a socket in the 'established' state that
+	//  isn't one of ours.  Connections your sketch makes itself look the same, so
+	//  'HasPendingWork' may sometimes be true with nothing for the server to do.  On other
+	//  transports, a new connection can only be found by looking, so this is true
+	//  whenever a look is due.
+	bool HasPendingWork();
+	unsigned long NextDeadlineMicros();
+
+#ifdef YAAWS_OVERLOAD_REJECT
+	//  Number of connections turned away with a 503 because all connections were busy.
+	unsigned long RejectedConnections() const { return _rejectedConnections; }
+#endif
+
+#ifdef YAAWS_STATISTICS
+	//  Statistics since 'begin' (or the last reset) as a JSON object.  Latencies are
+	//  from a histogram, so the percentiles are rounded up to a power of two.
+	void PrintStatistics(Print &out);
+	void ResetStatistics();
+#endif
+
+#if defined(YAAWS_PATH_CACHE) || defined(YAAWS_SECTOR_CACHE)
+	//  Forget everything the path and sector caches know.  Call after changing files on
+	//  the card.
+	void InvalidateCache();
+#endif
+
+#ifdef YAAWS_SECTOR_CACHE
+	unsigned long SectorCacheHits() const { return _sectorHits; }
+	unsigned long SectorCacheMisses() const { return _sectorMisses; }
+#endif
+
+#ifdef YAAWS_ACCESS_LOG
+	//  Requests that weren't logged because the log couldn't keep up.
+	unsigned long AccessLogDropped() const { return _logDropped; }
+#endif
+
+#ifdef YAAWS_CALL_TARGET_MICROS
+	//  Largest piece of a file that will currently be sent in one call.
+	uint16_t ChunkSize() const { return _chunkSize; }
+#endif
+
+#ifdef YAAWS_STACK_USAGE
+	enum StackPhase : byte
+	{
+		stackAccept,                //  Reading and checking the request
+		stackHeader,                //  Sending the response header
+		stackFileAction,            //  In the callback's 'FileAction'
+		stackSend,                  //  Sending the body
+		STACK_PHASES
+	};
+
+	//  Deepest the stack has gone below 'ServiceWebServer' in each phase, and the least
+	//  free RAM there has been between the heap and the stack.  Depths under 64 bytes
+	//  show as 64.
+	uint16_t StackUsed(StackPhase phase) const { return _stackUsed[phase]; }
+	size_t StackHeadroom() const { return _stackHeadroom; }
+
+	//  The same, as a JSON object.
+	void PrintStackUsage(Print &out);
+#endif
+
 private:
+	//  Lights the built-in LED while busy, if the config wants it.
+	typedef Flashy<Config::flashyFlashy> FlashyFlashy;
 
+#ifdef YAAWS_BUFFERED_CLIENT
+	typedef YaawsBufferedClient<ClientType> ConnectionClientType;
+#else
+	typedef ClientType ConnectionClientType;
+#endif
 
-	ResponseType GetResponseType(const char *filename);
 	void SendResponseHeader();
 	void FinishConnection();
 
 	void SendSdFile();
+	uint32_t BodyPosition();
+	uint32_t BodyLeft(byte slot);
+	int SpaceWanted(byte slot);
+	int ReadBody(byte *pBuffer, int amount);
+#ifdef YAAWS_SD_PREFETCH
+	void Prefetch();
+#endif
+#ifdef YAAWS_AUTOINDEX
+	void SendDirListing();
+#endif
+#ifdef YAAWS_CSV_INDEX
+	void QueryCsv();
+	bool OpenCsvIndex();
+	void CloseCsvIndex();
+	bool UpdateCsvIndex();
+	uint32_t SearchCsvIndex(uint32_t time);
+	bool ScanCsvRows(uint32_t &position, uint32_t time);
+#endif
+#ifdef YAAWS_LOG_TAIL
+	void StartTail(long tail, bool follow, const char *path);
+	bool IsFollowWaiting(byte slot);
+	void FollowFile();
+#endif
 	void ContinueRequest();
 
+	//  Each of these takes the request buffer, for a 404 if that's the only error
+	//  reported.
 	void Return404(char *fileNameBuffer);
-#ifndef YAAWS_404_THE_ONE_TRUE_ERROR
-	void Return400BadRequest();
-	void Return405MethodNotAllowed();
-	void Return414UriTooLong();
+	void Return400BadRequest(char *fileNameBuffer);
+	void Return405MethodNotAllowed(char *fileNameBuffer);
+	void Return414UriTooLong(char *fileNameBuffer);
+#ifdef YAAWS_BODY_SOURCES
+	void Return406NotAcceptable(char *fileNameBuffer);
+#endif
+#ifdef YAAWS_OVERLOAD_REJECT
+	void RejectOverload(ServerType &server);
 #endif
 	void AcceptIncoming();
+#ifdef YAAWS_BODY_SOURCES
+	bool OpenBuiltIn(const char *path, bool &refused);
+#endif
+#ifdef YAAWS_PACKED_SITE
+	bool OpenPacked(const char *path);
+#endif
+#ifdef YAAWS_FLASH_SITE
+	bool OpenFlash(const char *path);
+#endif
 	void AdvanceServiceIndex();
+	void ServiceConnections();
+	byte NextActiveAfter(byte slot);
+#if YAAWS_SCHEDULER == YAAWS_SCHEDULE_SHORTEST
+	byte ShortestRemaining();
+#endif
 	const char *GetWebRoot();
+#if YAAWS_MAX_LISTENERS > 1
+	bool CanAccept(byte listener);
+	ServerType &ListenerServer(byte listener) { return *_listeners[listener].server; }
+#else
+	bool CanAccept(byte) { return true; }
+	ServerType &ListenerServer(byte) { return _server; }
+#endif
+
+	//  Callback for the connection being serviced.
+	CallbackType &Callback()
+	{
+#if YAAWS_MAX_LISTENERS > 1
+		return *_listeners[_contData[_serviceIndex].listener].callback;
+#else
+		return _callback;
+#endif
+	}
 
 
-	EthernetServer _server;
-	webSdCard &_SdCard;
-	YaawsCallback &_callback;
+	//  For servers made without a callback of their own.
+	static CallbackType _defaultCallback;
+
+	ServerType _server;
+	VolumeType &_SdCard;
+	CallbackType &_callback;
 	const char *_webRoot;
 
-#ifndef YAAWS_ONE_STREAM_ONLY
-	//  4 works on all 5X00 chips.  5500 might support more, but do you really need to?
-	static constexpr size_t MAX_CLIENTS = 4;
+	static constexpr size_t MAX_CLIENTS = Config::maxClients;
+
+#ifdef YAAWS_RESERVE_LISTENER_SOCKET
+	static_assert(MAX_CLIENTS + YAAWS_MAX_LISTENERS <= Transport::maxSockets,
+				  "maxClients must leave a socket free for each listener");
 #else
-	static constexpr size_t MAX_CLIENTS = 1;
+	static_assert(MAX_CLIENTS <= Transport::maxSockets,
+				  "maxClients is larger than the number of sockets");
+#endif
+	static_assert((MAX_CLIENTS > 0) && (MAX_CLIENTS <= 32),
+				  "maxClients must be between 1 and 32");
+#ifdef YAAWS_GET_IS_ALL_WE_NEED
+	static_assert(Config::getIsAllWeNeed,
+				  "YAAWS_GET_IS_ALL_WE_NEED has taken POST out of every server");
+#endif
+#ifdef YAAWS_NOTHING_EVER_CHANGES
+	static_assert(Config::nothingEverChanges,
+				  "YAAWS_NOTHING_EVER_CHANGES has taken 'FileAction' out of every server");
+#endif
+#ifdef YAAWS_CSV_INDEX
+	static_assert(FileSystem::sdFat, "YAAWS_CSV_INDEX needs the SdFat file system");
+#endif
+#ifdef YAAWS_PATH_CACHE
+	static_assert(FileSystem::sdFat, "YAAWS_PATH_CACHE needs the SdFat file system");
+#endif
+#ifdef YAAWS_SECTOR_CACHE
+	static_assert(FileSystem::sdFat, "YAAWS_SECTOR_CACHE needs the SdFat file system");
+#endif
+
+#if YAAWS_MAX_LISTENERS > 1
+	//  A port we accept connections on.  The first is the one given to the constructor.
+	struct Listener
+	{
+		ServerType *server;
+		CallbackType *callback;
+		const char *webRoot;    //  In PROGMEM, nullptr for the default
+		byte reserved;          //  Connections kept for this listener
+	};
+
+	Listener _listeners[YAAWS_MAX_LISTENERS];
+	byte _listenerCount;
 #endif
+
+	//  Smallest type that has one bit per connection, and the type we do our shifting in
+	//  (so that we never shift into the sign bit of a promoted 'int').
+	typedef typename YaawsSelect<(MAX_CLIENTS <= 8), uint8_t,
+		typename YaawsSelect<(MAX_CLIENTS <= 16), uint16_t,
+		uint32_t>::type>::type SlotMask;
+	typedef typename YaawsSelect<(sizeof(SlotMask) <= sizeof(unsigned)),
+		unsigned, unsigned long>::type SlotShift;
+
+	static constexpr SlotMask SlotBit(byte slot)
+	{
+		return static_cast<SlotMask>(SlotShift(1) << slot);
+	}
+
 	//  Data we need to allow the request to be 'continued'.  In particular, the file is
 	//  served in numerous chunks, one at each call to 'ServiceWebServer'.
 	struct ContinuationData
 	{
-		EthernetClient client;  // Connection to the client (requestor)
-		WebFileType sdFile;     // File to be returned.
+		ConnectionClientType client;  // Connection to the client (requestor)
+		FileType sdFile;        // File to be returned.
 		ResponseType rt;        // 'Content-type' of the file.
+		uint32_t bodyEnd;       //  Where the response body ends in the file
+		bool headOnly;          //  HEAD request, send only the header
+#ifdef YAAWS_BODY_SOURCES
+		byte source;            //  Where the body comes from - 'sdFile', archive, flash
+		byte bodyFlags;         //  Flags for the body (gzip'd, cacheable)
+		uint32_t bodyPos;       //  Next byte to send, for bodies not in 'sdFile'
+		uint32_t etag;          //  ETag for the body
+#ifdef YAAWS_FLASH_SITE
+		const uint8_t *flashData;  //  Body data, for flash files
+#endif
+#endif
 #ifndef YAAWS_NOTHING_EVER_CHANGES
 		bool doFileAction;      //  Do we need to continue calling FileAction()
+#endif
+#ifdef YAAWS_SECTOR_CACHE
+		bool shareSectors;      //  Read the file through the sector cache
+#endif
+#ifdef YAAWS_ACCEPT_ENCODING
+		bool acceptGzip;        //  Client sent 'Accept-Encoding: gzip'
+#endif
+#ifdef YAAWS_CSV_INDEX
+		byte csvPhase;          //  Progress finding a time range, or 'not a range'
+		uint32_t csvFrom;       //  Times asked for
+		uint32_t csvTo;
+		uint32_t csvStart;      //  Where the range starts, or how far we've looked
+		uint32_t csvEnd;        //  Where it ends, likewise
+#endif
+#ifdef YAAWS_LOG_TAIL
+		bool follow;            //  Keep sending what is added to the file
+		unsigned long followMillis;  //  When we last looked for more
+		char followPath[YAAWS_FOLLOW_PATH];  //  To open the file again
+#endif
+#ifdef YAAWS_SD_PREFETCH
+		uint16_t prefetchStart;   //  First staged byte not yet sent
+		uint16_t prefetchEnd;     //  End of the staged bytes
+		byte prefetch[YAAWS_PREFETCH_SIZE];
+#endif
+#ifdef YAAWS_AUTOINDEX
+		byte listing;           //  Directory listing progress, or 'not a listing'
+		bool listJson;          //  List as JSON rather than HTML
+		uint16_t listIndex;     //  Next directory entry to look at
+		uint16_t listFrom;      //  First entry to list ('offset=')
+		uint16_t listTo;        //  Stop listing at this entry ('offset=' + 'limit=')
+#endif
+#if YAAWS_SCHEDULER != YAAWS_SCHEDULE_ROUND_ROBIN
+		byte priority;          //  From 'RequestPriority', 0 is the lowest
+#endif
+#if YAAWS_MAX_LISTENERS > 1
+		byte listener;          //  Which listener the connection came in on
+#endif
+#if YAAWS_SCHEDULER == YAAWS_SCHEDULE_DEFICIT
+		long deficit;           //  Bytes this connection may still send this turn
+#endif
+#if defined(YAAWS_STATISTICS) || defined(YAAWS_ACCESS_LOG)
+		unsigned long startMillis;  //  When the connection was accepted
+#endif
+#ifdef YAAWS_ACCESS_LOG
+		uint16_t logStatus;     //  HTTP status sent, 0 if there's nothing to log
+		byte logMethod;         //  GET, HEAD, POST
+		char logVersion;        //  HTTP minor version, '0' or '1'
+		uint32_t logBytes;      //  Size of the body when the header was sent
+		char logPath[YAAWS_ACCESS_LOG_PATH];  //  Request URI, perhaps cut short
+#endif
+#ifdef YAAWS_CONTEXT_SIZE
+		alignas(max_align_t) byte context[YAAWS_CONTEXT_SIZE];  //  For the callback
 #endif
 	};
 
-	static constexpr byte clientsMask = (1 << MAX_CLIENTS) - 1;
+	static constexpr SlotMask clientsMask =
+		static_cast<SlotMask>((SlotShift(1) << (MAX_CLIENTS - 1)) * 2 - 1);
 	ContinuationData _contData[MAX_CLIENTS];
-	byte _activeConnections;    //  Bit mask showing which connections are active.
-#ifndef YAAWS_ONE_STREAM_ONLY
+#ifdef YAAWS_FLASH_SITE
+	const YaawsFlashFile *_flashFiles;  //  Flash site index, in PROGMEM
+	size_t _flashCount;
+#endif
+#ifdef YAAWS_GZIP_STREAM
+	YaawsDeflate _deflate;      //  Shared by all connections, one response at a time
+#endif
+#ifdef YAAWS_CSV_INDEX
+	FileType _csvIndex;         //  Index being worked on, shared by all connections
+	byte _csvIndexOwner;        //  Connection using it, or MAX_CLIENTS if none
+	uint32_t _csvScanned;       //  How much of the CSV file the index covers
+	uint32_t _csvRows;          //  Rows in that part
+#endif
+#ifdef YAAWS_PACKED_SITE
+	FileType _packFile;         //  The packed site archive, shared by all connections
+	uint32_t _packBuckets;      //  Size of its hash index, 0 if there is no archive
+#endif
+	SlotMask _activeConnections;  //  Bit mask showing which connections are active.
 	byte _serviceIndex;         //  Connection we are servicing
-#else
-	static constexpr byte _serviceIndex = 0;
+#ifdef YAAWS_OVERLOAD_REJECT
+	unsigned long _rejectedConnections;
+#endif
+#ifdef YAAWS_STATISTICS
+	//  Histograms have one bucket per power of two, the last one catches everything
+	//  bigger.
+	static constexpr byte HISTOGRAM_BUCKETS = 16;
+
+	struct Statistics
+	{
+		unsigned long startMillis;
+		unsigned long requests;
+		unsigned long bytesSent;
+		unsigned long serviceCalls;
+		unsigned long maxCallMicros;
+		unsigned long maxLatencyMillis;
+		unsigned long callMicros[HISTOGRAM_BUCKETS];
+		unsigned long latencyMillis[HISTOGRAM_BUCKETS];
+	};
+
+	Statistics _stats;
+#endif
+#ifdef YAAWS_PATH_CACHE
+	struct PathCacheEntry
+	{
+		uint32_t hash;              //  Of the full path, 0 if unused
+		uint32_t dirHash;           //  Of its directory, 0 if the path doesn't exist
+		uint16_t index;             //  Entry number within the directory
+		byte length;                //  Of the path (cut to 255), as a check on the hash
+		unsigned long missMillis;   //  When it was found not to exist
+	};
+
+	struct DirCacheEntry
+	{
+		uint32_t hash;
+		FileType dir;
+	};
+
+	PathCacheEntry _pathCache[YAAWS_PATH_CACHE_SIZE];
+	DirCacheEntry _dirCache[YAAWS_PATH_CACHE_DIRS];
+	byte _pathCacheNext;        //  Entries are replaced in turn
+	byte _dirCacheNext;
+
+	bool OpenPath(FileType &file, char *path);
+	FileType *CachedDir(char *path, char *end, uint32_t hash);
+	void ForgetMissing();
+#endif
+#ifdef YAAWS_SECTOR_CACHE
+	//  A file is known by its first cluster, slot in its directory and size, so one
+	//  deleted and written again on the same cluster isn't served the old one's sectors.
+	struct SectorCacheEntry
+	{
+		uint32_t cluster;           //  First cluster of the file, 0 if unused
+		uint32_t size;              //  Length of the file
+		uint16_t dirIndex;          //  Its slot in its directory
+		uint32_t block;             //  Sector within the file
+		uint16_t length;            //  Bytes held, less than 512 at the end of a file
+		uint16_t used;              //  '_sectorClock' when last used
+		byte data[512];
+	};
+
+	SectorCacheEntry _sectorCache[YAAWS_SECTOR_CACHE_BLOCKS];
+	uint16_t _sectorClock;
+	unsigned long _sectorHits;
+	unsigned long _sectorMisses;
+
+	int ReadCached(FileType &file, byte *pBuffer, int amount);
+#endif
+#ifdef YAAWS_ACCESS_LOG
+	struct LogRecord
+	{
+		uint32_t time;              //  'CurrentTime' when the request finished
+		uint32_t bytes;
+		uint16_t status;
+		uint16_t millis;            //  How long the request took
+		uint8_t address[4];         //  Client IP address
+		byte method;
+		char version;
+		char path[YAAWS_ACCESS_LOG_PATH];
+	};
+
+	LogRecord _logRing[YAAWS_ACCESS_LOG_RECORDS];
+	byte _logFirst;             //  Oldest record in the ring
+	byte _logCount;             //  Records waiting to be written
+	unsigned long _logDropped;
+	FileType _logFile;
+	char _logSector[512];       //  Formatted lines, waiting for a whole sector
+	uint16_t _logFill;
+	unsigned long _logWritten;  //  When we last wrote to the file
+
+	void LogRequest();
+	void ServiceAccessLog();
+	void WriteAccessLog();
+	size_t FormatLogRecord(char *line, const LogRecord &record);
+	byte _logLineDone;          //  How much of the oldest record's line is in the buffer
+#endif
+#ifdef YAAWS_STACK_USAGE
+	uint16_t _stackUsed[STACK_PHASES];
+	size_t _stackHeadroom;
+
+	StackPhase CurrentPhase();
+	void MeasureStack(StackPhase phase, byte *top);
+#endif
+#if YAAWS_ACCEPT_INTERVAL_MICROS
+	unsigned long _lastAcceptPoll;  //  When we last looked for new connections
+#endif
+#ifdef YAAWS_CALL_TARGET_MICROS
+	uint16_t _chunkSize;        //  Most to send in one call, to meet the target
+	uint16_t _microsPerKByte;   //  Running estimate of the cost of sending
+
+	void AdjustChunkSize(unsigned long elapsed, int amount);
+#endif
+#if YAAWS_SCHEDULER == YAAWS_SCHEDULE_DEFICIT
+	unsigned _bytesSent;        //  Bytes of file sent by this call
+#elif YAAWS_SCHEDULER == YAAWS_SCHEDULE_SHORTEST
+	byte _agingCount;           //  Calls since the last round robin turn
 #endif
 
 };
@@ -201,8 +1595,8 @@ private:
 //
 //  'ProcessFormData' is called when a form is submitted with a method of 'GET',
 //  'ProcessPostData' is called when a form is submitted using 'POST'.  'GET' data is
-//  passed directly, 'POST' data is read by the callback from the 'EthernetClient' object
-//  provided.
+//  passed directly, 'POST' data is read by the callback from the client object provided
+//  ('EthernetClient', unless you changed the transport).
 //
 //  'IsMutable' is used to determine which files are available for 'FileAction'.
 //  Read-only files are *never* mutable.
@@ -212,18 +1606,153 @@ private:
 //
 //  In 'FileAction', you can examine or even modify the response, but you MUST send any
 //  part of the file you read and do not want to discard to the requestor yourself,
-//  through the EthernetClient object.  If you return 'true', you will continue to be
+//  through the client object.  If you return 'true', you will continue to be
 //  called until you return 'false', so you don't have to perform all your processing in
 //  one go. Once you return 'false', the webserver will handle sending any remaining part
 //  of the file, and you will not be called again for that request.
 //
 
-class YaawsCallback
+//  Protothread style helpers for 'FileAction', so a page can be written as straight line
+//  code that gives up the processor part way through, rather than as a 'switch' on which
+//  step it is up to.  'state' is a 'YaawsResumePoint' that you keep for the request - in
+//  the request context (YAAWS_CONTEXT_SIZE) or, with one stream, in your callback - and
+//  set to 0 when the request starts.
+//
+//    bool MyHandler::FileAction(WebClientType &client, WebFileType &file, void *context)
+//    {
+//        MyState &my = *static_cast<MyState *>(context);
+//
+//        YAAWS_BEGIN(my.resume);
+//        client.print(F("<html><body>"));
+//        YAAWS_YIELD(my.resume);
+//        for (my.row = 0; my.row < 100; my.row++)
+//        {
+//            YAAWS_WAIT_FOR_SPACE(my.resume, client, 64);
+//            client.println(my.row);
+//        }
+//        YAAWS_END(my.resume);
+//    }
+//
+//  Each yield returns 'true', and the next call carries on from just after it.
+//  'YAAWS_END' returns 'false' to let the server send the rest of the file.  Local
+//  variables are NOT kept across a yield, and yields can't be inside a 'switch' of your
+//  own.
+typedef uint16_t YaawsResumePoint;
+
+#define YAAWS_BEGIN(state) switch (state) { case 0:
+
+#define YAAWS_YIELD(state) \
+	do { (state) = __LINE__; return true; case __LINE__:; } while (0)
+
+#define YAAWS_WAIT_UNTIL(state, condition) \
+	do { (state) = __LINE__; case __LINE__: if (!(condition)) return true; } while (0)
+
+#define YAAWS_WAIT_FOR_SPACE(state, client, amount) \
+	YAAWS_WAIT_UNTIL(state, (client).availableForWrite() >= (int)(amount))
+
+#define YAAWS_END(state) } (state) = 0; return false
+
+
+//  The form and query string helpers, the same for every kind of callback.
+class YaawsCallbackBase
+{
+protected:
+	//  Some utility functions you might find useful.  Declared in the base class like
+	//  this makes them available to any derived class.
+
+	struct queryPair
+	{
+		const char *_name;
+		const char *_value;
+	};
+
+	//  Breaks apart a query string into name / value pairs.  Initially, call with the
+	//  original query string.  Use the return value on subsequent invokations to move
+	//  along the query string.  You're done when it return 'nullptr'.
+	//
+	//  The 'queryPair' structure will have pointers to both the name and the value
+	//  components.  Each will be already URL decoded.
+	//  - if the value is 'nullptr', then the original query string didn't have a value
+	//    for that name.
+	//  - the value can also be a zero length string.
+	static char *getNextQueryPair(char *queryString, queryPair &nameValuePair);
+
+	//  Binds a query string straight into your variables.  Describe each field you expect
+	//  in a PROGMEM array of 'formField', and 'bindFormFields' decodes the query string
+	//  in one pass, converting and range checking each value it finds and storing it
+	//  through 'dest'.  For example:
+	//
+	//    const char fnPass[] PROGMEM = "pass";
+	//    const char fnCount[] PROGMEM = "count";
+	//    const formField fields[] PROGMEM = {
+	//        {fnPass, fieldString, 0, sizeof(pass), pass},
+	//        {fnCount, fieldInt, 1, 10, &count}};
+	//
+	//    formResult result = bindFormFields(FormData, fields, 2);
+	//    return result.Valid(2);
+	//
+	//  - fieldInt / fieldLong / fieldFloat are stored if they lie in 'min' to 'max'.
+	//  - fieldString is copied if it fits, 'max' is the size of the buffer (with the
+	//    terminating nul).  'min' is the shortest allowed length.
+	//  - fieldBool is stored 'false' for "0", "off" or "false", otherwise 'true'.  Browsers
+	//    leave out unchecked checkboxes, so set these 'false' before binding.
+	//  Names that aren't in the list are ignored.  Fields not in the query string, and
+	//  fields with bad values, are left untouched.  At most 32 fields.
+	enum fieldType : byte
+	{
+		fieldInt,
+		fieldLong,
+		fieldFloat,
+		fieldBool,
+		fieldString
+	};
+
+	struct formField
+	{
+		const char *name;           //  In PROGMEM
+		fieldType type;
+		long min;
+		long max;
+		void *dest;
+	};
+
+	struct formResult
+	{
+		uint32_t found;             //  Bit 'n' is set if fields[n] was in the query
+		uint32_t invalid;           //  Bit 'n' is set if fields[n] had a bad value
+
+		//  Bit mask of fields that weren't in the query string.
+		uint32_t Missing(byte count) const
+		{
+			return ~found & ((count < 32) ? (1UL << count) - 1 : ~0UL);
+		}
+
+		//  Every field was there, and good.
+		bool Valid(byte count) const
+		{
+			return (invalid == 0) && (Missing(count) == 0);
+		}
+	};
+
+	static formResult bindFormFields(char *queryString, const formField *fields,
+									 byte count);
+
+	//  Decodes a URL encoded string in place.  A decoded string is *never* longer than
+	//  the original string, so we don't need to know how long the buffer is.
+	static void urlDecode(char *encodedString);
+
+private:
+	static bool bindField(const formField &field, const char *value);
+};
+
+
+template <class Client, class File>
+class BasicYaawsCallback : public YaawsCallbackBase
 {
 public:
 
 	//  For form data you get the path to the file it was submitted to, and the query
-	//  string (still URL encoded).  You can use 'getNextQueryPair' (below) to split the
+	//  string (still URL encoded).  You can use 'getNextQueryPair' (above) to split the
 	//  query string into name / value pairs.  
 	//
 	//  Return 'true' to allow the requested file to be sent back to the client, return
@@ -236,7 +1765,7 @@ public:
 	//  Similar to ProcessFormData, except for 'POST' requests.  The default action is to
 	//  read the POST parameters into a buffer, then pass them to 'ProcessFormData',
 	//  above.  Override this if your post data is too long for the default handler.
-	virtual bool ProcessPostData(const char *path, EthernetClient &client,
+	virtual bool ProcessPostData(const char *path, Client &client,
 								 unsigned long contentLength);
 #endif
 
@@ -248,34 +1777,59 @@ public:
 #ifndef YAAWS_NOTHING_EVER_CHANGES
 	virtual bool IsMutable(const char *path);
 
-	virtual bool FileAction(EthernetClient &client, WebFileType &file);
+	virtual bool FileAction(Client &client, File &file);
 #endif
 
-protected:
-	//  Some utility functions you might find useful.  Declared in the base class like
-	//  this makes them available to any derived class.
+#ifdef YAAWS_CONTEXT_SIZE
+	//  The same again, with the request's own storage (YAAWS_CONTEXT_SIZE bytes, zeroed
+	//  when the connection arrived).  Override these instead of the ones above to keep
+	//  state for a request here - for example how far 'FileAction' has got.  By default
+	//  they ignore 'context' and call the ones above, except 'ProcessPostData', which
+	//  reads the data itself and passes 'context' on to 'ProcessFormData'.  These are the
+	//  ones the server calls, so override the four argument 'ProcessPostData' if you
+	//  read POST data yourself.
+	//
+	//  Overriding one of a set of overloads hides the rest (and GCC warns about it), so
+	//  bring the others into your class, for example with
+	//  'using YaawsCallback::FileAction;'.
+	virtual bool ProcessFormData(const char *path, char *FormData, void *context);
+#ifndef YAAWS_GET_IS_ALL_WE_NEED
+	virtual bool ProcessPostData(const char *path, Client &client,
+								 unsigned long contentLength, void *context);
+#endif
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+	virtual bool IsMutable(const char *path, void *context);
+	virtual bool FileAction(Client &client, File &file, void *context);
+#endif
+#endif
 
-	struct queryPair
-	{
-		const char *_name;
-		const char *_value;
-	};
+#ifdef YAAWS_ACCESS_LOG
+	//  Seconds since 1 Jan 1970 (UTC), for the access log.  Override this if you have a
+	//  clock.  The default returns 0, and the log then shows the time since the sketch
+	//  started, as a date in January 1970.
+	virtual uint32_t CurrentTime();
+#endif
 
-	//  Breaks apart a query string into name / value pairs.  Initially, call with the
-	//  original query string.  Use the return value on subsequent invokations to move
-	//  along the query string.  You're done when it return 'nullptr'.
-	//
-	//  The 'queryPair' structure will have pointers to both the name and the value
-	//  components.  Each will be already URL decoded.
-	//  - if the value is 'nullptr', then the original query string didn't have a value
-	//    for that name.
-	//  - the value can also be a zero length string.
-	static char *getNextQueryPair(char *queryString, queryPair &nameValuePair);
+#if YAAWS_SCHEDULER != YAAWS_SCHEDULE_ROUND_ROBIN
+	//  Scheduling class of a request, used when YAAWS_SCHEDULER is not round robin.  0
+	//  (the default for all requests) is bulk, up to 3 is most interactive.  Higher
+	//  priority requests get more of the link, but lower priority ones are never starved.
+	virtual byte RequestPriority(const char *path);
+#endif
 
-	//  Decodes a URL encoded string in place.  A decoded string is *never* longer than
-	//  the original string, so we don't need to know how long the buffer is.
-	static void urlDecode(char *encodedString);
+#ifndef YAAWS_GET_IS_ALL_WE_NEED
+private:
+	static constexpr size_t postBufferSize = 128;
+
+	static bool ReadPostData(Client &client, unsigned long contentLength, char *buffer);
+#endif
 };
 
+
+//  The web server with the default transport, file system and config.
+typedef BasicYaaws<> YAAWS;
+
+#include "YaawsImpl.h"
+
 #endif
 
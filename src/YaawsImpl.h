@@ -0,0 +1,3806 @@
+//  MIT License
+//
+//  Copyright(c) 2019 M Hotchin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this
+//  software and associated documentation files(the "Software"), to deal in the Software
+//  without restriction, including without limitation the rights to use, copy, modify,
+//  merge, publish, distribute, sublicense, and/or sell copies of the Software, andto
+//  permit persons to whom the Software is furnished to do so, subject to the following
+//  conditions :
+//
+//  The above copyright notice andthis permission notice shall be included in all copies
+//  or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+//  CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+//  OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//  The template half of YAAWS, included at the end of YAAWS.h - the members of
+//  BasicYaaws, its callback and its buffered client.  Each kind of server a sketch
+//  declares is compiled from these, what they all share is in YAAWS.cpp.
+
+#ifndef _YaawsImpl_h
+#define _YaawsImpl_h
+
+#include <alloca.h>
+
+#ifndef YAAWS_HUSH_NOW
+#define TRACE(X) Serial.print(YAAWS_MILLIS()),Serial.print(F("  ")),Serial.println(X)
+#define IF_TRACE(X) (X)
+#define quotedTrace(X) Serial.print(F("\"")),Serial.print(X),Serial.println(F("\""))
+#else
+#define TRACE(X) (void)0
+#define IF_TRACE(X) (void)0
+
+#define quotedTrace(x) (void)0;
+
+#endif
+
+//  Number of items in an array
+#define COUNTOF(x) (sizeof(x)/sizeof(x[0]))
+
+//  Hands a request's own storage to the callbacks, when there is any.
+#ifdef YAAWS_CONTEXT_SIZE
+#define CONTEXT_ARG(contData) , (contData).context
+#else
+#define CONTEXT_ARG(contData)
+#endif
+
+
+//  Default implementation accepts all inputs as valid.
+template <class Client, class File>
+bool BasicYaawsCallback<Client, File>::ProcessFormData(
+	const char *path, char *formData)
+{
+	return true;
+}
+
+
+#ifndef YAAWS_GET_IS_ALL_WE_NEED
+//  Reads short POST data into 'buffer', which has room for 'postBufferSize' bytes and a
+//  nul.  False if there is too much of it.
+template <class Client, class File>
+bool BasicYaawsCallback<Client, File>::ReadPostData(
+	Client &client,
+	unsigned long contentLength,
+	char *buffer)
+{
+	if (contentLength > postBufferSize)
+	{
+		return false;
+	}
+
+	//  Asking for more than was sent would wait out the stream's timeout for the rest.
+	auto amountRead = client.readBytes(buffer, contentLength);
+
+	buffer[amountRead] = '\0';
+	return true;
+}
+
+//  Default implementation just passes the POST data as a URL query string to the GET
+//  handler.
+template <class Client, class File>
+bool BasicYaawsCallback<Client, File>::ProcessPostData(
+	const char *path,
+	Client &client,
+	unsigned long contentLength)
+{
+	char buffer[postBufferSize + 1];
+
+	return ReadPostData(client, contentLength, buffer) && ProcessFormData(path, buffer);
+}
+#endif
+
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+template <class Client, class File>
+bool BasicYaawsCallback<Client, File>::IsMutable(
+	const char *)
+{
+	return false;
+}
+
+
+template <class Client, class File>
+bool BasicYaawsCallback<Client, File>::FileAction(
+	Client &, File &)
+{
+	return false;
+}
+#endif
+
+#ifdef YAAWS_CONTEXT_SIZE
+template <class Client, class File>
+bool BasicYaawsCallback<Client, File>::ProcessFormData(
+	const char *path, char *formData, void *)
+{
+	return ProcessFormData(path, formData);
+}
+
+
+#ifndef YAAWS_GET_IS_ALL_WE_NEED
+//  As above, handing the request's context on to the GET handler.
+template <class Client, class File>
+bool BasicYaawsCallback<Client, File>::ProcessPostData(
+	const char *path,
+	Client &client,
+	unsigned long contentLength,
+	void *context)
+{
+	char buffer[postBufferSize + 1];
+
+	return ReadPostData(client, contentLength, buffer) &&
+		ProcessFormData(path, buffer, context);
+}
+#endif
+
+
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+template <class Client, class File>
+bool BasicYaawsCallback<Client, File>::IsMutable(
+	const char *path, void *)
+{
+	return IsMutable(path);
+}
+
+
+template <class Client, class File>
+bool BasicYaawsCallback<Client, File>::FileAction(
+	Client &client, File &file, void *)
+{
+	return FileAction(client, file);
+}
+#endif
+#endif
+
+#ifdef YAAWS_ACCESS_LOG
+template <class Client, class File>
+uint32_t BasicYaawsCallback<Client, File>::CurrentTime()
+{
+	return 0;
+}
+#endif
+
+#if YAAWS_SCHEDULER != YAAWS_SCHEDULE_ROUND_ROBIN
+template <class Client, class File>
+byte BasicYaawsCallback<Client, File>::RequestPriority(
+	const char *)
+{
+	return 0;
+}
+#endif
+
+
+#ifdef YAAWS_PATH_CACHE
+//  True if 'file' is called 'name' (ignoring case, as FAT does).
+template <class File>
+bool YaawsBase::HasName(File &file, const char *name)
+{
+	size_t size = strlen(name) + 2;
+	char *actual = (char *)alloca(size);
+
+	return file.getName(actual, size) && (strcasecmp(actual, name) == 0);
+}
+#endif
+
+
+#ifdef YAAWS_BUFFERED_CLIENT
+template <class Client>
+size_t YaawsBufferedClient<Client>::write(uint8_t b)
+{
+	return write(&b, 1);
+}
+
+
+template <class Client>
+size_t YaawsBufferedClient<Client>::write(const uint8_t *buf, size_t size)
+{
+#ifdef YAAWS_GZIP_STREAM
+	if (_deflate != nullptr)
+	{
+		const size_t total = size;
+
+		while (size > 0)
+		{
+			size_t taken = _deflate->Compress(buf, size);
+
+			buf += taken;
+			size -= taken;
+
+			//  Partly full output waits for more, or for the end of the call.
+			if (_deflate->OutputFull())
+			{
+				SendCompressed();
+			}
+		}
+
+		return total;
+	}
+#endif
+
+	return RawWrite(buf, size);
+}
+
+
+#ifdef YAAWS_WRITE_COMBINING
+//  Top up the buffer, sending it when full.  Anything too big to buffer goes straight out.
+template <class Client>
+size_t YaawsBufferedClient<Client>::RawWrite(const uint8_t *buf, size_t size)
+{
+	const size_t total = size;
+
+	while (size > 0)
+	{
+		if ((_pending == 0) && (size >= sizeof(_buffer)))
+		{
+			return Client::write(buf, size) + (total - size);
+		}
+
+		size_t amount = min(size, sizeof(_buffer) - _pending);
+
+		memcpy(_buffer + _pending, buf, amount);
+		_pending += amount;
+		buf += amount;
+		size -= amount;
+
+		if (_pending == sizeof(_buffer))
+		{
+			SendBuffer();
+		}
+	}
+
+	return total;
+}
+#else
+template <class Client>
+size_t YaawsBufferedClient<Client>::RawWrite(const uint8_t *buf, size_t size)
+{
+	return Client::write(buf, size);
+}
+#endif
+
+
+template <class Client>
+int YaawsBufferedClient<Client>::availableForWrite()
+{
+	int available = Client::availableForWrite();
+
+#ifdef YAAWS_WRITE_COMBINING
+	available -= _pending;
+#endif
+#ifdef YAAWS_GZIP_STREAM
+	//  Compressed text is smaller, but in the worst case each byte takes nine bits.
+	if (_deflate != nullptr)
+	{
+		available = (available - _deflate->OutputLength()) / 9 * 8;
+	}
+#endif
+
+	return max(available, 0);
+}
+
+
+template <class Client>
+void YaawsBufferedClient<Client>::flush()
+{
+	Send();
+	Client::flush();
+}
+
+
+template <class Client>
+void YaawsBufferedClient<Client>::stop()
+{
+#ifdef YAAWS_GZIP_STREAM
+	EndCompression();
+#endif
+	Send();
+	Client::stop();
+}
+
+
+template <class Client>
+void YaawsBufferedClient<Client>::Send()
+{
+#ifdef YAAWS_GZIP_STREAM
+	if (_deflate != nullptr)
+	{
+		SendCompressed();
+	}
+#endif
+#ifdef YAAWS_WRITE_COMBINING
+	SendBuffer();
+#endif
+}
+
+
+#ifdef YAAWS_WRITE_COMBINING
+//  Only ever goes to the socket - compressed output is on its way through the buffer, so
+//  going back through the compressor from here would never end.
+template <class Client>
+void YaawsBufferedClient<Client>::SendBuffer()
+{
+	if (_pending != 0)
+	{
+		Client::write(_buffer, _pending);
+		_pending = 0;
+	}
+}
+#endif
+
+
+#ifdef YAAWS_GZIP_STREAM
+template <class Client>
+void YaawsBufferedClient<Client>::Compress(YaawsDeflate &deflate)
+{
+	_deflate = &deflate;
+	_deflate->Start();
+}
+
+
+//  Send the rest of the stream, and free the compressor.
+template <class Client>
+void YaawsBufferedClient<Client>::EndCompression()
+{
+	if (_deflate != nullptr)
+	{
+		while (!_deflate->Finish())
+		{
+			SendCompressed();
+		}
+
+		SendCompressed();
+		_deflate = nullptr;
+	}
+}
+
+
+//  The output is taken before it's written, so nothing can send it twice.
+template <class Client>
+void YaawsBufferedClient<Client>::SendCompressed()
+{
+	uint8_t length = _deflate->OutputLength();
+
+	_deflate->OutputSent();
+	RawWrite(_deflate->Output(), length);
+}
+#endif
+#endif
+
+
+template <class Transport, class FileSystem, class Config>
+typename BasicYaaws<Transport, FileSystem, Config>::CallbackType
+BasicYaaws<Transport, FileSystem, Config>::_defaultCallback;
+
+
+template <class Transport, class FileSystem, class Config>
+BasicYaaws<Transport, FileSystem, Config>::BasicYaaws(
+	VolumeType &SdCard,
+	CallbackType &callback,
+	const char *webRoot,
+	uint16_t port)
+	: _server(port), _SdCard(SdCard), _callback(callback), _webRoot(webRoot),
+	_activeConnections(0)
+
+{
+	_serviceIndex = 0;
+#if YAAWS_SCHEDULER == YAAWS_SCHEDULE_SHORTEST
+	_agingCount = 0;
+#endif
+#ifdef YAAWS_OVERLOAD_REJECT
+	_rejectedConnections = 0;
+#endif
+#ifdef YAAWS_FLASH_SITE
+	_flashFiles = nullptr;
+	_flashCount = 0;
+#endif
+#if YAAWS_MAX_LISTENERS > 1
+	_listeners[0] = {&_server, &_callback, _webRoot, 0};
+	_listenerCount = 1;
+#endif
+}
+
+
+
+
+template <class Transport, class FileSystem, class Config>
+BasicYaaws<Transport, FileSystem, Config>::BasicYaaws(
+	VolumeType &SdCard,
+	const char *webRoot,
+	uint16_t port)
+	: _server(port), _SdCard(SdCard), _callback(_defaultCallback), _webRoot(webRoot),
+	_activeConnections(0)
+{
+	_serviceIndex = 0;
+#if YAAWS_SCHEDULER == YAAWS_SCHEDULE_SHORTEST
+	_agingCount = 0;
+#endif
+#ifdef YAAWS_OVERLOAD_REJECT
+	_rejectedConnections = 0;
+#endif
+#ifdef YAAWS_FLASH_SITE
+	_flashFiles = nullptr;
+	_flashCount = 0;
+#endif
+#if YAAWS_MAX_LISTENERS > 1
+	_listeners[0] = {&_server, &_callback, _webRoot, 0};
+	_listenerCount = 1;
+#endif
+}
+
+
+
+
+
+
+#ifdef YAAWS_PACKED_SITE
+
+
+//  Look for 'path' (the URL path, e.g.  '/index.html') in the packed site.  If it's
+//  there, set up the current connection to send it back.
+template <class Transport, class FileSystem, class Config>
+bool BasicYaaws<Transport, FileSystem, Config>::OpenPacked(const char *path)
+{
+	if (_packBuckets == 0)
+	{
+		return false;
+	}
+
+	ContinuationData &contData = _contData[_serviceIndex];
+	const uint32_t hash = PathHash(path);
+	const size_t pathLength = strlen(path);
+
+	for (uint32_t probe = 0; probe < _packBuckets; probe++)
+	{
+		PackEntry entry;
+		uint32_t bucket = (hash + probe) & (_packBuckets - 1);
+
+		if (!_packFile.seekSet(sizeof(PackHeader) + bucket * sizeof(PackEntry)) ||
+			(_packFile.read(&entry, sizeof(entry)) != sizeof(entry)) ||
+			(entry.hash == 0))
+		{
+			return false;
+		}
+
+		if ((entry.hash != hash) || (entry.pathLength != pathLength))
+		{
+			continue;
+		}
+
+		//  Same hash, make sure it really is the same path.
+		char stored[32];
+		size_t compared = 0;
+
+		_packFile.seekSet(entry.offset - entry.pathLength);
+
+		while (compared < pathLength)
+		{
+			size_t amount = min(sizeof(stored), pathLength - compared);
+
+			if ((_packFile.read(stored, amount) != (int)amount) ||
+				(strncasecmp(stored, path + compared, amount) != 0))
+			{
+				break;
+			}
+
+			compared += amount;
+		}
+
+		if (compared == pathLength)
+		{
+			contData.source = srcPacked;
+			contData.bodyPos = entry.offset;
+			contData.bodyEnd = entry.offset + entry.length;
+			contData.bodyFlags = entry.flags;
+			contData.etag = entry.etag;
+			contData.rt = (entry.rt < UNKNOWN) ? (ResponseType)entry.rt : default200;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+#endif
+
+
+#ifdef YAAWS_FLASH_SITE
+//  Look for 'path' in the flash site (a binary search, the index is sorted).  If it's
+//  there, set up the current connection to send it back.
+template <class Transport, class FileSystem, class Config>
+bool BasicYaaws<Transport, FileSystem, Config>::OpenFlash(const char *path)
+{
+	size_t low = 0;
+	size_t high = _flashCount;
+
+	while (low < high)
+	{
+		size_t mid = (low + high) / 2;
+
+		YaawsFlashFile file;
+		memcpy_P(&file, &_flashFiles[mid], sizeof(file));
+
+		int compare = strcasecmp_P(path, file.path);
+
+		if (compare == 0)
+		{
+			ContinuationData &contData = _contData[_serviceIndex];
+
+			contData.source = srcFlash;
+			contData.flashData = file.data;
+			contData.bodyPos = 0;
+			contData.bodyEnd = file.length;
+			contData.bodyFlags = file.flags;
+			contData.etag = file.etag;
+			contData.rt = (file.rt < UNKNOWN) ? (ResponseType)file.rt : default200;
+
+			return true;
+		}
+
+		if (compare < 0)
+		{
+			high = mid;
+		}
+		else
+		{
+			low = mid + 1;
+		}
+	}
+
+	return false;
+}
+#endif
+
+
+#ifdef YAAWS_BODY_SOURCES
+//  Look for 'path' (the URL path) in flash, then the packed site.  Anything not found
+//  there comes from the SD card.  A gzip'd file is passed over if the client doesn't take
+//  gzip, and 'refused' set, so a plain copy further on can be sent instead.
+template <class Transport, class FileSystem, class Config>
+bool BasicYaaws<Transport, FileSystem, Config>::OpenBuiltIn(
+	const char *path,
+	bool &refused)
+{
+	ContinuationData &contData = _contData[_serviceIndex];
+
+	refused = false;
+
+#ifdef YAAWS_FLASH_SITE
+	if (OpenFlash(path))
+	{
+		if (contData.acceptGzip || !(contData.bodyFlags & bodyGzip))
+		{
+			return true;
+		}
+
+		refused = true;
+	}
+#endif
+#ifdef YAAWS_PACKED_SITE
+	if (OpenPacked(path))
+	{
+		if (contData.acceptGzip || !(contData.bodyFlags & bodyGzip))
+		{
+			return true;
+		}
+
+		refused = true;
+	}
+#endif
+
+	contData.source = srcSdFile;
+	return false;
+}
+#endif
+
+
+//  If this returns false, your webserver won't be working.  Check that your ethernet and
+//  SD Card are working.
+template <class Transport, class FileSystem, class Config>
+bool BasicYaaws<Transport, FileSystem, Config>::begin(void)
+{
+	FlashyFlashy::Begin();
+
+	_server.begin();
+
+	bool listening = (bool)_server;
+
+#if YAAWS_MAX_LISTENERS > 1
+	for (byte l = 1; l < _listenerCount; l++)
+	{
+		_listeners[l].server->begin();
+		listening = listening && (bool)*_listeners[l].server;
+	}
+#endif
+
+#ifdef YAAWS_STATISTICS
+	ResetStatistics();
+#endif
+
+#if YAAWS_ACCEPT_INTERVAL_MICROS
+	_lastAcceptPoll = YAAWS_MICROS() - YAAWS_ACCEPT_INTERVAL_MICROS;
+#endif
+
+#if defined(YAAWS_PATH_CACHE) || defined(YAAWS_SECTOR_CACHE)
+	InvalidateCache();
+#endif
+#ifdef YAAWS_SECTOR_CACHE
+	_sectorClock = 0;
+	_sectorHits = 0;
+	_sectorMisses = 0;
+#endif
+
+#ifdef YAAWS_CSV_INDEX
+	_csvIndexOwner = MAX_CLIENTS;
+
+	if (!_SdCard.exists(YAAWS_CSV_INDEX_DIR))
+	{
+		_SdCard.mkdir(YAAWS_CSV_INDEX_DIR);
+	}
+#endif
+
+#ifdef YAAWS_ACCESS_LOG
+	_logFirst = _logCount = _logLineDone = 0;
+	_logDropped = 0;
+	_logFill = 0;
+	_logWritten = YAAWS_MILLIS();
+	_logFile.open(YAAWS_ACCESS_LOG_FILE, O_WRITE | O_CREAT | O_AT_END);
+#endif
+
+#ifdef YAAWS_CALL_TARGET_MICROS
+	_chunkSize = 1400;
+	_microsPerKByte = 0;
+#endif
+
+#ifdef YAAWS_STACK_USAGE
+	memset(_stackUsed, 0, sizeof(_stackUsed));
+
+	byte *bottom = StackBottom();
+	byte *top = static_cast<byte *>(__builtin_frame_address(0)) - stackMargin;
+
+	//  Should the stack not be where we expect, paint nothing rather than the heap.
+	if (top > bottom)
+	{
+		_stackHeadroom = top - bottom;
+		memset(bottom, stackPaint, top - bottom);
+	}
+	else
+	{
+		_stackHeadroom = 0;
+	}
+#endif
+
+	if (listening)
+	{
+		TRACE(F("YAAWS is listening"));
+	}
+
+#ifdef YAAWS_PACKED_SITE
+	_packBuckets = 0;
+
+	if (_packFile.open(YAAWS_PACKED_SITE_FILE, O_READ))
+	{
+		PackHeader header;
+
+		if ((_packFile.read(&header, sizeof(header)) == sizeof(header)) &&
+			(memcmp_P(header.magic, packMagic, sizeof(header.magic)) == 0) &&
+			(header.version == packVersion) &&
+			((header.buckets & (header.buckets - 1)) == 0))
+		{
+			TRACE(F("Using packed site"));
+			_packBuckets = header.buckets;
+		}
+		else
+		{
+			_packFile.close();
+		}
+	}
+#endif
+
+	//  With a flash site we can get by without an SD card.
+	bool haveFiles = (_SdCard.volumeBlockCount() > 0);
+
+#ifdef YAAWS_FLASH_SITE
+	haveFiles = haveFiles || (_flashCount > 0);
+#endif
+
+	return (listening && Transport::Present() && haveFiles);
+
+
+}
+
+
+
+
+//  Send the first part of the response - the HTML Response Header.  The 'Content-Type'
+//  directive is determined by the file's extension.
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::SendResponseHeader()
+{
+	TRACE(F("SendResponseHeader"));
+	constexpr size_t buffSize = 256;
+	char buffer[buffSize + 1] = {0};
+	ContinuationData &contData = _contData[_serviceIndex];
+#ifdef YAAWS_GZIP_STREAM
+	bool compress = false;
+#endif
+
+#ifdef YAAWS_ACCESS_LOG
+	contData.logStatus = (contData.rt == htm404) ? 404 : 200;
+	contData.logBytes = contData.headOnly ? 0 : BodyLeft(_serviceIndex);
+#ifdef YAAWS_AUTOINDEX
+	if (contData.listing != lsNone)
+	{
+		contData.logBytes = 0;
+	}
+#endif
+#endif
+
+	//  404 is one piece, all others are made up of three pieces.
+	if (contData.rt != htm404)
+	{
+		strncpy_P(buffer, str200Header, buffSize);
+	}
+
+	strncat_P(buffer, pgm_read_ptr(&aResponses[contData.rt]), buffSize);
+
+	if (contData.rt != htm404)
+	{
+		strncat_P(buffer, PSTR("\n"), buffSize);
+
+		bool isCacheable = contData.sdFile.isReadOnly();
+		bool isLengthKnown = true;
+
+#ifdef YAAWS_BODY_SOURCES
+		if (contData.source != srcSdFile)
+		{
+			isCacheable = (contData.bodyFlags & bodyCacheable) != 0;
+
+			//  Only sent gzip'd to a client that asked for it.
+			if (contData.bodyFlags & bodyGzip)
+			{
+				strncat_P(buffer, PSTR("Content-Encoding: gzip\nVary: Accept-Encoding\n"),
+						  buffSize);
+			}
+
+			strncat_P(buffer, PSTR("ETag: \""), buffSize);
+			ultoa(contData.etag, buffer + strlen(buffer), 16);
+			strncat_P(buffer, PSTR("\"\n"), buffSize);
+		}
+#endif
+
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+		//  Only mutable files will have this set at this point.
+		isLengthKnown = !contData.doFileAction;
+#endif
+#ifdef YAAWS_AUTOINDEX
+		//  Directory listings are generated as we go, and always current.
+		if (contData.listing != lsNone)
+		{
+			isCacheable = false;
+			isLengthKnown = false;
+		}
+#endif
+#ifdef YAAWS_LOG_TAIL
+		//  A followed file has no end.
+		if (contData.follow)
+		{
+			isCacheable = false;
+			isLengthKnown = false;
+		}
+#endif
+
+#ifdef YAAWS_GZIP_STREAM
+		//  Text goes out compressed if the client can take it, it's worth doing, and the
+		//  compressor is free.
+		bool mayCompress = IsText(contData.rt);
+
+#ifdef YAAWS_BODY_SOURCES
+		//  Already gzip'd, and the headers already say so.
+		if ((contData.source != srcSdFile) && (contData.bodyFlags & bodyGzip))
+		{
+			mayCompress = false;
+		}
+#endif
+
+		if (mayCompress)
+		{
+			compress = contData.acceptGzip && !_deflate.Busy() &&
+				(!isLengthKnown || (BodyLeft(_serviceIndex) >= YAAWS_GZIP_MIN_SIZE));
+#ifdef YAAWS_LOG_TAIL
+			//  A follower would keep the compressor for as long as it's connected.
+			if (contData.follow)
+			{
+				compress = false;
+			}
+#endif
+
+			if (compress)
+			{
+				strncat_P(buffer, PSTR("Content-Encoding: gzip\n"), buffSize);
+				isLengthKnown = false;
+			}
+
+			strncat_P(buffer, PSTR("Vary: Accept-Encoding\n"), buffSize);
+		}
+#endif
+
+		if (isCacheable)
+		{
+			strncat_P(buffer, strCacheable, buffSize);
+		}
+		else
+		{
+			strncat_P(buffer, strNonCacheable, buffSize);
+		}
+
+		//  If the file is not mutable, we can provide a Content-length: directive.
+		if (isLengthKnown)
+		{
+			strncat_P(buffer, PSTR("Content-length: "), buffSize);
+			ultoa(BodyLeft(_serviceIndex), buffer + strlen(buffer), 10);
+			strncat_P(buffer, PSTR("\n"), buffSize);
+
+			//  TODO - Etag validation not yet implemented.
+		}
+
+		strncat_P(buffer, PSTR("\n"), buffSize);
+	}
+
+	buffer[buffSize] = '\0';
+
+	FlashyFlashy ff;
+	contData.client.write(buffer);
+
+#ifdef YAAWS_GZIP_STREAM
+	//  The body, however it's made, is written through the compressor.
+	if (compress && !contData.headOnly)
+	{
+		contData.client.Compress(_deflate);
+	}
+#endif
+
+#ifdef YAAWS_STATISTICS
+	_stats.bytesSent += strlen(buffer);
+#endif
+
+	return;
+}
+
+
+//  Clean up our connection once we are done with it, whatever the reason.  Flush the
+//  data, mark the connection as available
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::FinishConnection()
+{
+	ContinuationData &contData = _contData[_serviceIndex];
+
+	FlashyFlashy ff;
+
+#ifdef YAAWS_ACCESS_LOG
+	if (_activeConnections & SlotBit(_serviceIndex))
+	{
+		LogRequest();
+	}
+#endif
+
+#ifdef YAAWS_GZIP_STREAM
+	//  Finish the compressed stream (if any), and free the compressor for the next one.
+	contData.client.EndCompression();
+#endif
+#ifdef YAAWS_CSV_INDEX
+	if (_csvIndexOwner == _serviceIndex)
+	{
+		CloseCsvIndex();
+	}
+#endif
+
+	if (contData.client.connected())
+	{
+		contData.client.flush();
+	}
+
+	//  Even if the other end has hung up, the socket stays taken until it is stopped.
+	contData.client.stop();
+	contData.sdFile.close();
+
+#ifdef YAAWS_STATISTICS
+	if (_activeConnections & SlotBit(_serviceIndex))
+	{
+		unsigned long latency = YAAWS_MILLIS() - contData.startMillis;
+
+		_stats.requests++;
+		_stats.latencyMillis[HistogramBucket(latency)]++;
+		_stats.maxLatencyMillis = max(_stats.maxLatencyMillis, latency);
+	}
+#endif
+
+	_activeConnections &= ~SlotBit(_serviceIndex);
+
+	TRACE(F("Request complete."));
+}
+
+
+//  Position of the next byte of the body to send.
+template <class Transport, class FileSystem, class Config>
+uint32_t BasicYaaws<Transport, FileSystem, Config>::BodyPosition()
+{
+	ContinuationData &contData = _contData[_serviceIndex];
+
+#ifdef YAAWS_BODY_SOURCES
+	if (contData.source != srcSdFile)
+	{
+		return contData.bodyPos;
+	}
+#endif
+
+	return contData.sdFile.curPosition();
+}
+
+
+//  How much of the body is still to be sent on a connection.
+template <class Transport, class FileSystem, class Config>
+uint32_t BasicYaaws<Transport, FileSystem, Config>::BodyLeft(byte slot)
+{
+	ContinuationData &contData = _contData[slot];
+
+#ifdef YAAWS_BODY_SOURCES
+	if (contData.source != srcSdFile)
+	{
+		uint32_t left = contData.bodyEnd - contData.bodyPos;
+
+#ifdef YAAWS_SD_PREFETCH
+		left += contData.prefetchEnd - contData.prefetchStart;
+#endif
+
+		return left;
+	}
+#endif
+
+	uint32_t position = contData.sdFile.curPosition();
+	uint32_t left = (contData.bodyEnd > position) ? contData.bodyEnd - position : 0;
+
+#ifdef YAAWS_SD_PREFETCH
+	//  Read ahead, but not yet sent.
+	left += contData.prefetchEnd - contData.prefetchStart;
+#endif
+
+	return left;
+}
+
+
+//  Read the next part of the body to be sent.  Returns the amount read, or -1 on error.
+template <class Transport, class FileSystem, class Config>
+int BasicYaaws<Transport, FileSystem, Config>::ReadBody(byte *pBuffer, int amount)
+{
+	ContinuationData &contData = _contData[_serviceIndex];
+
+#ifdef YAAWS_PACKED_SITE
+	if (contData.source == srcPacked)
+	{
+		//  All connections share the one archive file, so seek before every read.
+		if (!_packFile.seekSet(contData.bodyPos))
+		{
+			return -1;
+		}
+
+#ifdef YAAWS_SECTOR_CACHE
+		int amountRead = ReadCached(_packFile, pBuffer, amount);
+#else
+		int amountRead = _packFile.read(pBuffer, amount);
+#endif
+
+		if (amountRead > 0)
+		{
+			contData.bodyPos += amountRead;
+		}
+
+		return amountRead;
+	}
+#endif
+#ifdef YAAWS_FLASH_SITE
+	if (contData.source == srcFlash)
+	{
+		memcpy_P(pBuffer, contData.flashData + contData.bodyPos, amount);
+		contData.bodyPos += amount;
+
+		return amount;
+	}
+#endif
+
+#ifdef YAAWS_SECTOR_CACHE
+	if (contData.shareSectors)
+	{
+		return ReadCached(contData.sdFile, pBuffer, amount);
+	}
+#endif
+
+	return contData.sdFile.read(pBuffer, amount);
+}
+
+
+#ifdef YAAWS_SD_PREFETCH
+//  The socket is busy, so read the next part of the body while we wait.  Reads no more
+//  than one buffer ahead, and stops at a sector boundary so the reads after it stay
+//  aligned.
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::Prefetch()
+{
+	ContinuationData &contData = _contData[_serviceIndex];
+
+	if (contData.prefetchStart != contData.prefetchEnd)
+	{
+		return;
+	}
+
+#ifdef YAAWS_FLASH_SITE
+	//  Nothing to wait for.
+	if (contData.source == srcFlash)
+	{
+		return;
+	}
+#endif
+
+	int amountToRead = YAAWS_PREFETCH_SIZE - (int)(BodyPosition() % 512);
+	amountToRead = (int)min((uint32_t)amountToRead, BodyLeft(_serviceIndex));
+
+	if (amountToRead > 0)
+	{
+		FlashyFlashy ff;
+
+		amountToRead = ReadBody(contData.prefetch, amountToRead);
+
+		contData.prefetchStart = 0;
+		contData.prefetchEnd = (amountToRead > 0) ? amountToRead : 0;
+	}
+}
+#endif
+
+
+//  Send the actual file to the requestor.  Will return before sending the whole file,
+//  called repeatedly to keep things going.
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::SendSdFile()
+{
+	ContinuationData &contData = _contData[_serviceIndex];
+	int amountToWrite = contData.client.availableForWrite();
+
+#ifdef YAAWS_SD_PREFETCH
+	//  A slow client's socket often has room for only a few bytes.  Reading just those
+	//  from the card, then the next few, and so on, reads each sector many times over,
+	//  so read the whole sector into the staging buffer and send from that instead.
+	if ((amountToWrite < 512) && (contData.prefetchStart == contData.prefetchEnd) &&
+		((uint32_t)amountToWrite < BodyLeft(_serviceIndex)))
+	{
+		Prefetch();
+	}
+
+	if (amountToWrite <= 0)
+	{
+		return;
+	}
+
+	//  Anything staged goes first.  It's already in RAM, so just send it and let the next
+	//  call read more.
+	if (contData.prefetchStart != contData.prefetchEnd)
+	{
+		int staged = contData.prefetchEnd - contData.prefetchStart;
+
+		amountToWrite = min(amountToWrite, staged);
+		contData.client.write(contData.prefetch + contData.prefetchStart, amountToWrite);
+		contData.prefetchStart += amountToWrite;
+#ifdef YAAWS_STATISTICS
+		_stats.bytesSent += amountToWrite;
+#endif
+#if YAAWS_SCHEDULER == YAAWS_SCHEDULE_DEFICIT
+		_bytesSent = amountToWrite;
+#endif
+
+		return;
+	}
+#endif
+
+	if (amountToWrite > 0)
+	{
+		//  Maximum we will write in one go. If we have only one client, use as much of
+		//  the underlying Ethernet frame size as possible.  Otherwise, limit to a
+		//  multiple of the SD sector size to reduce SD card redundant reads. 
+		constexpr int maxBufferSize = (MAX_CLIENTS == 1) ? 1400 : 1024;
+
+		amountToWrite = min(amountToWrite, maxBufferSize);
+
+#ifdef YAAWS_CALL_TARGET_MICROS
+		amountToWrite = min(amountToWrite, (int)_chunkSize);
+#endif
+
+		if (MAX_CLIENTS > 1)
+		{
+			//  If we want aligned reads, then make sure we are actually aligned.
+			int alignment = (maxBufferSize - (BodyPosition() % 512));
+#ifdef YAAWS_CALL_TARGET_MICROS
+			//  Pieces under a sector shouldn't straddle two.
+			if (amountToWrite < 512)
+			{
+				alignment = 512 - (BodyPosition() % 512);
+			}
+#endif
+			amountToWrite = min(amountToWrite, alignment);
+		}
+
+		//  Leaving 100 bytes seems to work fine.
+		//  TO-DO - Fine tune this somehow?
+		const int stackAvailable = freeRam() - 100;
+		const uint32_t sdFileLeft = BodyLeft(_serviceIndex);
+
+		amountToWrite = min(amountToWrite, stackAvailable);
+		amountToWrite = (int)min((uint32_t)amountToWrite, sdFileLeft);
+
+		if (amountToWrite > 0)
+		{
+			byte *pBuffer = (byte *)alloca(amountToWrite);
+
+			FlashyFlashy ff;
+
+#ifdef YAAWS_CALL_TARGET_MICROS
+			unsigned long sendStart = YAAWS_MICROS();
+#endif
+
+			amountToWrite = ReadBody(pBuffer, amountToWrite);
+
+			if (amountToWrite <= 0)
+			{
+				//  Read failed, nothing more we can do.
+				FinishConnection();
+				return;
+			}
+
+			contData.client.write(pBuffer, amountToWrite);
+
+#ifdef YAAWS_CALL_TARGET_MICROS
+			AdjustChunkSize(YAAWS_MICROS() - sendStart, amountToWrite);
+#endif
+#ifdef YAAWS_STATISTICS
+			_stats.bytesSent += amountToWrite;
+#endif
+#if YAAWS_SCHEDULER == YAAWS_SCHEDULE_DEFICIT
+			_bytesSent = amountToWrite;
+#endif
+		}
+		else
+		{
+			FinishConnection();
+		}
+	}
+}
+
+
+#ifdef YAAWS_CALL_TARGET_MICROS
+//  Feedback for the chunk size.  Keeps a running average of the cost per KByte of a
+//  read and write (weighted 1/4 to the newest), and picks the chunk that fits the
+//  target.  Never less than 64 bytes, or there is no progress to speak of; never more
+//  than the usual limit, which 'SendSdFile' applies anyway.
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::AdjustChunkSize(
+	unsigned long elapsed,
+	int amount)
+{
+	constexpr uint16_t minChunk = 64;
+	constexpr uint16_t maxChunk = 1400;
+
+	unsigned long cost = (elapsed * 1024UL) / (unsigned)amount;
+
+	cost = min(cost, 0xFFFFUL);
+	if (_microsPerKByte == 0)
+	{
+		_microsPerKByte = cost;
+	}
+	else
+	{
+		_microsPerKByte = (uint16_t)(((unsigned long)_microsPerKByte * 3 + cost) / 4);
+	}
+
+	unsigned long chunk =
+		(YAAWS_CALL_TARGET_MICROS * 1024UL) / max(_microsPerKByte, (uint16_t)1);
+
+	chunk = constrain(chunk, (unsigned long)minChunk, (unsigned long)maxChunk);
+
+	//  Whole sectors keep the reads aligned.
+	if (chunk >= 512)
+	{
+		chunk &= ~511UL;
+	}
+
+	_chunkSize = (uint16_t)chunk;
+}
+#endif
+
+
+#ifdef YAAWS_AUTOINDEX
+
+
+//  Send part of a generated directory listing.  Only a few entries go out on each call,
+//  and only one directory entry is held in memory at a time, so even a big log directory
+//  doesn't block.  'offset' and 'limit' in the query string select which entries are
+//  listed; the listing ends with a link (or 'next' value, for JSON) to the next page.
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::SendDirListing()
+{
+	ContinuationData &contData = _contData[_serviceIndex];
+
+	constexpr size_t buffSize = listingLineSize;
+	char buffer[buffSize + 1];
+
+	//  Each line is written in one go, so wait until there is room for a whole one.
+	if (contData.client.availableForWrite() < SpaceWanted(_serviceIndex))
+	{
+		return;
+	}
+
+	FlashyFlashy ff;
+
+	switch (contData.listing)
+	{
+	case lsPrologue:
+		contData.client.write((const uint8_t *)buffer,
+							  strlen(strcpy_P(buffer, contData.listJson ?
+												  strJsonPrologue : strListPrologue)));
+		contData.listing = lsEntries;
+		break;
+
+	case lsEntries:
+		for (byte n = 0; n < YAAWS_AUTOINDEX_PER_CALL; n++)
+		{
+			FileType entry;
+
+			if (!entry.openNext(&contData.sdFile, O_READ))
+			{
+				//  End of the directory.
+				contData.listing = lsEpilogue;
+				break;
+			}
+
+			if (entry.isHidden())
+			{
+				entry.close();
+				continue;
+			}
+
+			if (contData.listIndex >= contData.listTo)
+			{
+				//  There are more entries than were asked for.
+				entry.close();
+				contData.listing = lsEpilogueMore;
+				break;
+			}
+
+			if (contData.listIndex++ < contData.listFrom)
+			{
+				entry.close();
+				continue;
+			}
+
+			char name[YAAWS_AUTOINDEX_NAME_MAX + 1];
+			dir_t dirEntry;
+
+			entry.getName(name, sizeof(name));
+			entry.dirEntry(&dirEntry);
+
+			bool isDir = entry.isDir();
+
+			entry.close();
+
+			char *p = buffer;
+
+			if (contData.listJson)
+			{
+				if (contData.listIndex - 1 > contData.listFrom)
+				{
+					*p++ = ',';
+				}
+
+				p = AppendP(p, PSTR("\n{\"name\":\""));
+				p = AppendEscaped(p, p + YAAWS_AUTOINDEX_NAME_MAX, name, true);
+				p = AppendP(p, isDir ? PSTR("/\",\"size\":") : PSTR("\",\"size\":"));
+				p = AppendNumber(p, isDir ? 0 : dirEntry.fileSize);
+				p = AppendP(p, PSTR(",\"mtime\":\""));
+				p = AppendFatTime(p, dirEntry.lastWriteDate, dirEntry.lastWriteTime, true);
+				p = AppendP(p, PSTR("\"}"));
+			}
+			else
+			{
+				p = AppendP(p, PSTR("<tr><td><a href=\""));
+				p = AppendUrlEncoded(p, p + 3 * YAAWS_AUTOINDEX_NAME_MAX + 1, name);
+				p = AppendP(p, isDir ? PSTR("/\">") : PSTR("\">"));
+				p = AppendEscaped(p, p + YAAWS_AUTOINDEX_NAME_MAX, name, false);
+				p = AppendP(p, isDir ? PSTR("/</a></td><td></td><td>") :
+							PSTR("</a></td><td align=\"right\">"));
+
+				if (!isDir)
+				{
+					p = AppendNumber(p, dirEntry.fileSize);
+					p = AppendP(p, PSTR("</td><td>"));
+				}
+
+				p = AppendFatTime(p, dirEntry.lastWriteDate, dirEntry.lastWriteTime, false);
+				p = AppendP(p, PSTR("</td></tr>\n"));
+			}
+
+			contData.client.write((const uint8_t *)buffer, p - buffer);
+		}
+		break;
+
+	case lsEpilogue:
+	case lsEpilogueMore:
+	{
+		//  If we stopped early, point to where the next page starts - unless the last
+		//  entry that can be numbered has been reached.
+		bool more = (contData.listing == lsEpilogueMore) &&
+			(contData.listTo > contData.listFrom);
+		char *p = buffer;
+
+		if (contData.listJson)
+		{
+			p = AppendP(p, PSTR("\n],\"next\":"));
+
+			if (more)
+			{
+				p = AppendNumber(p, contData.listTo);
+			}
+			else
+			{
+				p = AppendP(p, PSTR("null"));
+			}
+
+			p = AppendP(p, PSTR("}\n"));
+		}
+		else
+		{
+			p = AppendP(p, PSTR("</table>\n"));
+
+			if (more)
+			{
+				p = AppendP(p, PSTR("<br><a href=\"?offset="));
+				p = AppendNumber(p, contData.listTo);
+				p = AppendP(p, PSTR("&amp;limit="));
+				p = AppendNumber(p, contData.listTo - contData.listFrom);
+				p = AppendP(p, PSTR("\">More</a>\n"));
+			}
+
+			p = AppendP(p, PSTR("</BODY>\n</HTML>\n"));
+		}
+
+		contData.client.write((const uint8_t *)buffer, p - buffer);
+		contData.listing = lsDone;
+		break;
+	}
+
+	default:
+		FinishConnection();
+		break;
+	}
+}
+#endif
+
+#ifdef YAAWS_CSV_INDEX
+
+
+//  One step towards finding the rows in the time range asked for.  Once found, they are
+//  sent as the body, like any other part of a file.
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::QueryCsv()
+{
+	ContinuationData &contData = _contData[_serviceIndex];
+
+	FlashyFlashy ff;
+
+	switch (contData.csvPhase)
+	{
+	case csvIndex:
+		if (_csvIndexOwner != _serviceIndex)
+		{
+			if (_csvIndexOwner != MAX_CLIENTS)
+			{
+				//  Someone else's turn.
+				return;
+			}
+
+			_csvIndexOwner = _serviceIndex;
+
+			if (!OpenCsvIndex())
+			{
+				//  No index to be had, so look through the whole file instead.
+				CloseCsvIndex();
+				contData.csvStart = 0;
+				contData.csvEnd = (contData.csvTo == 0xFFFFFFFFUL) ? contData.bodyEnd : 0;
+				contData.csvPhase = csvStart;
+				return;
+			}
+		}
+
+		if (!UpdateCsvIndex())
+		{
+			return;
+		}
+
+		//  Rows the index hasn't seen are still being written.
+		contData.bodyEnd = _csvScanned;
+		contData.csvStart = SearchCsvIndex(contData.csvFrom);
+		contData.csvEnd = (contData.csvTo == 0xFFFFFFFFUL) ?
+			_csvScanned : SearchCsvIndex(contData.csvTo + 1);
+		CloseCsvIndex();
+		contData.csvPhase = csvStart;
+		break;
+
+	case csvStart:
+		if (ScanCsvRows(contData.csvStart, contData.csvFrom))
+		{
+			contData.csvEnd = max(contData.csvEnd, contData.csvStart);
+			contData.csvPhase = csvEnd;
+		}
+		break;
+
+	case csvEnd:
+		if ((contData.csvTo == 0xFFFFFFFFUL) ||
+			ScanCsvRows(contData.csvEnd, contData.csvTo + 1))
+		{
+			contData.sdFile.seekSet(contData.csvStart);
+			contData.bodyEnd = contData.csvEnd;
+			contData.csvPhase = csvNone;
+		}
+		break;
+	}
+}
+
+
+//  Open the index of the file being sent.  It's named for the file's first cluster, which
+//  a later file may be given, so check that it still matches - if not, start again.
+template <class Transport, class FileSystem, class Config>
+bool BasicYaaws<Transport, FileSystem, Config>::OpenCsvIndex()
+{
+	ContinuationData &contData = _contData[_serviceIndex];
+	uint32_t cluster = contData.sdFile.firstCluster();
+	char path[sizeof(YAAWS_CSV_INDEX_DIR) + 13];
+
+	//  An empty file has no cluster, and nothing to find.
+	if (cluster == 0)
+	{
+		return false;
+	}
+
+	strcpy_P(path, PSTR(YAAWS_CSV_INDEX_DIR "/"));
+	ultoa(cluster, path + strlen(path), 16);
+	strcat_P(path, PSTR(".IDX"));
+
+	if (!_csvIndex.open(path, O_RDWR | O_CREAT))
+	{
+		return false;
+	}
+
+#ifdef YAAWS_PATH_CACHE
+	ForgetMissing();
+#endif
+
+	CsvIndexHeader header;
+
+	bool valid = (_csvIndex.read(&header, sizeof(header)) == sizeof(header)) &&
+		(memcmp_P(header.magic, csvIndexMagic, sizeof(header.magic)) == 0) &&
+		(header.scanned <= contData.bodyEnd);
+
+	//  The last row indexed should still be where the index says, with the same time.
+	if (valid && (header.rows > 0))
+	{
+		CsvIndexEntry entry;
+		byte digits[10];
+		uint32_t last = (header.rows - 1) / YAAWS_CSV_INDEX_ROWS;
+
+		valid = _csvIndex.seekSet(sizeof(header) + last * sizeof(entry)) &&
+			(_csvIndex.read(&entry, sizeof(entry)) == sizeof(entry)) &&
+			contData.sdFile.seekSet(entry.offset);
+
+		if (valid)
+		{
+			int amountRead = contData.sdFile.read(digits, sizeof(digits));
+
+			valid = (amountRead > 0) && (RowTime(digits, amountRead) == entry.time);
+		}
+	}
+
+	if (valid)
+	{
+		_csvScanned = header.scanned;
+		_csvRows = header.rows;
+	}
+	else
+	{
+		TRACE(F("New CSV index"));
+
+		//  The header goes first, so the entries can be written after it.
+		memcpy_P(header.magic, csvIndexMagic, sizeof(header.magic));
+		header.scanned = 0;
+		header.rows = 0;
+
+		if (!_csvIndex.truncate(0) ||
+			(_csvIndex.write(&header, sizeof(header)) != sizeof(header)))
+		{
+			_csvIndex.close();
+			return false;
+		}
+
+		_csvScanned = 0;
+		_csvRows = 0;
+	}
+
+	return true;
+}
+
+
+//  Save how far the index goes, and let the next connection have it.
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::CloseCsvIndex()
+{
+	if (_csvIndex.isOpen())
+	{
+		CsvIndexHeader header;
+
+		memcpy_P(header.magic, csvIndexMagic, sizeof(header.magic));
+		header.scanned = _csvScanned;
+		header.rows = _csvRows;
+
+		_csvIndex.seekSet(0);
+		_csvIndex.write(&header, sizeof(header));
+		_csvIndex.close();
+	}
+
+	_csvIndexOwner = MAX_CLIENTS;
+}
+
+
+//  Index the rows added since last time, up to YAAWS_CSV_INDEX_PER_CALL bytes of them.
+//  True once the index is up to date.  The header is only written when the index is
+//  closed; if that never happens, the entries written since are simply written again.
+template <class Transport, class FileSystem, class Config>
+bool BasicYaaws<Transport, FileSystem, Config>::UpdateCsvIndex()
+{
+	ContinuationData &contData = _contData[_serviceIndex];
+	byte buffer[YAAWS_CSV_ROW_MAX];
+	size_t looked = 0;
+
+	while (looked < YAAWS_CSV_INDEX_PER_CALL)
+	{
+		uint32_t amount = min((uint32_t)sizeof(buffer), contData.bodyEnd - _csvScanned);
+
+		if ((amount == 0) || !contData.sdFile.seekSet(_csvScanned))
+		{
+			return true;
+		}
+
+		int amountRead = contData.sdFile.read(buffer, amount);
+
+		if (amountRead <= 0)
+		{
+			return true;
+		}
+
+		looked += amountRead;
+
+		size_t rowStart = 0;
+
+		for (size_t i = 0; i < (size_t)amountRead; i++)
+		{
+			if (buffer[i] != '\n')
+			{
+				continue;
+			}
+
+			if ((_csvRows % YAAWS_CSV_INDEX_ROWS) == 0)
+			{
+				CsvIndexEntry entry;
+
+				entry.time = RowTime(buffer + rowStart, i - rowStart);
+				entry.offset = _csvScanned + rowStart;
+
+				_csvIndex.seekSet(sizeof(CsvIndexHeader) +
+								  (_csvRows / YAAWS_CSV_INDEX_ROWS) * sizeof(entry));
+				_csvIndex.write(&entry, sizeof(entry));
+			}
+
+			_csvRows++;
+			rowStart = i + 1;
+		}
+
+		if (rowStart == 0)
+		{
+			if ((size_t)amountRead < sizeof(buffer))
+			{
+				//  Just the row being written.
+				return true;
+			}
+
+			//  Too long to be a row, step over it.
+			rowStart = amountRead;
+		}
+
+		_csvScanned += rowStart;
+	}
+
+	return false;
+}
+
+
+//  Position of the last indexed row before 'time', or the start of the file.  Rows are in
+//  time order, so the first row at or after 'time' is at most YAAWS_CSV_INDEX_ROWS on.
+template <class Transport, class FileSystem, class Config>
+uint32_t BasicYaaws<Transport, FileSystem, Config>::SearchCsvIndex(uint32_t time)
+{
+	uint32_t low = 0;
+	uint32_t high = (_csvRows + YAAWS_CSV_INDEX_ROWS - 1) / YAAWS_CSV_INDEX_ROWS;
+	uint32_t offset = 0;
+
+	//  Entries before 'low' are before 'time', those from 'high' on are not.
+	while (low < high)
+	{
+		uint32_t middle = low + (high - low) / 2;
+		CsvIndexEntry entry;
+
+		if (!_csvIndex.seekSet(sizeof(CsvIndexHeader) + middle * sizeof(entry)) ||
+			(_csvIndex.read(&entry, sizeof(entry)) != sizeof(entry)))
+		{
+			return 0;
+		}
+
+		if (entry.time < time)
+		{
+			low = middle + 1;
+			offset = entry.offset;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	return offset;
+}
+
+
+//  Look through the rows from 'position' for the first with a time of at least 'time'.
+//  True once it's found (or there are no more rows), with 'position' at its start.
+//  Otherwise 'position' is moved past the rows looked at, to carry on next call.
+template <class Transport, class FileSystem, class Config>
+bool BasicYaaws<Transport, FileSystem, Config>::ScanCsvRows(
+	uint32_t &position,
+	uint32_t time)
+{
+	ContinuationData &contData = _contData[_serviceIndex];
+	byte buffer[YAAWS_CSV_ROW_MAX];
+
+	uint32_t amount = (position < contData.bodyEnd) ?
+		min((uint32_t)sizeof(buffer), contData.bodyEnd - position) : 0;
+	int amountRead = 0;
+
+	if ((amount > 0) && contData.sdFile.seekSet(position))
+	{
+		amountRead = contData.sdFile.read(buffer, amount);
+	}
+
+	if (amountRead <= 0)
+	{
+		position = contData.bodyEnd;
+		return true;
+	}
+
+	size_t rowStart = 0;
+
+	for (size_t i = 0; i < (size_t)amountRead; i++)
+	{
+		if (buffer[i] == '\n')
+		{
+			if (RowTime(buffer + rowStart, i - rowStart) >= time)
+			{
+				position += rowStart;
+				return true;
+			}
+
+			rowStart = i + 1;
+		}
+	}
+
+	if (rowStart == 0)
+	{
+		if ((size_t)amountRead < sizeof(buffer))
+		{
+			//  Just an unfinished row left.
+			position = contData.bodyEnd;
+			return true;
+		}
+
+		//  Too long to be a row, step over it.
+		rowStart = amountRead;
+	}
+
+	position += rowStart;
+	return false;
+}
+#endif
+
+
+// In general, we don't want Service calls to take *too* long. If a request is waiting,
+// then the first call will receive it, next will send back the response header. After
+// that, each call will transmit part of the response file.
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::ContinueRequest(void)
+{
+	ContinuationData &contData = _contData[_serviceIndex];
+
+#ifdef YAAWS_CSV_INDEX
+	//  A time range of a CSV file has to be found before we know what to send.
+	if (contData.csvPhase != csvNone)
+	{
+		QueryCsv();
+		return;
+	}
+#endif
+
+	if (contData.rt != FINISHED)
+	{
+		SendResponseHeader();
+		contData.rt = FINISHED;
+
+		if (contData.headOnly)
+		{
+			FinishConnection();
+		}
+	}
+#ifdef YAAWS_AUTOINDEX
+	else if (contData.listing != lsNone)
+	{
+		SendDirListing();
+	}
+#endif
+#ifdef YAAWS_LOG_TAIL
+	else if (IsFollowWaiting(_serviceIndex))
+	{
+		FollowFile();
+	}
+#endif
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+	else if (contData.doFileAction)
+	{
+		//  Wait for the socket to drain before asking for more.
+		if (contData.client.availableForWrite() < SpaceWanted(_serviceIndex))
+		{
+			return;
+		}
+
+		contData.doFileAction =
+			Callback().FileAction(contData.client, contData.sdFile CONTEXT_ARG(contData));
+#ifdef YAAWS_PATH_CACHE
+		//  It may have made files that were missing.
+		ForgetMissing();
+#endif
+
+		//  The callback may have changed the file, send whatever it now has left.
+		if (!contData.doFileAction)
+		{
+			contData.bodyEnd = contData.sdFile.fileSize();
+		}
+	}
+#endif
+	else
+	{
+		SendSdFile();
+
+		if ((BodyLeft(_serviceIndex) == 0)
+#ifdef YAAWS_LOG_TAIL
+			&& !contData.follow
+#endif
+			)
+		{
+			IF_TRACE(Serial.println(F("SendSdFile() completed")));
+			FinishConnection();
+		}
+	}
+
+	return;
+}
+
+
+#ifdef YAAWS_LOG_TAIL
+//  Start the body 'tail' bytes (if not negative) from the end of the file, at the start
+//  of a line, and remember how to find the file again if it is to be followed.
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::StartTail(
+	long tail,
+	bool follow,
+	const char *path)
+{
+	ContinuationData &contData = _contData[_serviceIndex];
+
+	if ((tail >= 0) && ((uint32_t)tail < contData.bodyEnd))
+	{
+		//  Skip the rest of the line we land in, unless we landed right at its start.  A
+		//  line too long to find the end of is sent from where we landed.
+		uint32_t start = contData.bodyEnd - tail - 1;
+		uint32_t limit = start + YAAWS_TAIL_SCAN;
+		int c;
+
+		contData.sdFile.seekSet(start);
+
+		do
+		{
+			c = contData.sdFile.read();
+		} while ((c >= 0) && (c != '\n') && (contData.sdFile.curPosition() < limit));
+
+		if ((c >= 0) && (c != '\n'))
+		{
+			contData.sdFile.seekSet(start + 1);
+		}
+	}
+
+	if (follow && (strlen(path) < sizeof(contData.followPath)))
+	{
+		strcpy(contData.followPath, path);
+		contData.follow = true;
+		contData.followMillis = YAAWS_MILLIS();
+	}
+}
+
+
+//  Connection is following a file, and has sent all there was.
+template <class Transport, class FileSystem, class Config>
+bool BasicYaaws<Transport, FileSystem, Config>::IsFollowWaiting(byte slot)
+{
+	ContinuationData &contData = _contData[slot];
+
+	return contData.follow && (contData.rt == FINISHED) && (BodyLeft(slot) == 0);
+}
+
+
+//  Look for anything added to a followed file.  Our open file has the length the file was
+//  when we opened it, so open it again to see the length now.
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::FollowFile()
+{
+	ContinuationData &contData = _contData[_serviceIndex];
+	unsigned long now = YAAWS_MILLIS();
+
+	if ((now - contData.followMillis) < YAAWS_FOLLOW_POLL_MS)
+	{
+		return;
+	}
+
+	contData.followMillis = now;
+
+	FlashyFlashy ff;
+
+	uint32_t position = contData.sdFile.curPosition();
+
+	contData.sdFile.close();
+
+	//  Gone, or rotated - nothing more will come.
+	if (!contData.sdFile.open(contData.followPath, O_READ) ||
+		(contData.sdFile.fileSize() < position) ||
+		!contData.sdFile.seekSet(position))
+	{
+		TRACE(F("Followed file gone"));
+		FinishConnection();
+		return;
+	}
+
+	contData.bodyEnd = contData.sdFile.fileSize();
+}
+#endif
+
+
+//  Uses 'filename' as a caller provided buffer for building the filename.  Reduces max
+//  stack usage by re-using already allocated space.  We'll just assume things fit.
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::Return404(char *fileName)
+{
+	TRACE(F("404!"));
+
+	ContinuationData &contData = _contData[_serviceIndex];
+
+#ifdef YAAWS_BODY_SOURCES
+	bool refused;
+
+	strcpy_P(fileName, PSTR("/404.html"));
+
+	if (OpenBuiltIn(fileName, refused))
+	{
+		contData.rt = htm404;
+		return;
+	}
+#endif
+
+	strcpy_P(fileName, GetWebRoot());
+
+	strcat_P(fileName, PSTR("/404.html"));
+
+#ifdef YAAWS_PATH_CACHE
+	OpenPath(contData.sdFile, fileName);
+#else
+	contData.sdFile.open(fileName, O_READ);
+#endif
+	contData.bodyEnd = contData.sdFile.fileSize();
+	contData.rt = htm404;
+
+	//  If there is no custom 404 file, send a canned response.
+	if (!contData.sdFile.isOpen())
+	{
+		FlashyFlashy ff;
+
+#ifdef YAAWS_ACCESS_LOG
+		contData.logStatus = 404;
+#endif
+
+		contData.client.print(F(
+			"HTTP/1.0 404 Not Found\n"
+			"Content-Type: text/html\n"
+			"Connection: close\n\n"
+			"<HTML>\n"
+			"<HEAD>\n"
+			"<title>Page Not Found</title>\n"
+			"</HEAD>\n"
+			"<BODY>\n"
+			"<h1>Error 404</h1>\n"
+			"<br>Page Not Found\n"
+			"</BODY>\n"
+			"</HTML>\n\n"));
+
+		FinishConnection();
+	}
+
+	//  Normal file processing will send the 404 file back to the client.
+}
+
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::Return400BadRequest(
+	char *fileNameBuffer)
+{
+	if (Config::only404Errors)
+	{
+		Return404(fileNameBuffer);
+		return;
+	}
+
+	FlashyFlashy ff;
+
+#ifdef YAAWS_ACCESS_LOG
+	_contData[_serviceIndex].logStatus = 400;
+#endif
+
+	_contData[_serviceIndex].client.print(F(
+		"HTTP/1.0 400 Bad Request\n"
+		"Content-Type: text/html\n"
+		"Connection: close\n\n"
+		"<HTML>\n"
+		"<HEAD>\n"
+		"<title>Bad Request</title>\n"
+		"</HEAD>\n"
+		"<BODY>\n"
+		"<h1>Error 400</h1>\n"
+		"<br>The Request is malformed.\n"
+		"</BODY>\n"
+		"</HTML>\n\n"));
+
+	FinishConnection();
+}
+
+
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::Return405MethodNotAllowed(
+	char *fileNameBuffer)
+{
+	if (Config::only404Errors)
+	{
+		Return404(fileNameBuffer);
+		return;
+	}
+
+	FlashyFlashy ff;
+
+#ifdef YAAWS_ACCESS_LOG
+	_contData[_serviceIndex].logStatus = 405;
+#endif
+
+	auto &client = _contData[_serviceIndex].client;
+
+	client.print(F(
+		"HTTP/1.0 405 Method Not Allowed\n"
+		"Content-Type: text/html\n"));
+
+	if (Config::getIsAllWeNeed)
+	{
+		client.print(F("Allow: GET, HEAD\n"));
+	}
+	else
+	{
+		client.print(F("Allow: GET, HEAD, POST\n"));
+	}
+
+	client.print(F(
+		"Connection: close\n\n"
+		"<HTML>\n"
+		"<HEAD>\n"
+		"<title>Method Not Allowed</title>\n"
+		"</HEAD>\n"
+		"<BODY>\n"
+		"<h1>Error 405</h1>\n"
+		"<br>The Request Method is invalid for this resource.\n"
+		"</BODY>\n"
+		"</HTML>\n\n"));
+
+	FinishConnection();
+}
+
+
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::Return414UriTooLong(
+	char *fileNameBuffer)
+{
+	if (Config::only404Errors)
+	{
+		Return404(fileNameBuffer);
+		return;
+	}
+
+	FlashyFlashy ff;
+
+#ifdef YAAWS_ACCESS_LOG
+	_contData[_serviceIndex].logStatus = 414;
+#endif
+
+	_contData[_serviceIndex].client.print(F(
+		"HTTP/1.0 414 URI Too Long\n"
+		"Content-Type: text/html\n"
+		"Connection: close\n\n"
+		"<HTML>\n"
+		"<HEAD>\n"
+		"<title>Request Too Long</title>\n"
+		"</HEAD>\n"
+		"<BODY>\n"
+		"<h1>Error 414</h1>\n"
+		"<br>The Request is too long.  Limit is 128 characters\n"
+		"</BODY>\n"
+		"</HTML>\n\n"));
+
+	FinishConnection();
+}
+
+
+#ifdef YAAWS_BODY_SOURCES
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::Return406NotAcceptable(
+	char *fileNameBuffer)
+{
+	if (Config::only404Errors)
+	{
+		Return404(fileNameBuffer);
+		return;
+	}
+
+	FlashyFlashy ff;
+
+#ifdef YAAWS_ACCESS_LOG
+	_contData[_serviceIndex].logStatus = 406;
+#endif
+
+	_contData[_serviceIndex].client.print(F(
+		"HTTP/1.0 406 Not Acceptable\n"
+		"Content-Type: text/html\n"
+		"Vary: Accept-Encoding\n"
+		"Connection: close\n\n"
+		"<HTML>\n"
+		"<HEAD>\n"
+		"<title>Not Acceptable</title>\n"
+		"</HEAD>\n"
+		"<BODY>\n"
+		"<h1>Error 406</h1>\n"
+		"<br>This resource is only available gzip encoded.\n"
+		"</BODY>\n"
+		"</HTML>\n\n"));
+
+	FinishConnection();
+}
+#endif
+
+#ifdef YAAWS_OVERLOAD_REJECT
+
+//  All connections are busy.  If another client is waiting, tell it so and hang up
+//  straight away.
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::RejectOverload(ServerType &server)
+{
+	ClientType client = server.accept();
+
+	if (client.connected())
+	{
+		TRACE(F("Busy, rejecting connection"));
+
+		FlashyFlashy ff;
+
+		WriteOverload(client);
+
+		_rejectedConnections++;
+	}
+
+	//  One that has already hung up still holds its socket until stopped.
+	client.stop();
+}
+#endif
+
+
+
+
+
+//  Initial processing of any request:
+//   - Read the request from the client.
+//   - Validate request type
+//   - Validate file to return
+//   - Process any form data
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::AcceptIncoming()
+{
+	// TO-DO - better buffer size for this?
+	constexpr size_t buffSize = 128;
+	char inputFileName[buffSize + 1] = {0};
+
+	inputFileName[buffSize] = '\0';
+
+	ContinuationData &contData = _contData[_serviceIndex];
+
+	contData.headOnly = false;
+#ifdef YAAWS_SD_PREFETCH
+	contData.prefetchStart = contData.prefetchEnd = 0;
+#endif
+#ifdef YAAWS_SECTOR_CACHE
+	contData.shareSectors = true;
+#endif
+#ifdef YAAWS_ACCEPT_ENCODING
+	contData.acceptGzip = false;
+#endif
+#ifdef YAAWS_LOG_TAIL
+	contData.follow = false;
+#endif
+#ifdef YAAWS_CSV_INDEX
+	contData.csvPhase = csvNone;
+#endif
+#ifdef YAAWS_ACCESS_LOG
+	contData.logStatus = 0;
+	contData.logBytes = 0;
+	contData.logMethod = rtUnknown;
+	contData.logVersion = '0';
+	contData.logPath[0] = '\0';
+#endif
+#ifdef YAAWS_AUTOINDEX
+	contData.listing = lsNone;
+#endif
+
+	//  Well isn't THAT special.  I'm seeing cases where the connection does not arrive
+	//  with the payload.  If you wait long enough, it seems to show up.  Up to 30 ms
+	//  seems possible.
+	if ((contData.rt == UNKNOWN) && !contData.client.available())
+	{
+		//  There's no timeout on this - we will wait as long as the connection is held
+		//  open.
+		TRACE(F("Awaiting incoming payload"));
+		return;
+	}
+
+	//  Start building the filename to be returned.
+	strcpy_P(inputFileName, GetWebRoot());
+
+	size_t inputOffset = strlen(inputFileName);
+	char *pRequestStart = inputFileName + inputOffset;
+
+	//  Read in incoming request until buffer is full, or no more data, or end of line,
+	//  whatever comes first.
+	while (contData.client.available() && (inputOffset < COUNTOF(inputFileName) - 1))
+	{
+		inputFileName[inputOffset] = contData.client.read();
+
+		if (inputFileName[inputOffset] == '\n')
+			break;
+
+		inputOffset++;
+	}
+
+	inputFileName[inputOffset + 1] = '\0';
+
+	if (inputFileName[inputOffset] != '\n')
+	{
+		//  If we never saw the line ending then punt
+		Return414UriTooLong(inputFileName);
+		return;
+	}
+
+	//  Look for the "HTTP" marker.  URL is encoded, so marker should never be in the URL.
+	char *end = strstr_P(inputFileName, PSTR(" HTTP"));
+
+	if (end == nullptr)
+	{
+		Return400BadRequest(inputFileName);
+		return;
+	}
+
+	//  Re-terminate the request at the marker.  Now all we have is a NUL terminated URI.
+	*end = '\0';
+
+#ifdef YAAWS_ACCESS_LOG
+	//  " HTTP/1.x"
+	if ((end[6] == '1') && (end[7] == '.') && isdigit(end[8]))
+	{
+		contData.logVersion = end[8];
+	}
+#endif
+
+	//  Determines the type of the request, then moves the URI down.  This appends it to
+	//  the webroot we initialized with (above), and gives us the filename.
+	RequestType rt = GetRequestType(pRequestStart);
+
+#ifndef YAAWS_GET_IS_ALL_WE_NEED
+	//  A server configured for GET and HEAD only treats POST as it would any other
+	//  method it doesn't know.
+	if (Config::getIsAllWeNeed && (rt == rtPost))
+	{
+		rt = rtUnknown;
+	}
+#endif
+
+#ifdef YAAWS_ACCESS_LOG
+	contData.logMethod = rt;
+	strncpy(contData.logPath, pRequestStart, sizeof(contData.logPath) - 1);
+	contData.logPath[sizeof(contData.logPath) - 1] = '\0';
+#endif
+
+	//  A 'HEAD' request is just a 'GET' without the actual payload.  Normal processing
+	//  takes care of it, stopping once the header is sent.
+	bool skipFileData = false;
+
+	switch (rt)
+	{
+	case rtGet:
+		break;
+
+	case rtHead:
+		skipFileData = true;
+		break;
+
+#ifndef YAAWS_GET_IS_ALL_WE_NEED
+	case rtPost:
+		break;
+#endif
+
+	default:
+		TRACE(F("Unknown request type"));
+		Return405MethodNotAllowed(inputFileName);
+		return;
+
+	}
+
+#ifndef YAAWS_GET_IS_ALL_WE_NEED
+	//  The end of the HTML request header is marked by the 4 character sequence
+	//  "\r\n\r\n".  Data after that may be needed for processing (e.g., POST requests)
+	//  We also want the 'Content-Length' value if there is one.
+	const char *pContentLengthMatch = contentLengthMarker;
+	bool fGetLength = false;
+	unsigned long contentLength = 0;
+#ifdef YAAWS_ACCEPT_ENCODING
+	//  Which also tells us whether the client will take a compressed response.
+	const char *pEncodingMatch = acceptEncodingMarker;
+	bool fGetEncoding = false;
+	uint32_t encodingTail = 0;  //  The last four characters seen
+	const bool readHeader = true;
+#else
+	const bool readHeader = (rt == rtPost);
+#endif
+
+	if (readHeader)
+	{
+		int HeaderMarker = 0;
+
+		while (contData.client.available() && HeaderMarker != 4)
+		{
+			byte c = contData.client.read();
+
+			switch (HeaderMarker)
+			{
+			case 0:
+			case 2:
+				if (c == '\r') HeaderMarker++; else HeaderMarker = 0;
+				break;
+
+			case 1:
+			case 3:
+				if (c == '\n') HeaderMarker++; else HeaderMarker = 0;
+				break;
+			}
+
+			//  If we found the the 'Content-length' marker, then the following digits
+			//  define the length.
+			if (fGetLength)
+			{
+				if (isdigit(c))
+				{
+					contentLength = contentLength * 10 + (c - '0');
+				}
+				else
+				{
+					//  All done
+					fGetLength = false;
+				}
+			}
+
+			//  Spec says case-insensitive!
+			byte l = tolower(c);
+
+			//  If we've matched the whole marker, then we can read the length value
+			//  (above).
+			if (MatchMarker(contentLengthMarker, pContentLengthMatch, l))
+			{
+				fGetLength = true;
+			}
+
+#ifdef YAAWS_ACCEPT_ENCODING
+			//  Look for 'gzip' anywhere in the rest of the 'Accept-Encoding' line.
+			if (fGetEncoding)
+			{
+				encodingTail = (encodingTail << 8) | l;
+
+				if (encodingTail == 0x677A6970UL)  //  "gzip"
+				{
+					contData.acceptGzip = true;
+				}
+
+				if ((c == '\r') || (c == '\n'))
+				{
+					fGetEncoding = false;
+				}
+			}
+
+			if (MatchMarker(acceptEncodingMarker, pEncodingMatch, l))
+			{
+				fGetEncoding = true;
+				encodingTail = 0;
+			}
+#endif
+		}
+
+		//  Anything other than a POST can do without the rest of the header.
+		if ((HeaderMarker != 4) && (rt == rtPost))
+		{
+			Return400BadRequest(inputFileName);
+			return;
+		}
+	}
+#endif
+
+	char *FormDataString = strchr(inputFileName, '?');
+
+	if (FormDataString != nullptr)
+	{
+		//  Split the string into the filename and the form data.
+		*FormDataString = '\0';
+		FormDataString++;
+
+		//  Input buffer now has a NUL terminated filename, then a NUL terminated string
+		//  of form data.  
+
+		//  No sense 'processing' an empty query string.
+		if (*FormDataString == '\0')
+		{
+			FormDataString = nullptr;
+		}
+		else
+		{
+			IF_TRACE(Serial.println(FormDataString));
+		}
+	}
+
+	//  Only decode the filename!  If you decode the query string, it may then contain
+	//  extra '=' or '&' characters, which will hopelessly mess up parsing the query
+	//  string.
+	urldecode2(inputFileName);
+
+#ifdef YAAWS_AUTOINDEX
+	//  Where the directory name ends, if there is no filename.
+	size_t dirNameLength = 0;
+	uint16_t listFrom = 0;
+	uint16_t listCount = 0;
+	bool listJson = false;
+#endif
+
+	if (inputFileName[strlen(inputFileName) - 1] == '/')
+	{
+		//  Path but no filename, use default
+		TRACE(F("Adding default filename"));
+
+#ifdef YAAWS_AUTOINDEX
+		//  Pick up any paging for a directory listing before it gets stomped on.
+		dirNameLength = strlen(inputFileName);
+		long from = QueryNumber(FormDataString, PSTR("offset"), 0);
+		long count = QueryNumber(FormDataString, PSTR("limit"), YAAWS_AUTOINDEX_LIMIT);
+
+		listFrom = (uint16_t)constrain(from, 0L, 0xFFFFL);
+		listCount = (uint16_t)constrain(count, 1L, (long)YAAWS_AUTOINDEX_LIMIT);
+		listJson = (FormDataString != nullptr) &&
+			(strstr_P(FormDataString, PSTR("format=json")) != nullptr);
+#endif
+
+		strcat_P(inputFileName, PSTR("index.html"));
+
+		//  We might have stomped over form data.  New rule! - default files can't have
+		//  form data!
+		FormDataString = nullptr;
+	}
+
+	TRACE(F("Requested file:"));
+	IF_TRACE(quotedTrace(inputFileName));
+
+#ifdef YAAWS_BODY_SOURCES
+	//  Files in flash or the packed site are never mutable, and know their own
+	//  'Content-type'.
+	bool refusedGzip;
+
+	if (OpenBuiltIn(pRequestStart, refusedGzip))
+	{
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+		contData.doFileAction = false;
+#endif
+	}
+	else
+#endif
+#ifdef YAAWS_PATH_CACHE
+	if (!OpenPath(contData.sdFile, inputFileName))
+#else
+	if (!contData.sdFile.open(inputFileName, O_READ))
+#endif
+	{
+#ifdef YAAWS_AUTOINDEX
+		//  No 'index.html', so list the directory instead.  Keep the '/' if the
+		//  directory is the root of the card.
+		if (dirNameLength != 0)
+		{
+			inputFileName[(dirNameLength > 1) ? dirNameLength - 1 : dirNameLength] = '\0';
+
+			if (contData.sdFile.open(inputFileName, O_READ) && contData.sdFile.isDir())
+			{
+				TRACE(F("Directory listing"));
+
+				contData.listing = skipFileData ? lsDone : lsPrologue;
+				contData.listJson = listJson;
+				contData.listIndex = 0;
+				contData.listFrom = listFrom;
+				contData.listTo = (uint16_t)min((uint32_t)listFrom + listCount, 0xFFFFUL);
+				contData.rt = listJson ? json200 : htm200;
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+				contData.doFileAction = false;
+#endif
+				return;
+			}
+
+			contData.sdFile.close();
+		}
+#endif
+		{
+#ifdef YAAWS_BODY_SOURCES
+			//  Only a gzip'd copy, and the client can't take it.
+			if (refusedGzip)
+			{
+				Return406NotAcceptable(inputFileName);
+				return;
+			}
+#endif
+			TRACE(F("Unknown file"));
+
+			//  Unknown file or filetype
+			Return404(inputFileName);
+			return;
+		}
+	}
+
+	else
+	{
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+		//  You can apply 'FileAction' only to mutable files.  We supply the URL path, NOT
+		//  the full file-system path.
+		contData.doFileAction =
+			!Config::nothingEverChanges && !contData.sdFile.isReadOnly() &&
+			Callback().IsMutable(pRequestStart CONTEXT_ARG(contData));
+#endif
+#ifdef YAAWS_SECTOR_CACHE
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+		contData.shareSectors = !contData.doFileAction;
+#endif
+#endif
+
+		//  Determine 'Content-type' of the file.
+		contData.rt = GetResponseType(inputFileName);
+		contData.bodyEnd = contData.sdFile.fileSize();
+
+#ifdef YAAWS_CSV_INDEX
+		//  A time range of a CSV file.
+		bool isCsv = (contData.rt == csv200) && (FormDataString != nullptr);
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+		isCsv = isCsv && !contData.doFileAction;
+#endif
+
+		if (isCsv)
+		{
+			long from = QueryNumber(FormDataString, PSTR("from"), -1);
+			long to = QueryNumber(FormDataString, PSTR("to"), -1);
+
+			if ((from >= 0) || (to >= 0))
+			{
+				contData.csvPhase = csvIndex;
+				contData.csvFrom = (from >= 0) ? from : 0;
+				contData.csvTo = (to >= 0) ? to : 0xFFFFFFFFUL;
+			}
+		}
+#endif
+#ifdef YAAWS_LOG_TAIL
+		//  Logs can be tailed, and followed.
+		bool isLog = (contData.rt == txt200) || (contData.rt == csv200);
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+		isLog = isLog && !contData.doFileAction;
+#endif
+#ifdef YAAWS_CSV_INDEX
+		isLog = isLog && (contData.csvPhase == csvNone);
+#endif
+
+		if (isLog)
+		{
+			StartTail(QueryNumber(FormDataString, PSTR("tail"), -1),
+					  QueryNumber(FormDataString, PSTR("follow"), 0) != 0, inputFileName);
+		}
+#endif
+	}
+
+	//  HEAD is just a GET that stops once the HTTP Response Header has been sent.
+	contData.headOnly = skipFileData;
+
+#if YAAWS_SCHEDULER != YAAWS_SCHEDULE_ROUND_ROBIN
+	contData.priority = min(Callback().RequestPriority(pRequestStart), MAX_PRIORITY);
+#endif
+
+	//  Process form data.  We assume that only 'GET' requests have data in the request
+	//  header that needs to be processed.
+	if ((rt == rtGet) && (FormDataString != nullptr))
+	{
+		TRACE(F("Form data:"));
+
+		IF_TRACE(Serial.println(FormDataString));
+		if (!Callback().ProcessFormData(pRequestStart, FormDataString
+									   CONTEXT_ARG(contData)))
+		{
+			Return400BadRequest(inputFileName);
+			return;
+		}
+	}
+
+#ifndef YAAWS_GET_IS_ALL_WE_NEED
+	if (rt == rtPost)
+	{
+		if (!Callback().ProcessPostData(pRequestStart, contData.client, contentLength
+									   CONTEXT_ARG(contData)))
+		{
+			Return400BadRequest(inputFileName);
+			return;
+		}
+	}
+#endif
+
+	//  We've processed any form data.  More calls to 'ServiceWebServer' will send the
+	//  HTTP Response Header and the file back.
+}
+
+
+
+
+//  First active connection after 'slot', wrapping around to the first active connection
+//  if there are none.  There must be at least one active connection.
+template <class Transport, class FileSystem, class Config>
+byte BasicYaaws<Transport, FileSystem, Config>::NextActiveAfter(byte slot)
+{
+	SlotMask later = _activeConnections &
+		static_cast<SlotMask>(~((SlotShift(2) << slot) - 1));
+
+	return FirstSetBit(later ? later : _activeConnections);
+}
+
+
+#if YAAWS_SCHEDULER == YAAWS_SCHEDULE_SHORTEST
+//  Active connection with the highest priority and the least left to send.  Connections
+//  still reading the request or sending the header count as having nothing left, they
+//  are cheap and we want them out of the way.  Ties go to the round robin order.
+template <class Transport, class FileSystem, class Config>
+byte BasicYaaws<Transport, FileSystem, Config>::ShortestRemaining()
+{
+	byte best = NextActiveAfter(_serviceIndex);
+
+	if (++_agingCount >= YAAWS_SCHEDULE_AGING)
+	{
+		_agingCount = 0;
+		return best;
+	}
+
+	auto remainingToSend = [this](byte slot) -> uint32_t
+	{
+		ContinuationData &contData = _contData[slot];
+
+		if ((contData.rt != FINISHED)
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+			|| contData.doFileAction
+#endif
+			)
+		{
+			return 0;
+		}
+
+		return BodyLeft(slot);
+	};
+
+	byte bestPriority = _contData[best].priority;
+	uint32_t bestRemaining = remainingToSend(best);
+
+	for (SlotMask active = _activeConnections; active != 0; active &= active - 1)
+	{
+		byte i = FirstSetBit(active);
+		byte priority = _contData[i].priority;
+		uint32_t remaining = remainingToSend(i);
+
+		if ((priority > bestPriority) ||
+			((priority == bestPriority) && (remaining < bestRemaining)))
+		{
+			best = i;
+			bestPriority = priority;
+			bestRemaining = remaining;
+		}
+	}
+
+	return best;
+}
+#endif
+
+
+//  Move to the next active connection, to be serviced on the next call.
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::AdvanceServiceIndex()
+{
+	//  With one connection, it is always the one to service.
+	if (MAX_CLIENTS == 1)
+	{
+		return;
+	}
+
+	if ((_activeConnections != 0))
+	{
+#if YAAWS_SCHEDULER == YAAWS_SCHEDULE_DEFICIT
+		//  Stay with this connection while it is sending and still has credit.  If it
+		//  sent nothing (waiting on the client, sending the header, ...) move on.
+		if ((_activeConnections & SlotBit(_serviceIndex)) && (_bytesSent != 0))
+		{
+			ContinuationData &contData = _contData[_serviceIndex];
+
+			contData.deficit -= _bytesSent;
+
+			if (contData.deficit > 0)
+			{
+				return;
+			}
+		}
+#endif
+		//  No need to look for the 'next' connection if this one is the only one.
+		if (_activeConnections != SlotBit(_serviceIndex))
+		{
+#if YAAWS_SCHEDULER == YAAWS_SCHEDULE_SHORTEST
+			_serviceIndex = ShortestRemaining();
+#else
+			_serviceIndex = NextActiveAfter(_serviceIndex);
+#endif
+		}
+
+#if YAAWS_SCHEDULER == YAAWS_SCHEDULE_DEFICIT
+		//  Fresh credit for the connection taking its turn.  Unused credit is not carried
+		//  over, so no connection can save up for a long burst.  A call can send more than
+		//  a turn is worth, so one still in debt after its credit is passed over until
+		//  the debt is paid off.  Debt is never more than one call's worth.
+		for (;;)
+		{
+			ContinuationData &next = _contData[_serviceIndex];
+
+			next.deficit = min(next.deficit, 0L) +
+				((long)YAAWS_SCHEDULE_QUANTUM << next.priority);
+
+			if (next.deficit > 0)
+			{
+				break;
+			}
+
+			_serviceIndex = NextActiveAfter(_serviceIndex);
+		}
+#endif
+	}
+	else
+	{
+		//  No active connections.
+		_serviceIndex = 0;
+	}
+}
+
+
+template <class Transport, class FileSystem, class Config>
+const char *
+BasicYaaws<Transport, FileSystem, Config>::GetWebRoot()
+{
+#if YAAWS_MAX_LISTENERS > 1
+	const char *webRoot = _listeners[_contData[_serviceIndex].listener].webRoot;
+#else
+	const char *webRoot = _webRoot;
+#endif
+
+	return (const char *)(webRoot ? webRoot : PSTR("/WWW"));
+}
+
+
+#if YAAWS_MAX_LISTENERS > 1
+template <class Transport, class FileSystem, class Config>
+bool BasicYaaws<Transport, FileSystem, Config>::AddListener(
+	ServerType &server,
+	CallbackType &callback,
+	const char *webRoot,
+	byte reserved)
+{
+	if (_listenerCount == YAAWS_MAX_LISTENERS)
+	{
+		return false;
+	}
+
+	_listeners[_listenerCount] = {&server, &callback, webRoot, 0};
+	_listenerCount++;
+
+	if (!ReserveConnections(reserved, _listenerCount - 1))
+	{
+		_listenerCount--;
+		return false;
+	}
+
+	return true;
+}
+
+
+template <class Transport, class FileSystem, class Config>
+bool BasicYaaws<Transport, FileSystem, Config>::ReserveConnections(
+	byte reserved,
+	byte listener)
+{
+	size_t total = reserved;
+
+	if (listener >= _listenerCount)
+	{
+		return false;
+	}
+
+	for (byte l = 0; l < _listenerCount; l++)
+	{
+		if (l != listener)
+		{
+			total += _listeners[l].reserved;
+		}
+	}
+
+	if (total > MAX_CLIENTS)
+	{
+		return false;
+	}
+
+	_listeners[listener].reserved = reserved;
+	return true;
+}
+
+
+//  A listener may have a new connection if it hasn't used all those kept for it, or
+//  there is a shared one free.  Connections count against their listener's reserve
+//  first.
+template <class Transport, class FileSystem, class Config>
+bool BasicYaaws<Transport, FileSystem, Config>::CanAccept(byte listener)
+{
+	byte used[YAAWS_MAX_LISTENERS] = {0};
+
+	for (SlotMask active = _activeConnections; active != 0; active &= active - 1)
+	{
+		used[_contData[FirstSetBit(active)].listener]++;
+	}
+
+	if (used[listener] < _listeners[listener].reserved)
+	{
+		return true;
+	}
+
+	byte shared = MAX_CLIENTS;
+	byte sharedUsed = 0;
+
+	for (byte l = 0; l < _listenerCount; l++)
+	{
+		shared -= _listeners[l].reserved;
+
+		if (used[l] > _listeners[l].reserved)
+		{
+			sharedUsed += used[l] - _listeners[l].reserved;
+		}
+	}
+
+	return sharedUsed < shared;
+}
+#endif
+
+
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::ServiceWebServer(void)
+{
+#ifdef YAAWS_STATISTICS
+	unsigned long callStart = YAAWS_MICROS();
+
+	ServiceConnections();
+
+	unsigned long callMicros = YAAWS_MICROS() - callStart;
+
+	_stats.serviceCalls++;
+	_stats.callMicros[HistogramBucket(callMicros)]++;
+	_stats.maxCallMicros = max(_stats.maxCallMicros, callMicros);
+#else
+	ServiceConnections();
+#endif
+
+#ifdef YAAWS_ACCESS_LOG
+	ServiceAccessLog();
+#endif
+}
+
+
+
+
+//  Room the socket needs before sending the rest of the body can make any progress.
+template <class Transport, class FileSystem, class Config>
+int BasicYaaws<Transport, FileSystem, Config>::SpaceWanted(byte slot)
+{
+	ContinuationData &contData = _contData[slot];
+
+#ifdef YAAWS_AUTOINDEX
+	if (contData.listing != lsNone)
+	{
+		return listingLineSize;
+	}
+#endif
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+	if (contData.doFileAction)
+	{
+		return YAAWS_FILEACTION_SPACE;
+	}
+#endif
+
+	(void)contData;
+	return 1;
+}
+
+
+template <class Transport, class FileSystem, class Config>
+bool BasicYaaws<Transport, FileSystem, Config>::HasPendingWork()
+{
+	//  Anything we can do for the connections we have?
+	for (SlotMask active = _activeConnections; active != 0; active &= active - 1)
+	{
+		byte slot = FirstSetBit(active);
+		ContinuationData &contData = _contData[slot];
+
+		if (!contData.client.connected())
+		{
+			//  Closed, to be tidied up.
+			return true;
+		}
+
+		if (contData.rt == UNKNOWN)
+		{
+			//  Waiting for the request.
+			if (contData.client.available())
+			{
+				return true;
+			}
+		}
+#ifdef YAAWS_LOG_TAIL
+		else if (IsFollowWaiting(slot))
+		{
+			//  Nothing to send until it's time to look for more.
+			if ((YAAWS_MILLIS() - contData.followMillis) >= YAAWS_FOLLOW_POLL_MS)
+			{
+				return true;
+			}
+		}
+#endif
+		else if (contData.rt != FINISHED)
+		{
+			//  Header still to send.
+			return true;
+		}
+		else if (contData.client.availableForWrite() >= SpaceWanted(slot))
+		{
+			return true;
+		}
+#ifdef YAAWS_SD_PREFETCH
+		else if (contData.prefetchStart == contData.prefetchEnd)
+		{
+			//  Socket is full, but we can read ahead.
+			return true;
+		}
+#endif
+	}
+
+#ifndef YAAWS_OVERLOAD_REJECT
+	//  Nowhere to put a new connection anyway.
+	if (_activeConnections == clientsMask)
+	{
+		return false;
+	}
+#endif
+
+#if YAAWS_ACCEPT_INTERVAL_MICROS
+	if ((YAAWS_MICROS() - _lastAcceptPoll) < YAAWS_ACCEPT_INTERVAL_MICROS)
+	{
+		return false;
+	}
+#endif
+
+	//  The transport looks for connected sockets that aren't one of these.
+	uint32_t ours = 0;
+
+	for (SlotMask active = _activeConnections; active != 0; active &= active - 1)
+	{
+		byte socket = Transport::SocketNumber(_contData[FirstSetBit(active)].client);
+
+		if (socket < 32)
+		{
+			ours |= 1UL << socket;
+		}
+	}
+
+	return Transport::ConnectionWaiting(ours);
+}
+
+
+template <class Transport, class FileSystem, class Config>
+unsigned long BasicYaaws<Transport, FileSystem, Config>::NextDeadlineMicros()
+{
+	if (HasPendingWork())
+	{
+		return 0;
+	}
+
+	unsigned long deadline = 0xFFFFFFFFUL;
+
+#ifdef YAAWS_LOG_TAIL
+	//  Followed files are looked at again every YAAWS_FOLLOW_POLL_MS.
+	for (SlotMask active = _activeConnections; active != 0; active &= active - 1)
+	{
+		byte slot = FirstSetBit(active);
+
+		if (IsFollowWaiting(slot))
+		{
+			unsigned long waited = YAAWS_MILLIS() - _contData[slot].followMillis;
+			unsigned long wait = (waited < YAAWS_FOLLOW_POLL_MS) ?
+				(YAAWS_FOLLOW_POLL_MS - waited) * 1000UL : 0;
+
+			deadline = min(deadline, wait);
+		}
+	}
+#endif
+
+#if YAAWS_ACCEPT_INTERVAL_MICROS
+	unsigned long sinceLook = YAAWS_MICROS() - _lastAcceptPoll;
+
+	if (_activeConnections != clientsMask)
+	{
+		unsigned long wait = (sinceLook < YAAWS_ACCEPT_INTERVAL_MICROS) ?
+			YAAWS_ACCEPT_INTERVAL_MICROS - sinceLook : 0;
+
+		deadline = min(deadline, wait);
+	}
+#endif
+
+	return deadline;
+}
+
+
+//  One pass of the web server - accept any new connections, then service one of them.
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::ServiceConnections()
+{
+#if YAAWS_SCHEDULER == YAAWS_SCHEDULE_DEFICIT
+	_bytesSent = 0;
+#endif
+
+#if YAAWS_ACCEPT_INTERVAL_MICROS
+	unsigned long now = YAAWS_MICROS();
+	const bool lookForNew = (now - _lastAcceptPoll) >= YAAWS_ACCEPT_INTERVAL_MICROS;
+
+	if (lookForNew)
+	{
+		_lastAcceptPoll = now;
+	}
+	else if (_activeConnections == 0)
+	{
+		//  Nothing to do, and not time to look for anything new.
+		return;
+	}
+#else
+	constexpr bool lookForNew = true;
+#endif
+
+#if YAAWS_MAX_LISTENERS > 1
+	const byte listenerCount = _listenerCount;
+#else
+	constexpr byte listenerCount = 1;
+#endif
+
+	if (MAX_CLIENTS > 1)
+	{
+		SlotMask freeSlots = static_cast<SlotMask>(~_activeConnections & clientsMask);
+
+		//  Fill unused connections, lowest first, until there are no more incoming.  Each
+		//  listener in turn, for as long as it has connections it may use.
+		for (byte l = 0; lookForNew && (l < listenerCount); l++)
+		{
+			ServerType &server = ListenerServer(l);
+
+			while ((freeSlots != 0) && CanAccept(l))
+			{
+				byte i = FirstSetBit(freeSlots);
+				ContinuationData &contData = _contData[i];
+
+				contData.client = server.accept();
+
+				if (contData.client.connected())
+				{
+					freeSlots &= freeSlots - 1;
+
+					//  If there are no other active connections, make this one the next to
+					//  be serviced.
+					if (_activeConnections == 0)
+					{
+						_serviceIndex = i;
+					}
+
+					//  Mark connection as active.
+					_activeConnections |= SlotBit(i);
+					contData.rt = UNKNOWN;
+#if YAAWS_MAX_LISTENERS > 1
+					contData.listener = l;
+#endif
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+					contData.doFileAction = true;
+#endif
+#if YAAWS_SCHEDULER != YAAWS_SCHEDULE_ROUND_ROBIN
+					contData.priority = 0;
+#endif
+#if YAAWS_SCHEDULER == YAAWS_SCHEDULE_DEFICIT
+					contData.deficit = 0;
+#endif
+#if defined(YAAWS_STATISTICS) || defined(YAAWS_ACCESS_LOG)
+					contData.startMillis = YAAWS_MILLIS();
+#endif
+#ifdef YAAWS_CONTEXT_SIZE
+					memset(contData.context, 0, sizeof(contData.context));
+#endif
+				}
+				else
+				{
+					//  No need to continue looking for incoming connections here.
+					break;
+				}
+			}
+		}
+	}
+	else
+	{
+		//  Only one stream
+		for (byte l = 0; lookForNew && (_activeConnections == 0) && (l < listenerCount);
+			 l++)
+		{
+			ContinuationData &contData = _contData[_serviceIndex];
+			contData.client = ListenerServer(l).accept();
+
+			if (contData.client.connected())
+			{
+				_activeConnections |= SlotBit(_serviceIndex);
+				contData.rt = UNKNOWN;
+#if YAAWS_MAX_LISTENERS > 1
+				contData.listener = l;
+#endif
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+				contData.doFileAction = true;
+#endif
+#if defined(YAAWS_STATISTICS) || defined(YAAWS_ACCESS_LOG)
+				contData.startMillis = YAAWS_MILLIS();
+#endif
+#ifdef YAAWS_CONTEXT_SIZE
+				memset(contData.context, 0, sizeof(contData.context));
+#endif
+			}
+		}
+	}
+
+#ifdef YAAWS_OVERLOAD_REJECT
+	for (byte l = 0; lookForNew && (l < listenerCount); l++)
+	{
+		if ((_activeConnections == clientsMask) || !CanAccept(l))
+		{
+			RejectOverload(ListenerServer(l));
+		}
+	}
+#endif
+
+	if (_activeConnections & SlotBit(_serviceIndex))
+	{
+		ContinuationData &contData = _contData[_serviceIndex];
+
+		if (!contData.client.connected())
+		{
+			TRACE(F("Connection unexpectedly closed"));
+
+			FinishConnection();
+		}
+		else
+		{
+#ifdef YAAWS_BUFFERED_CLIENT
+			//  A response header is held back for the first part of the body.
+			bool sendingHeader = (contData.rt != UNKNOWN) && (contData.rt != FINISHED);
+#endif
+
+#ifdef YAAWS_STACK_USAGE
+			StackPhase phase = CurrentPhase();
+#endif
+
+			if (contData.rt == UNKNOWN)
+			{
+				AcceptIncoming();
+			}
+			else
+			{
+				ContinueRequest();
+			}
+
+#ifdef YAAWS_STACK_USAGE
+			MeasureStack(phase, static_cast<byte *>(__builtin_frame_address(0)));
+#endif
+
+#ifdef YAAWS_BUFFERED_CLIENT
+			if (!sendingHeader)
+			{
+				contData.client.Send();
+			}
+#endif
+		}
+	}
+
+	AdvanceServiceIndex();
+}
+
+
+
+
+
+#ifdef YAAWS_STATISTICS
+
+
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::ResetStatistics()
+{
+	memset(&_stats, 0, sizeof(_stats));
+	_stats.startMillis = YAAWS_MILLIS();
+}
+
+
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::PrintStatistics(Print &out)
+{
+	unsigned long elapsed = YAAWS_MILLIS() - _stats.startMillis;
+
+	//  Rates are per second, worked out from the whole period.
+	out.print(F("{\"uptime_ms\":"));
+	out.print(elapsed);
+	out.print(F(",\"requests\":"));
+	out.print(_stats.requests);
+	out.print(F(",\"bytes\":"));
+	out.print(_stats.bytesSent);
+	out.print(F(",\"requests_per_s\":"));
+	out.print(elapsed ? (_stats.requests * 1000.0) / elapsed : 0.0);
+	out.print(F(",\"bytes_per_s\":"));
+	out.print(elapsed ? (_stats.bytesSent * 1000.0) / elapsed : 0.0);
+	out.print(F(",\"service_calls\":"));
+	out.print(_stats.serviceCalls);
+#ifdef YAAWS_OVERLOAD_REJECT
+	out.print(F(",\"rejected\":"));
+	out.print(_rejectedConnections);
+#endif
+	PrintHistogram(out, F("latency_ms"), _stats.latencyMillis, _stats.maxLatencyMillis);
+	PrintHistogram(out, F("call_us"), _stats.callMicros, _stats.maxCallMicros);
+#ifdef YAAWS_SECTOR_CACHE
+	out.print(F(",\"sector_hits\":"));
+	out.print(_sectorHits);
+	out.print(F(",\"sector_misses\":"));
+	out.print(_sectorMisses);
+#endif
+#ifdef YAAWS_STACK_USAGE
+	out.print(F(",\"stack\":"));
+	PrintStackUsage(out);
+#endif
+	out.println('}');
+}
+
+
+#endif
+
+
+#ifdef YAAWS_STACK_USAGE
+//  What the next call will do for the connection being serviced.
+template <class Transport, class FileSystem, class Config>
+typename BasicYaaws<Transport, FileSystem, Config>::StackPhase
+BasicYaaws<Transport, FileSystem, Config>::CurrentPhase()
+{
+	ContinuationData &contData = _contData[_serviceIndex];
+
+	if (contData.rt == UNKNOWN)
+	{
+		return stackAccept;
+	}
+
+	if (contData.rt != FINISHED)
+	{
+		return stackHeader;
+	}
+
+#ifndef YAAWS_NOTHING_EVER_CHANGES
+	if (contData.doFileAction)
+	{
+		return stackFileAction;
+	}
+#endif
+
+	return stackSend;
+}
+
+
+//  Finds how far below 'top' the stack went, by looking down from 'top' for a run of
+//  untouched pattern, then paints over what was used ready for the next call.
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::MeasureStack(StackPhase phase, byte *top)
+{
+	byte *bottom = StackBottom();
+	byte *start = top - stackMargin;
+	byte *p = start;
+	byte run = 0;
+
+	while ((p > bottom) && (run < stackRun))
+	{
+		p--;
+		run = (*p == stackPaint) ? run + 1 : 0;
+	}
+
+	byte *lowest = p + run;
+
+	_stackUsed[phase] = max(_stackUsed[phase], (uint16_t)(top - lowest));
+	_stackHeadroom = (lowest > bottom) ?
+		min(_stackHeadroom, (size_t)(lowest - bottom)) : 0;
+
+	memset(lowest, stackPaint, start - lowest);
+}
+
+
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::PrintStackUsage(Print &out)
+{
+	out.print(F("{\"accept\":"));
+	out.print(_stackUsed[stackAccept]);
+	out.print(F(",\"header\":"));
+	out.print(_stackUsed[stackHeader]);
+	out.print(F(",\"file_action\":"));
+	out.print(_stackUsed[stackFileAction]);
+	out.print(F(",\"send\":"));
+	out.print(_stackUsed[stackSend]);
+	out.print(F(",\"headroom\":"));
+	out.print(_stackHeadroom);
+	out.print('}');
+}
+#endif
+
+
+#ifdef YAAWS_ACCESS_LOG
+
+
+//  Puts the request just finished into the ring, for 'ServiceAccessLog' to write.
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::LogRequest()
+{
+	ContinuationData &contData = _contData[_serviceIndex];
+
+	//  Never got as far as a request.
+	if (contData.logStatus == 0)
+	{
+		return;
+	}
+
+	if (_logCount == YAAWS_ACCESS_LOG_RECORDS)
+	{
+		_logDropped++;
+		contData.logStatus = 0;
+		return;
+	}
+
+	LogRecord &record = _logRing[(_logFirst + _logCount) % YAAWS_ACCESS_LOG_RECORDS];
+	uint32_t left = BodyLeft(_serviceIndex);
+	unsigned long elapsed = YAAWS_MILLIS() - contData.startMillis;
+	IPAddress address = contData.client.remoteIP();
+
+	record.time = _callback.CurrentTime();
+	if (record.time == 0)
+	{
+		record.time = YAAWS_MILLIS() / 1000;
+	}
+
+	record.bytes = (contData.logBytes > left) ? contData.logBytes - left : 0;
+	record.status = contData.logStatus;
+	record.millis = (uint16_t)min(elapsed, 0xFFFFUL);
+	for (byte i = 0; i < 4; i++)
+	{
+		record.address[i] = address[i];
+	}
+	record.method = contData.logMethod;
+	record.version = contData.logVersion;
+	memcpy(record.path, contData.logPath, sizeof(record.path));
+
+	_logCount++;
+	contData.logStatus = 0;
+}
+
+
+//  One line of the log: 'host - - [date] "request" status bytes milliseconds'.  Returns
+//  its length.
+template <class Transport, class FileSystem, class Config>
+size_t BasicYaaws<Transport, FileSystem, Config>::FormatLogRecord(
+	char *line,
+	const LogRecord &record)
+{
+	char *p = line;
+
+	for (byte i = 0; i < 4; i++)
+	{
+		p = AppendNumber(p, record.address[i]);
+		*p++ = (i < 3) ? '.' : ' ';
+	}
+
+	p = AppendP(p, PSTR("- - "));
+	p = AppendLogTime(p, record.time);
+	p = AppendP(p, PSTR(" \""));
+
+	if ((record.path[0] == '\0') || (record.method > rtPost))
+	{
+		*p++ = '-';
+	}
+	else
+	{
+		const char *method = strMethods;
+
+		for (byte i = 0; i < record.method; i++)
+		{
+			method += strlen_P(method) + 1;
+		}
+
+		p = AppendP(p, method);
+		*p++ = ' ';
+
+		//  Keep the quotes around the request unambiguous.
+		for (const char *c = record.path; *c != '\0'; c++)
+		{
+			if (*c == '"')
+			{
+				p = AppendP(p, PSTR("%22"));
+			}
+			else
+			{
+				*p++ = *c;
+			}
+		}
+
+		p = AppendP(p, PSTR(" HTTP/1."));
+		*p++ = record.version;
+	}
+
+	p = AppendP(p, PSTR("\" "));
+	p = AppendNumber(p, record.status);
+	*p++ = ' ';
+
+	if (record.bytes == 0)
+	{
+		*p++ = '-';
+	}
+	else
+	{
+		p = AppendNumber(p, record.bytes);
+	}
+
+	*p++ = ' ';
+	p = AppendNumber(p, record.millis);
+	*p++ = '\n';
+	*p = '\0';
+
+	return p - line;
+}
+
+
+//  A little of the access log's work each call.  Moves (part of) one record into the
+//  sector buffer, and writes the buffer once it is full, or once it has waited long
+//  enough.  Writes wait for a call with no connections to service, unless the ring is
+//  full and records are about to be dropped.
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::ServiceAccessLog()
+{
+	if (!_logFile.isOpen())
+	{
+		return;
+	}
+
+	if ((_logCount > 0) && (_logFill < sizeof(_logSector)))
+	{
+		//  Room for the longest line, even if every character of the path is a '"'.
+		char line[YAAWS_ACCESS_LOG_PATH * 3 + 100];
+		size_t length = FormatLogRecord(line, _logRing[_logFirst]);
+		size_t amount = min(length - _logLineDone, sizeof(_logSector) - _logFill);
+
+		memcpy(_logSector + _logFill, line + _logLineDone, amount);
+		_logFill += amount;
+		_logLineDone += amount;
+
+		if (_logLineDone == length)
+		{
+			_logFirst = (_logFirst + 1) % YAAWS_ACCESS_LOG_RECORDS;
+			_logCount--;
+			_logLineDone = 0;
+		}
+	}
+
+	if ((_activeConnections == 0) || (_logCount == YAAWS_ACCESS_LOG_RECORDS))
+	{
+		if ((_logFill == sizeof(_logSector)) ||
+			((_logFill != 0) && (_logCount == 0) &&
+			 (YAAWS_MILLIS() - _logWritten >= YAAWS_ACCESS_LOG_FLUSH_MS)))
+		{
+			WriteAccessLog();
+		}
+	}
+}
+
+
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::WriteAccessLog()
+{
+	FlashyFlashy ff;
+
+	_logFile.write(_logSector, _logFill);
+	_logFile.sync();
+	_logFill = 0;
+	_logWritten = YAAWS_MILLIS();
+
+	if (_logFile.fileSize() >= YAAWS_ACCESS_LOG_MAX_SIZE)
+	{
+		TRACE(F("Starting a new access log"));
+
+		_logFile.close();
+		_SdCard.remove(YAAWS_ACCESS_LOG_OLD);
+		_SdCard.rename(YAAWS_ACCESS_LOG_FILE, YAAWS_ACCESS_LOG_OLD);
+		_logFile.open(YAAWS_ACCESS_LOG_FILE, O_WRITE | O_CREAT | O_AT_END);
+#ifdef YAAWS_PATH_CACHE
+		ForgetMissing();
+#endif
+	}
+}
+#endif
+
+
+#if defined(YAAWS_PATH_CACHE) || defined(YAAWS_SECTOR_CACHE)
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::InvalidateCache()
+{
+#ifdef YAAWS_PATH_CACHE
+	for (byte i = 0; i < YAAWS_PATH_CACHE_SIZE; i++)
+	{
+		_pathCache[i].hash = 0;
+	}
+
+	for (byte i = 0; i < YAAWS_PATH_CACHE_DIRS; i++)
+	{
+		_dirCache[i].hash = 0;
+		_dirCache[i].dir.close();
+	}
+
+	_pathCacheNext = 0;
+	_dirCacheNext = 0;
+#endif
+#ifdef YAAWS_SECTOR_CACHE
+	for (byte i = 0; i < YAAWS_SECTOR_CACHE_BLOCKS; i++)
+	{
+		_sectorCache[i].cluster = 0;
+	}
+#endif
+}
+#endif
+
+
+#ifdef YAAWS_PATH_CACHE
+
+
+//  The open directory for the first 'end - path' characters of 'path', from the cache or
+//  opened (by path) into it.  nullptr if it can't be opened.  A cached directory must
+//  have the right name as well as the right hash.
+template <class Transport, class FileSystem, class Config>
+typename BasicYaaws<Transport, FileSystem, Config>::FileType *
+BasicYaaws<Transport, FileSystem, Config>::CachedDir(char *path, char *end, uint32_t hash)
+{
+	//  The root directory keeps its '/'.
+	char *cut = (end == path) ? end + 1 : end;
+	char saved = *cut;
+	FileType *dir = nullptr;
+
+	*cut = '\0';
+
+	for (byte i = 0; (dir == nullptr) && (i < YAAWS_PATH_CACHE_DIRS); i++)
+	{
+		if ((_dirCache[i].hash == hash) && _dirCache[i].dir.isOpen() &&
+			((end == path) || HasName(_dirCache[i].dir, strrchr(path, '/') + 1)))
+		{
+			dir = &_dirCache[i].dir;
+		}
+	}
+
+	if (dir == nullptr)
+	{
+		DirCacheEntry &entry = _dirCache[_dirCacheNext];
+
+		_dirCacheNext = (_dirCacheNext + 1) % YAAWS_PATH_CACHE_DIRS;
+
+		entry.dir.close();
+		entry.hash = 0;
+
+		if (entry.dir.open(path, O_READ) && entry.dir.isDir())
+		{
+			entry.hash = hash;
+			dir = &entry.dir;
+		}
+		else
+		{
+			entry.dir.close();
+		}
+	}
+
+	*cut = saved;
+	return dir;
+}
+
+
+//  Forget the files known to be missing, after YAAWS has made a file itself.
+template <class Transport, class FileSystem, class Config>
+void BasicYaaws<Transport, FileSystem, Config>::ForgetMissing()
+{
+	for (byte i = 0; i < YAAWS_PATH_CACHE_SIZE; i++)
+	{
+		if (_pathCache[i].dirHash == 0)
+		{
+			_pathCache[i].hash = 0;
+		}
+	}
+}
+
+
+//  Opens 'path' (a full path on the card) for reading, through the path cache.
+template <class Transport, class FileSystem, class Config>
+bool BasicYaaws<Transport, FileSystem, Config>::OpenPath(FileType &file, char *path)
+{
+	const uint32_t hash = PathHash(path);
+	const byte length = (byte)min(strlen(path), (size_t)255);
+	char *slash = strrchr(path, '/');
+
+	if (slash == nullptr)
+	{
+		return file.open(path, O_READ);
+	}
+
+	for (byte i = 0; i < YAAWS_PATH_CACHE_SIZE; i++)
+	{
+		PathCacheEntry &entry = _pathCache[i];
+
+		if ((entry.hash != hash) || (entry.length != length))
+		{
+			continue;
+		}
+
+		if (entry.dirHash == 0)
+		{
+			if ((YAAWS_MILLIS() - entry.missMillis) < YAAWS_PATH_CACHE_MISS_MS)
+			{
+				TRACE(F("Known missing"));
+				return false;
+			}
+
+			//  Long enough ago that it may be there now.
+			entry.hash = 0;
+			break;
+		}
+
+		FileType *dir = CachedDir(path, slash, entry.dirHash);
+
+		//  The hash only picks the entry, the name in the directory must match too.
+		if ((dir != nullptr) && file.open(dir, entry.index, O_READ))
+		{
+			if (HasName(file, slash + 1))
+			{
+				return true;
+			}
+
+			file.close();
+		}
+
+		//  Gone stale, look for it the long way.
+		entry.hash = 0;
+		break;
+	}
+
+	bool found = file.open(path, O_READ);
+
+	PathCacheEntry &entry = _pathCache[_pathCacheNext];
+
+	_pathCacheNext = (_pathCacheNext + 1) % YAAWS_PATH_CACHE_SIZE;
+
+	entry.hash = hash;
+	entry.length = length;
+	entry.dirHash = 0;
+	entry.missMillis = YAAWS_MILLIS();
+
+	if (found)
+	{
+		uint32_t dirHash = PathHash(path, (slash == path) ? 1 : slash - path);
+
+		if (CachedDir(path, slash, dirHash) != nullptr)
+		{
+			entry.dirHash = dirHash;
+			entry.index = file.dirIndex();
+		}
+		else
+		{
+			//  Can't reopen it quickly, so don't remember it.
+			entry.hash = 0;
+		}
+	}
+
+	return found;
+}
+#endif
+
+
+#ifdef YAAWS_SECTOR_CACHE
+//  Reads from the current position of 'file' through the sector cache, leaving the file
+//  positioned after what was read.  Sectors are only added to the cache when a whole one
+//  is being read from its start, so a miss never has to seek backwards.
+template <class Transport, class FileSystem, class Config>
+int BasicYaaws<Transport, FileSystem, Config>::ReadCached(
+	FileType &file,
+	byte *pBuffer,
+	int amount)
+{
+	const uint32_t cluster = file.firstCluster();
+	const uint32_t size = file.fileSize();
+	const uint16_t dirIndex = file.dirIndex();
+	int total = 0;
+
+	while (amount > 0)
+	{
+		const uint32_t position = file.curPosition();
+		const uint32_t block = position / 512;
+		const uint16_t offset = position % 512;
+		const uint16_t inSector = (uint16_t)min((uint32_t)(512 - offset), size - position);
+		const int wanted = min(amount, (int)inSector);
+
+		if (wanted <= 0)
+		{
+			break;
+		}
+
+		SectorCacheEntry *entry = nullptr;
+		SectorCacheEntry *oldest = &_sectorCache[0];
+
+		for (byte i = 0; i < YAAWS_SECTOR_CACHE_BLOCKS; i++)
+		{
+			SectorCacheEntry &e = _sectorCache[i];
+
+			if ((e.cluster == cluster) && (e.block == block) && (e.size == size) &&
+				(e.dirIndex == dirIndex))
+			{
+				entry = &e;
+				break;
+			}
+
+			//  An empty entry beats any other.
+			const uint16_t age = _sectorClock - e.used;
+
+			if ((oldest->cluster != 0) &&
+				((e.cluster == 0) || (age > (uint16_t)(_sectorClock - oldest->used))))
+			{
+				oldest = &e;
+			}
+		}
+
+		int amountRead;
+
+		if ((entry != nullptr) && (entry->length >= offset + wanted))
+		{
+			_sectorHits++;
+			memcpy(pBuffer, entry->data + offset, wanted);
+			entry->used = ++_sectorClock;
+			amountRead = file.seekCur(wanted) ? wanted : -1;
+		}
+		else if ((offset == 0) && (wanted == inSector) && (cluster != 0))
+		{
+			entry = oldest;
+
+			_sectorMisses++;
+			entry->cluster = 0;
+			amountRead = file.read(entry->data, wanted);
+
+			if (amountRead == wanted)
+			{
+				entry->cluster = cluster;
+				entry->size = size;
+				entry->dirIndex = dirIndex;
+				entry->block = block;
+				entry->length = wanted;
+				entry->used = ++_sectorClock;
+				memcpy(pBuffer, entry->data, wanted);
+			}
+		}
+		else
+		{
+			_sectorMisses++;
+			amountRead = file.read(pBuffer, wanted);
+		}
+
+		if (amountRead <= 0)
+		{
+			return (total > 0) ? total : amountRead;
+		}
+
+		total += amountRead;
+		pBuffer += amountRead;
+		amount -= amountRead;
+
+		if (amountRead < wanted)
+		{
+			break;
+		}
+	}
+
+	return total;
+}
+#endif
+
+
+//  YAAWS.cpp keeps these for itself.
+#ifndef YAAWS_IMPLEMENTATION
+#undef TRACE
+#undef IF_TRACE
+#undef quotedTrace
+#undef COUNTOF
+#undef CONTEXT_ARG
+#endif
+
+#endif